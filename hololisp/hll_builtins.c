@@ -1,12 +1,18 @@
 #include "hll_compiler.h"
+#include "hll_f64.h"
+#include "hll_gc.h"
+#include "hll_mem.h"
 #include "hll_util.h"
 #include "hll_value.h"
 #include "hll_vm.h"
 
 #include <assert.h>
+#include <ctype.h>
 #include <inttypes.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 // 2008 edition of the POSIX standard (IEEE Standard 1003.1-2008)
 #define _POSIX_C_SOURCE 200809L
@@ -27,8 +33,26 @@ static hll_value builtin_print(struct hll_vm *vm, hll_value args) {
   return hll_car(vm, args);
 }
 
+// Arithmetic builtins keep exact integer result while all arguments are
+// integers and it does not overflow. After that the rest of arguments is
+// processed in doubles.
+
 static hll_value builtin_add(struct hll_vm *vm, hll_value args) {
-  double result = 0;
+  int64_t int_result = 0;
+  for (; hll_is_cons(args); args = hll_unwrap_cdr(args)) {
+    hll_value value = hll_unwrap_car(args);
+    int64_t sum;
+    if (!hll_is_int(value) ||
+        __builtin_add_overflow(int_result, hll_unwrap_int(value), &sum)) {
+      break;
+    }
+    int_result = sum;
+  }
+  if (!hll_is_cons(args)) {
+    return hll_int(int_result);
+  }
+
+  double result = (double)int_result;
   for (hll_value obj = args; hll_is_cons(obj); obj = hll_cdr(vm, obj)) {
     hll_value value = hll_car(vm, obj);
     if (!hll_is_num(value)) {
@@ -51,11 +75,33 @@ static hll_value builtin_sub(struct hll_vm *vm, hll_value args) {
                       hll_get_value_kind_str(hll_get_value_kind(first)));
   }
   if (hll_is_nil(hll_unwrap_cdr(args))) {
+    if (hll_is_int(first)) {
+      return hll_int(-hll_unwrap_int(first));
+    }
     return hll_num(-hll_unwrap_num(first));
   }
+
+  hll_value rest = hll_unwrap_cdr(args);
+  if (hll_is_int(first)) {
+    int64_t int_result = hll_unwrap_int(first);
+    for (; hll_is_cons(rest); rest = hll_unwrap_cdr(rest)) {
+      hll_value value = hll_unwrap_car(rest);
+      int64_t difference;
+      if (!hll_is_int(value) || __builtin_sub_overflow(int_result,
+                                                       hll_unwrap_int(value),
+                                                       &difference)) {
+        break;
+      }
+      int_result = difference;
+    }
+    if (!hll_is_cons(rest)) {
+      return hll_int(int_result);
+    }
+    first = hll_int(int_result);
+  }
+
   double result = hll_unwrap_num(first);
-  for (hll_value obj = hll_cdr(vm, args); hll_is_cons(obj);
-       obj = hll_cdr(vm, obj)) {
+  for (hll_value obj = rest; hll_is_cons(obj); obj = hll_cdr(vm, obj)) {
     hll_value value = hll_car(vm, obj);
     if (!hll_is_num(value)) {
       hll_runtime_error(vm, "'-' form expects integer arguments (got %s)",
@@ -93,7 +139,21 @@ static hll_value builtin_div(struct hll_vm *vm, hll_value args) {
 }
 
 static hll_value builtin_mul(struct hll_vm *vm, hll_value args) {
-  double result = 1;
+  int64_t int_result = 1;
+  for (; hll_is_cons(args); args = hll_unwrap_cdr(args)) {
+    hll_value value = hll_unwrap_car(args);
+    int64_t product;
+    if (!hll_is_int(value) ||
+        __builtin_mul_overflow(int_result, hll_unwrap_int(value), &product)) {
+      break;
+    }
+    int_result = product;
+  }
+  if (!hll_is_cons(args)) {
+    return hll_int(int_result);
+  }
+
+  double result = (double)int_result;
   for (hll_value obj = args; hll_is_cons(obj); obj = hll_cdr(vm, obj)) {
     hll_value value = hll_car(vm, obj);
     if (!hll_is_num(value)) {
@@ -308,9 +368,22 @@ static hll_value builtin_rem(struct hll_vm *vm, hll_value args) {
                       hll_get_value_kind_str(hll_get_value_kind(y)));
   }
 
+  if (hll_is_int(x) && hll_is_int(y) && hll_unwrap_int(y) != 0) {
+    return hll_int(hll_unwrap_int(x) % hll_unwrap_int(y));
+  }
+
   return hll_num(fmod(hll_unwrap_num(x), hll_unwrap_num(y)));
 }
 
+// Converts number to integer, rounding doubles down.
+static int64_t num_to_int(hll_value value) {
+  if (hll_is_int(value)) {
+    return hll_unwrap_int(value);
+  }
+
+  return (int64_t)floor(hll_unwrap_num(value));
+}
+
 static uint64_t xorshift64(uint64_t *state) {
   uint64_t x = *state;
   x ^= x << 13;
@@ -346,22 +419,24 @@ static hll_value builtin_random(struct hll_vm *vm, hll_value args) {
     }
   }
 
-  double result;
   if (hll_is_nil(high)) { // 0-1 float
-    result = (double)xorshift64(&vm->rng_state) / (double)UINT64_MAX;
-  } else if (hll_is_nil(low)) { // 0-high int
-    uint64_t upper = floor(hll_unwrap_num(high));
+    return hll_num((double)xorshift64(&vm->rng_state) / (double)UINT64_MAX);
+  }
+
+  int64_t result;
+  if (hll_is_nil(low)) { // 0-high int
+    uint64_t upper = num_to_int(high);
     uint64_t random = xorshift64(&vm->rng_state);
     result = random % upper;
   } else {
-    uint64_t lower = floor(hll_unwrap_num(high));
-    uint64_t upper = floor(hll_unwrap_num(low));
+    int64_t lower = num_to_int(high);
+    int64_t upper = num_to_int(low);
     assert(upper > lower);
     uint64_t random = xorshift64(&vm->rng_state);
-    result = random % (upper - lower) + lower;
+    result = (int64_t)(random % (uint64_t)(upper - lower)) + lower;
   }
 
-  return hll_num(result);
+  return hll_int(result);
 }
 
 static hll_value builtin_range(struct hll_vm *vm, hll_value args) {
@@ -394,36 +469,41 @@ static hll_value builtin_range(struct hll_vm *vm, hll_value args) {
     return hll_nil();
   }
 
-  hll_value list_head = hll_nil();
+  // Only head needs to be rooted because rest of the list is reachable from
+  // it.
+  hll_handle_scope scope = hll_gc_open_scope(vm->gc);
+  hll_handle list_head = hll_gc_handle(vm->gc, hll_nil());
   hll_value list_tail = hll_nil();
   if (hll_is_nil(low)) { // 0-high int
-    uint64_t upper = floor(hll_unwrap_num(high));
-    for (uint64_t i = 0; i < upper; ++i) {
-      hll_value n = hll_num(i);
+    int64_t upper = num_to_int(high);
+    for (int64_t i = 0; i < upper; ++i) {
+      hll_value n = hll_int(i);
       hll_value cons = hll_new_cons(vm, n, hll_nil());
-      if (hll_is_nil(list_head)) {
-        list_head = list_tail = cons;
+      if (hll_is_nil(hll_gc_get(vm->gc, list_head))) {
+        hll_gc_set(vm->gc, list_head, cons);
       } else {
         hll_unwrap_cons(list_tail)->cdr = cons;
-        list_tail = cons;
       }
+      list_tail = cons;
     }
   } else {
-    uint64_t lower = floor(hll_unwrap_num(high));
-    uint64_t upper = floor(hll_unwrap_num(low));
-    for (uint64_t i = lower; i < upper; ++i) {
-      hll_value n = hll_num(i);
+    int64_t lower = num_to_int(high);
+    int64_t upper = num_to_int(low);
+    for (int64_t i = lower; i < upper; ++i) {
+      hll_value n = hll_int(i);
       hll_value cons = hll_new_cons(vm, n, hll_nil());
-      if (hll_is_nil(list_head)) {
-        list_head = list_tail = cons;
+      if (hll_is_nil(hll_gc_get(vm->gc, list_head))) {
+        hll_gc_set(vm->gc, list_head, cons);
       } else {
         hll_unwrap_cons(list_tail)->cdr = cons;
-        list_tail = cons;
       }
+      list_tail = cons;
     }
   }
 
-  return list_head;
+  hll_value result = hll_gc_get(vm->gc, list_head);
+  hll_gc_close_scope(vm->gc, scope);
+  return result;
 }
 
 static hll_value builtin_min(struct hll_vm *vm, hll_value args) {
@@ -556,7 +636,7 @@ static hll_value builtin_even(struct hll_vm *vm, hll_value args) {
   }
 
   hll_value result = hll_nil();
-  if ((long long)hll_unwrap_num(obj) % 2 == 0) {
+  if (num_to_int(obj) % 2 == 0) {
     result = hll_true();
   }
 
@@ -575,7 +655,7 @@ static hll_value builtin_odd(struct hll_vm *vm, hll_value args) {
   }
 
   hll_value result = hll_nil();
-  if ((long long)hll_unwrap_num(obj) % 2 != 0) {
+  if (num_to_int(obj) % 2 != 0) {
     result = hll_true();
   }
 
@@ -632,6 +712,42 @@ static hll_value builtin_abs(struct hll_vm *vm, hll_value args) {
   return hll_num(fabs(hll_unwrap_num(obj)));
 }
 
+// Tells whether call to builtin with given arguments has no side effects and
+// can't fail, so that compiler can evaluate it ahead of time.
+bool hll_is_pure_builtin_call(hll_value bind, const hll_value *args,
+                              size_t arg_count) {
+  for (size_t i = 0; i < arg_count; ++i) {
+    if (!hll_is_num(args[i])) {
+      return false;
+    }
+  }
+
+  hll_value (*fn)(struct hll_vm *, hll_value) = hll_unwrap_bind(bind)->bind;
+  if (fn == builtin_add || fn == builtin_mul) {
+    return true;
+  }
+  if (fn == builtin_div) {
+    for (size_t i = 1; i < arg_count; ++i) {
+      if (hll_unwrap_num(args[i]) == 0.0) {
+        return false;
+      }
+    }
+    return arg_count >= 1;
+  }
+  if (fn == builtin_sub || fn == builtin_min || fn == builtin_max ||
+      fn == builtin_num_lt || fn == builtin_num_le || fn == builtin_num_gt ||
+      fn == builtin_num_ge || fn == builtin_num_eq || fn == builtin_num_ne) {
+    return arg_count >= 1;
+  }
+  if (fn == builtin_rem) {
+    return arg_count == 2;
+  }
+  if (fn == builtin_abs) {
+    return arg_count == 1;
+  }
+  return false;
+}
+
 static hll_value builtin_append(struct hll_vm *vm, hll_value args) {
   if (hll_get_value_kind(args) == HLL_VALUE_NIL) {
     return args;
@@ -659,6 +775,7 @@ static hll_value builtin_append(struct hll_vm *vm, hll_value args) {
 
     if (hll_get_value_kind(tail) == HLL_VALUE_CONS) {
       hll_unwrap_cons(tail)->cdr = hll_car(vm, slot);
+      hll_gc_write_barrier(vm->gc, tail);
     } else {
       tail = slot;
       list = slot;
@@ -683,6 +800,7 @@ static hll_value builtin_reverse(struct hll_vm *vm, hll_value args) {
     hll_value head = obj;
     obj = hll_cdr(vm, obj);
     hll_unwrap_cons(head)->cdr = result;
+    hll_gc_write_barrier(vm->gc, head);
     result = head;
   }
 
@@ -764,8 +882,12 @@ static hll_value builtin_sleep(struct hll_vm *vm, hll_value args) {
 }
 
 static hll_value builtin_length(struct hll_vm *vm, hll_value args) {
-  (void)vm;
-  return hll_num(hll_list_length(hll_car(vm, args)));
+  hll_value seq = hll_car(vm, args);
+  if (hll_get_value_kind(seq) == HLL_VALUE_RANGE) {
+    return hll_int(hll_unwrap_range(seq)->length);
+  }
+
+  return hll_num(hll_list_length(seq));
 }
 
 static hll_value builtin_gensym(struct hll_vm *vm, hll_value args) {
@@ -797,7 +919,1495 @@ static hll_value builtin_eq(struct hll_vm *vm, hll_value args) {
   return hll_true();
 }
 
+static hll_value builtin_vector(struct hll_vm *vm, hll_value args) {
+  // Arguments are reachable from the stack while vector is allocated.
+  hll_value vec = hll_new_vec(vm, hll_list_length(args));
+  hll_value *item = hll_unwrap_vec(vec)->items;
+  for (; hll_is_cons(args); args = hll_unwrap_cdr(args)) {
+    *item++ = hll_unwrap_car(args);
+  }
+
+  return vec;
+}
+
+static hll_value builtin_make_vector(struct hll_vm *vm, hll_value args) {
+  size_t arg_count = hll_list_length(args);
+  if (HLL_UNLIKELY(arg_count != 1 && arg_count != 2)) {
+    hll_runtime_error(vm, "'make-vector' expects 1 or 2 arguments (got %zu)",
+                      arg_count);
+    return hll_nil();
+  }
+
+  hll_value length = hll_car(vm, args);
+  if (HLL_UNLIKELY(!hll_is_num(length) || hll_unwrap_num(length) < 0)) {
+    hll_runtime_error(vm, "'make-vector' expects non-negative length");
+    return hll_nil();
+  }
+
+  hll_value vec = hll_new_vec(vm, (size_t)floor(hll_unwrap_num(length)));
+  hll_value fill = hll_car(vm, hll_cdr(vm, args));
+  hll_obj_vec *obj = hll_unwrap_vec(vec);
+  for (size_t i = 0; i < obj->length; ++i) {
+    obj->items[i] = fill;
+  }
+
+  return vec;
+}
+
+static hll_value builtin_vector_length(struct hll_vm *vm, hll_value args) {
+  if (HLL_UNLIKELY(hll_list_length(args) != 1)) {
+    hll_runtime_error(vm, "'vector-length' expects exactly 1 argument");
+    return hll_nil();
+  }
+
+  hll_value vec = hll_car(vm, args);
+  if (HLL_UNLIKELY(hll_get_value_kind(vec) != HLL_VALUE_VEC)) {
+    hll_runtime_error(vm, "'vector-length' expects vector (got %s)",
+                      hll_get_value_kind_str(hll_get_value_kind(vec)));
+    return hll_nil();
+  }
+
+  return hll_num(hll_unwrap_vec(vec)->length);
+}
+
+static hll_value builtin_vectorp(struct hll_vm *vm, hll_value args) {
+  if (HLL_UNLIKELY(hll_list_length(args) != 1)) {
+    hll_runtime_error(vm, "'vector?' expects exactly 1 argument");
+    return hll_nil();
+  }
+
+  return hll_get_value_kind(hll_car(vm, args)) == HLL_VALUE_VEC ? hll_true()
+                                                                 : hll_nil();
+}
+
+static hll_value builtin_list_to_vector(struct hll_vm *vm, hll_value args) {
+  if (HLL_UNLIKELY(hll_list_length(args) != 1)) {
+    hll_runtime_error(vm, "'list->vector' expects exactly 1 argument");
+    return hll_nil();
+  }
+
+  hll_value list = hll_car(vm, args);
+  if (HLL_UNLIKELY(!hll_is_list(list))) {
+    hll_runtime_error(vm, "'list->vector' expects list (got %s)",
+                      hll_get_value_kind_str(hll_get_value_kind(list)));
+    return hll_nil();
+  }
+
+  return builtin_vector(vm, list);
+}
+
+static hll_value builtin_vector_to_list(struct hll_vm *vm, hll_value args) {
+  if (HLL_UNLIKELY(hll_list_length(args) != 1)) {
+    hll_runtime_error(vm, "'vector->list' expects exactly 1 argument");
+    return hll_nil();
+  }
+
+  hll_value vec = hll_car(vm, args);
+  if (HLL_UNLIKELY(hll_get_value_kind(vec) != HLL_VALUE_VEC)) {
+    hll_runtime_error(vm, "'vector->list' expects vector (got %s)",
+                      hll_get_value_kind_str(hll_get_value_kind(vec)));
+    return hll_nil();
+  }
+
+  // List is built from the end, so only its head needs to be rooted. Vector
+  // is reachable from arguments.
+  hll_handle_scope scope = hll_gc_open_scope(vm->gc);
+  hll_handle list = hll_gc_handle(vm->gc, hll_nil());
+  for (size_t i = hll_unwrap_vec(vec)->length; i != 0; --i) {
+    hll_value item = hll_unwrap_vec(vec)->items[i - 1];
+    hll_gc_set(vm->gc, list,
+               hll_new_cons(vm, item, hll_gc_get(vm->gc, list)));
+  }
+
+  hll_value result = hll_gc_get(vm->gc, list);
+  hll_gc_close_scope(vm->gc, scope);
+  return result;
+}
+
+static void expect_arg_count(struct hll_vm *vm, hll_value args, size_t count,
+                             const char *name) {
+  size_t arg_count = hll_list_length(args);
+  if (HLL_UNLIKELY(arg_count != count)) {
+    hll_runtime_error(vm, "'%s' expects %zu arguments (got %zu)", name, count,
+                      arg_count);
+  }
+}
+
+static hll_obj_f64array *expect_f64array(struct hll_vm *vm, hll_value value,
+                                         const char *name) {
+  if (HLL_UNLIKELY(hll_get_value_kind(value) != HLL_VALUE_F64ARRAY)) {
+    hll_runtime_error(vm, "'%s' expects f64array (got %s)", name,
+                      hll_get_value_kind_str(hll_get_value_kind(value)));
+  }
+
+  return hll_unwrap_f64array(value);
+}
+
+static double expect_num(struct hll_vm *vm, hll_value value,
+                         const char *name) {
+  if (HLL_UNLIKELY(!hll_is_num(value))) {
+    hll_runtime_error(vm, "'%s' expects number (got %s)", name,
+                      hll_get_value_kind_str(hll_get_value_kind(value)));
+  }
+
+  return hll_unwrap_num(value);
+}
+
+static hll_value builtin_f64array(struct hll_vm *vm, hll_value args) {
+  // Arguments are reachable from the stack while array is allocated.
+  hll_value array = hll_new_f64array(vm, hll_list_length(args));
+  double *item = hll_unwrap_f64array(array)->items;
+  for (; hll_is_cons(args); args = hll_unwrap_cdr(args)) {
+    *item++ = expect_num(vm, hll_unwrap_car(args), "f64array");
+  }
+
+  return array;
+}
+
+static hll_value builtin_make_f64array(struct hll_vm *vm, hll_value args) {
+  size_t arg_count = hll_list_length(args);
+  if (HLL_UNLIKELY(arg_count != 1 && arg_count != 2)) {
+    hll_runtime_error(vm, "'make-f64array' expects 1 or 2 arguments (got %zu)",
+                      arg_count);
+    return hll_nil();
+  }
+
+  hll_value length = hll_car(vm, args);
+  if (HLL_UNLIKELY(!hll_is_num(length) || hll_unwrap_num(length) < 0)) {
+    hll_runtime_error(vm, "'make-f64array' expects non-negative length");
+    return hll_nil();
+  }
+
+  double fill = 0;
+  if (arg_count == 2) {
+    fill = expect_num(vm, hll_car(vm, hll_cdr(vm, args)), "make-f64array");
+  }
+
+  hll_value array = hll_new_f64array(vm, (size_t)floor(hll_unwrap_num(length)));
+  hll_obj_f64array *obj = hll_unwrap_f64array(array);
+  for (size_t i = 0; i < obj->length; ++i) {
+    obj->items[i] = fill;
+  }
+
+  return array;
+}
+
+static hll_value builtin_list_to_f64array(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 1, "list->f64array");
+  hll_value list = hll_car(vm, args);
+  if (HLL_UNLIKELY(!hll_is_list(list))) {
+    hll_runtime_error(vm, "'list->f64array' expects list (got %s)",
+                      hll_get_value_kind_str(hll_get_value_kind(list)));
+    return hll_nil();
+  }
+
+  return builtin_f64array(vm, list);
+}
+
+static hll_value builtin_f64array_to_list(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 1, "f64array->list");
+  hll_value array = hll_car(vm, args);
+  expect_f64array(vm, array, "f64array->list");
+
+  hll_handle_scope scope = hll_gc_open_scope(vm->gc);
+  hll_handle list = hll_gc_handle(vm->gc, hll_nil());
+  for (size_t i = hll_unwrap_f64array(array)->length; i != 0; --i) {
+    hll_value item = hll_num(hll_unwrap_f64array(array)->items[i - 1]);
+    hll_gc_set(vm->gc, list,
+               hll_new_cons(vm, item, hll_gc_get(vm->gc, list)));
+  }
+
+  hll_value result = hll_gc_get(vm->gc, list);
+  hll_gc_close_scope(vm->gc, scope);
+  return result;
+}
+
+static hll_value builtin_f64array_length(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 1, "f64array-length");
+  return hll_num(
+      expect_f64array(vm, hll_car(vm, args), "f64array-length")->length);
+}
+
+static hll_value builtin_f64arrayp(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 1, "f64array?");
+  return hll_get_value_kind(hll_car(vm, args)) == HLL_VALUE_F64ARRAY
+             ? hll_true()
+             : hll_nil();
+}
+
+static double *get_f64array_item(struct hll_vm *vm, hll_value args,
+                                 const char *name) {
+  hll_obj_f64array *array = expect_f64array(vm, hll_car(vm, args), name);
+  hll_value idx = hll_car(vm, hll_cdr(vm, args));
+  double num = expect_num(vm, idx, name);
+  if (HLL_UNLIKELY(!hll_is_int(idx) || hll_unwrap_int(idx) < 0 ||
+                   (uint64_t)hll_unwrap_int(idx) >= array->length)) {
+    hll_runtime_error(vm, "'%s' index %g is out of bounds (length %zu)", name,
+                      num, array->length);
+  }
+
+  return array->items + hll_unwrap_int(idx);
+}
+
+static hll_value builtin_f64array_ref(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 2, "f64array-ref");
+  return hll_num(*get_f64array_item(vm, args, "f64array-ref"));
+}
+
+static hll_value builtin_f64array_set(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 3, "f64array-set!");
+  hll_value value = hll_car(vm, hll_cdr(vm, hll_cdr(vm, args)));
+  double num = expect_num(vm, value, "f64array-set!");
+  *get_f64array_item(vm, args, "f64array-set!") = num;
+  return hll_car(vm, args);
+}
+
+typedef void hll_f64_binary_kernel(double *dst, const double *a,
+                                   const double *b, size_t n);
+
+// Applies element-wise kernel to two arrays of same length and returns new
+// array with result. If swap is set, operands are passed to kernel in reverse
+// order, which allows expressing > through <.
+static hll_value f64_binary(struct hll_vm *vm, hll_value args,
+                            const char *name, hll_f64_binary_kernel *kernel,
+                            bool swap) {
+  expect_arg_count(vm, args, 2, name);
+  hll_obj_f64array *a = expect_f64array(vm, hll_car(vm, args), name);
+  hll_obj_f64array *b =
+      expect_f64array(vm, hll_car(vm, hll_cdr(vm, args)), name);
+  if (HLL_UNLIKELY(a->length != b->length)) {
+    hll_runtime_error(vm,
+                      "'%s' expects arrays of same length (got %zu and %zu)",
+                      name, a->length, b->length);
+  }
+
+  // Arrays are reachable from arguments and are never moved by garbage
+  // collector, so pointers to them stay valid.
+  hll_value result = hll_new_f64array(vm, a->length);
+  double *dst = hll_unwrap_f64array(result)->items;
+  if (swap) {
+    kernel(dst, b->items, a->items, a->length);
+  } else {
+    kernel(dst, a->items, b->items, a->length);
+  }
+
+  return result;
+}
+
+static hll_value builtin_f64_add(struct hll_vm *vm, hll_value args) {
+  return f64_binary(vm, args, "f64+", hll_f64_get_kernels()->add, false);
+}
+
+static hll_value builtin_f64_sub(struct hll_vm *vm, hll_value args) {
+  return f64_binary(vm, args, "f64-", hll_f64_get_kernels()->sub, false);
+}
+
+static hll_value builtin_f64_mul(struct hll_vm *vm, hll_value args) {
+  return f64_binary(vm, args, "f64*", hll_f64_get_kernels()->mul, false);
+}
+
+static hll_value builtin_f64_lt(struct hll_vm *vm, hll_value args) {
+  return f64_binary(vm, args, "f64<", hll_f64_get_kernels()->lt, false);
+}
+
+static hll_value builtin_f64_le(struct hll_vm *vm, hll_value args) {
+  return f64_binary(vm, args, "f64<=", hll_f64_get_kernels()->le, false);
+}
+
+static hll_value builtin_f64_gt(struct hll_vm *vm, hll_value args) {
+  return f64_binary(vm, args, "f64>", hll_f64_get_kernels()->lt, true);
+}
+
+static hll_value builtin_f64_ge(struct hll_vm *vm, hll_value args) {
+  return f64_binary(vm, args, "f64>=", hll_f64_get_kernels()->le, true);
+}
+
+static hll_value builtin_f64_eq(struct hll_vm *vm, hll_value args) {
+  return f64_binary(vm, args, "f64=", hll_f64_get_kernels()->eq, false);
+}
+
+static hll_value builtin_f64_scale(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 2, "f64-scale");
+  hll_obj_f64array *a =
+      expect_f64array(vm, hll_car(vm, args), "f64-scale");
+  double k = expect_num(vm, hll_car(vm, hll_cdr(vm, args)), "f64-scale");
+
+  hll_value result = hll_new_f64array(vm, a->length);
+  hll_f64_get_kernels()->scale(hll_unwrap_f64array(result)->items, a->items,
+                               k, a->length);
+  return result;
+}
+
+static hll_value builtin_f64_fma(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 3, "f64-fma");
+  hll_obj_f64array *a = expect_f64array(vm, hll_car(vm, args), "f64-fma");
+  hll_obj_f64array *b =
+      expect_f64array(vm, hll_car(vm, hll_cdr(vm, args)), "f64-fma");
+  hll_value third = hll_car(vm, hll_cdr(vm, hll_cdr(vm, args)));
+  hll_obj_f64array *c = expect_f64array(vm, third, "f64-fma");
+  if (HLL_UNLIKELY(a->length != b->length || a->length != c->length)) {
+    hll_runtime_error(vm, "'f64-fma' expects arrays of same length");
+  }
+
+  hll_value result = hll_new_f64array(vm, a->length);
+  hll_f64_get_kernels()->fma(hll_unwrap_f64array(result)->items, a->items,
+                             b->items, c->items, a->length);
+  return result;
+}
+
+static hll_value builtin_f64_sum(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 1, "f64-sum");
+  hll_obj_f64array *a = expect_f64array(vm, hll_car(vm, args), "f64-sum");
+  return hll_num(hll_f64_get_kernels()->sum(a->items, a->length));
+}
+
+static hll_obj_f64array *expect_nonempty_f64array(struct hll_vm *vm,
+                                                  hll_value args,
+                                                  const char *name) {
+  expect_arg_count(vm, args, 1, name);
+  hll_obj_f64array *a = expect_f64array(vm, hll_car(vm, args), name);
+  if (HLL_UNLIKELY(a->length == 0)) {
+    hll_runtime_error(vm, "'%s' expects non-empty array", name);
+  }
+
+  return a;
+}
+
+static hll_value builtin_f64_min(struct hll_vm *vm, hll_value args) {
+  hll_obj_f64array *a = expect_nonempty_f64array(vm, args, "f64-min");
+  return hll_num(hll_f64_get_kernels()->min(a->items, a->length));
+}
+
+static hll_value builtin_f64_max(struct hll_vm *vm, hll_value args) {
+  hll_obj_f64array *a = expect_nonempty_f64array(vm, args, "f64-max");
+  return hll_num(hll_f64_get_kernels()->max(a->items, a->length));
+}
+
+static hll_value builtin_f64_dot(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 2, "f64-dot");
+  hll_obj_f64array *a = expect_f64array(vm, hll_car(vm, args), "f64-dot");
+  hll_obj_f64array *b =
+      expect_f64array(vm, hll_car(vm, hll_cdr(vm, args)), "f64-dot");
+  if (HLL_UNLIKELY(a->length != b->length)) {
+    hll_runtime_error(vm, "'f64-dot' expects arrays of same length (got %zu "
+                          "and %zu)",
+                      a->length, b->length);
+  }
+
+  return hll_num(hll_f64_get_kernels()->dot(a->items, b->items, a->length));
+}
+
+static hll_value builtin_make_hash(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 0, "make-hash");
+  return hll_new_hash(vm);
+}
+
+static hll_value builtin_hashp(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 1, "hash?");
+  return hll_get_value_kind(hll_car(vm, args)) == HLL_VALUE_HASH ? hll_true()
+                                                                  : hll_nil();
+}
+
+static hll_value expect_hash(struct hll_vm *vm, hll_value value,
+                             const char *name) {
+  if (HLL_UNLIKELY(hll_get_value_kind(value) != HLL_VALUE_HASH)) {
+    hll_runtime_error(vm, "'%s' expects hash table (got %s)", name,
+                      hll_get_value_kind_str(hll_get_value_kind(value)));
+  }
+
+  return value;
+}
+
+static hll_value builtin_hash_ref(struct hll_vm *vm, hll_value args) {
+  size_t arg_count = hll_list_length(args);
+  if (HLL_UNLIKELY(arg_count != 2 && arg_count != 3)) {
+    hll_runtime_error(vm, "'hash-ref' expects 2 or 3 arguments (got %zu)",
+                      arg_count);
+    return hll_nil();
+  }
+
+  hll_value hash = expect_hash(vm, hll_car(vm, args), "hash-ref");
+  hll_value *value = hll_hash_get(hash, hll_car(vm, hll_cdr(vm, args)));
+  if (value == NULL) {
+    // Default value is nil if not given.
+    return hll_car(vm, hll_cdr(vm, hll_cdr(vm, args)));
+  }
+
+  return *value;
+}
+
+static hll_value builtin_hash_set(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 3, "hash-set!");
+  hll_value hash = expect_hash(vm, hll_car(vm, args), "hash-set!");
+  hll_value key = hll_car(vm, hll_cdr(vm, args));
+  hll_value value = hll_car(vm, hll_cdr(vm, hll_cdr(vm, args)));
+  hll_hash_set(vm, hash, key, value);
+  return value;
+}
+
+static hll_value builtin_hash_remove(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 2, "hash-remove!");
+  hll_value hash = expect_hash(vm, hll_car(vm, args), "hash-remove!");
+  return hll_hash_remove(hash, hll_car(vm, hll_cdr(vm, args))) ? hll_true()
+                                                                : hll_nil();
+}
+
+static hll_value builtin_hash_count(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 1, "hash-count");
+  hll_value hash = expect_hash(vm, hll_car(vm, args), "hash-count");
+  return hll_num(hll_unwrap_hash(hash)->count);
+}
+
+typedef enum {
+  HLL_HASH_LIST_KEYS,
+  HLL_HASH_LIST_VALUES,
+  HLL_HASH_LIST_PAIRS,
+} hll_hash_list_kind;
+
+// Collects contents of hash table into a list. Order of items is the order
+// of entries in table, which is unspecified.
+static hll_value hash_to_list(struct hll_vm *vm, hll_value args,
+                              const char *name, hll_hash_list_kind kind) {
+  expect_arg_count(vm, args, 1, name);
+  hll_value hash = expect_hash(vm, hll_car(vm, args), name);
+
+  // Table is reachable from arguments. Its entries are not modified while
+  // list is built, so iterating them across allocations is safe.
+  hll_handle_scope scope = hll_gc_open_scope(vm->gc);
+  hll_handle list = hll_gc_handle(vm->gc, hll_nil());
+  hll_handle item = hll_gc_handle(vm->gc, hll_nil());
+  for (size_t i = hll_unwrap_hash(hash)->capacity; i != 0; --i) {
+    hll_hash_entry *entry = hll_unwrap_hash(hash)->entries + i - 1;
+    if (!hll_hash_entry_is_live(entry)) {
+      continue;
+    }
+
+    switch (kind) {
+    case HLL_HASH_LIST_KEYS:
+      hll_gc_set(vm->gc, item, entry->key);
+      break;
+    case HLL_HASH_LIST_VALUES:
+      hll_gc_set(vm->gc, item, entry->value);
+      break;
+    case HLL_HASH_LIST_PAIRS:
+      hll_gc_set(vm->gc, item, hll_new_cons(vm, entry->key, entry->value));
+      break;
+    default:
+      HLL_UNREACHABLE;
+      break;
+    }
+    hll_gc_set(vm->gc, list,
+               hll_new_cons(vm, hll_gc_get(vm->gc, item),
+                            hll_gc_get(vm->gc, list)));
+  }
+
+  hll_value result = hll_gc_get(vm->gc, list);
+  hll_gc_close_scope(vm->gc, scope);
+  return result;
+}
+
+static hll_value builtin_hash_keys(struct hll_vm *vm, hll_value args) {
+  return hash_to_list(vm, args, "hash-keys", HLL_HASH_LIST_KEYS);
+}
+
+static hll_value builtin_hash_values(struct hll_vm *vm, hll_value args) {
+  return hash_to_list(vm, args, "hash-values", HLL_HASH_LIST_VALUES);
+}
+
+static hll_value builtin_hash_to_alist(struct hll_vm *vm, hll_value args) {
+  return hash_to_list(vm, args, "hash->alist", HLL_HASH_LIST_PAIRS);
+}
+
+// Builds list front to back for native code. Only head is rooted, following
+// conses are reachable from it. Conses are not moved while native code runs,
+// so tail can be kept as raw value.
+typedef struct {
+  hll_handle head;
+  // Keeps item alive while cons for it is allocated.
+  hll_handle item;
+  hll_value tail;
+} hll_list_builder;
+
+static void list_builder_init(struct hll_vm *vm, hll_list_builder *builder) {
+  builder->head = hll_gc_handle(vm->gc, hll_nil());
+  builder->item = hll_gc_handle(vm->gc, hll_nil());
+  builder->tail = hll_nil();
+}
+
+static void list_builder_push(struct hll_vm *vm, hll_list_builder *builder,
+                              hll_value item) {
+  hll_gc_set(vm->gc, builder->item, item);
+  hll_value cons = hll_new_cons(vm, item, hll_nil());
+  if (hll_is_nil(builder->tail)) {
+    hll_gc_set(vm->gc, builder->head, cons);
+  } else {
+    // Tail is created by builder, so it can't be permanent and write barrier
+    // is not needed.
+    hll_unwrap_cons(builder->tail)->cdr = cons;
+  }
+  builder->tail = cons;
+}
+
+// Iterates sequence for native code. Sequence is either a list or a range.
+// Position in list is kept in a handle, because callbacks may unlink the rest
+// of list from its head.
+typedef struct {
+  hll_handle seq;
+  // Index of current item of range.
+  size_t idx;
+  const char *name;
+} hll_seq_iter;
+
+static void seq_iter_init(struct hll_vm *vm, hll_seq_iter *iter,
+                          hll_value seq, const char *name) {
+  iter->seq = hll_gc_handle(vm->gc, seq);
+  iter->idx = 0;
+  iter->name = name;
+}
+
+// Gets item at current position of sequence. Returns false at the end of
+// sequence. Item stays reachable until iterator is advanced.
+static bool seq_iter_get(struct hll_vm *vm, hll_seq_iter *iter,
+                         hll_value *item) {
+  hll_value seq = hll_gc_get(vm->gc, iter->seq);
+  switch (hll_get_value_kind(seq)) {
+  case HLL_VALUE_NIL:
+    return false;
+  case HLL_VALUE_CONS:
+    *item = hll_unwrap_car(seq);
+    return true;
+  case HLL_VALUE_RANGE: {
+    hll_obj_range *range = hll_unwrap_range(seq);
+    if (iter->idx == range->length) {
+      return false;
+    }
+    *item = hll_range_item(range, iter->idx);
+    return true;
+  }
+  default:
+    hll_runtime_error(vm, "'%s' expects list or range (got %s)", iter->name,
+                      hll_get_value_kind_str(hll_get_value_kind(seq)));
+    return false;
+  }
+}
+
+static void seq_iter_next(struct hll_vm *vm, hll_seq_iter *iter) {
+  hll_value seq = hll_gc_get(vm->gc, iter->seq);
+  if (hll_is_cons(seq)) {
+    hll_gc_set(vm->gc, iter->seq, hll_unwrap_cdr(seq));
+  } else {
+    ++iter->idx;
+  }
+}
+
+// Calls function with single argument. Argument must be reachable by garbage
+// collector.
+static hll_value call_unary(struct hll_vm *vm, hll_value fn, hll_value arg) {
+  return hll_call(vm, fn, hll_new_cons(vm, arg, hll_nil()));
+}
+
+static hll_value builtin_map(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 2, "map");
+  hll_value fn = hll_car(vm, args);
+
+  hll_handle_scope scope = hll_gc_open_scope(vm->gc);
+  hll_seq_iter iter;
+  seq_iter_init(vm, &iter, hll_car(vm, hll_cdr(vm, args)), "map");
+  hll_list_builder builder;
+  list_builder_init(vm, &builder);
+  for (hll_value item; seq_iter_get(vm, &iter, &item);
+       seq_iter_next(vm, &iter)) {
+    list_builder_push(vm, &builder, call_unary(vm, fn, item));
+  }
+
+  hll_value result = hll_gc_get(vm->gc, builder.head);
+  hll_gc_close_scope(vm->gc, scope);
+  return result;
+}
+
+static hll_value builtin_filter(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 2, "filter");
+  hll_value pred = hll_car(vm, args);
+
+  hll_handle_scope scope = hll_gc_open_scope(vm->gc);
+  hll_seq_iter iter;
+  seq_iter_init(vm, &iter, hll_car(vm, hll_cdr(vm, args)), "filter");
+  hll_list_builder builder;
+  list_builder_init(vm, &builder);
+  for (hll_value item; seq_iter_get(vm, &iter, &item);
+       seq_iter_next(vm, &iter)) {
+    if (!hll_is_nil(call_unary(vm, pred, item))) {
+      list_builder_push(vm, &builder, item);
+    }
+  }
+
+  hll_value result = hll_gc_get(vm->gc, builder.head);
+  hll_gc_close_scope(vm->gc, scope);
+  return result;
+}
+
+static hll_value builtin_mapcat(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 2, "mapcat");
+  hll_value fn = hll_car(vm, args);
+
+  hll_handle_scope scope = hll_gc_open_scope(vm->gc);
+  hll_seq_iter iter;
+  seq_iter_init(vm, &iter, hll_car(vm, hll_cdr(vm, args)), "mapcat");
+  hll_handle head = hll_gc_handle(vm->gc, hll_nil());
+  hll_value tail = hll_nil();
+  for (hll_value item; seq_iter_get(vm, &iter, &item);
+       seq_iter_next(vm, &iter)) {
+    hll_value list = call_unary(vm, fn, item);
+    if (hll_is_nil(list)) {
+      continue;
+    }
+    if (HLL_UNLIKELY(!hll_is_cons(list))) {
+      hll_runtime_error(vm, "'mapcat' expects function to return list (got %s)",
+                        hll_get_value_kind_str(hll_get_value_kind(list)));
+    }
+
+    // Lists are concatenated destructively, like append does.
+    if (hll_is_nil(tail)) {
+      hll_gc_set(vm->gc, head, list);
+    } else {
+      hll_unwrap_cons(tail)->cdr = list;
+      hll_gc_write_barrier(vm->gc, tail);
+    }
+    for (tail = list; hll_is_cons(hll_unwrap_cdr(tail));
+         tail = hll_unwrap_cdr(tail)) {
+    }
+  }
+
+  hll_value result = hll_gc_get(vm->gc, head);
+  hll_gc_close_scope(vm->gc, scope);
+  return result;
+}
+
+static hll_value builtin_any(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 2, "any");
+  hll_value pred = hll_car(vm, args);
+
+  hll_handle_scope scope = hll_gc_open_scope(vm->gc);
+  hll_seq_iter iter;
+  seq_iter_init(vm, &iter, hll_car(vm, hll_cdr(vm, args)), "any");
+  hll_value result = hll_nil();
+  for (hll_value item; seq_iter_get(vm, &iter, &item);
+       seq_iter_next(vm, &iter)) {
+    result = call_unary(vm, pred, item);
+    if (!hll_is_nil(result)) {
+      break;
+    }
+  }
+
+  hll_gc_close_scope(vm->gc, scope);
+  return result;
+}
+
+static hll_value builtin_all(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 2, "all");
+  hll_value pred = hll_car(vm, args);
+
+  hll_handle_scope scope = hll_gc_open_scope(vm->gc);
+  hll_seq_iter iter;
+  seq_iter_init(vm, &iter, hll_car(vm, hll_cdr(vm, args)), "all");
+  hll_value result = hll_true();
+  for (hll_value item; seq_iter_get(vm, &iter, &item);
+       seq_iter_next(vm, &iter)) {
+    if (hll_is_nil(call_unary(vm, pred, item))) {
+      result = hll_nil();
+      break;
+    }
+  }
+
+  hll_gc_close_scope(vm->gc, scope);
+  return result;
+}
+
+static hll_value builtin_count(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 2, "count");
+  hll_value pred = hll_car(vm, args);
+
+  hll_handle_scope scope = hll_gc_open_scope(vm->gc);
+  hll_seq_iter iter;
+  seq_iter_init(vm, &iter, hll_car(vm, hll_cdr(vm, args)), "count");
+  int64_t count = 0;
+  for (hll_value item; seq_iter_get(vm, &iter, &item);
+       seq_iter_next(vm, &iter)) {
+    count += !hll_is_nil(call_unary(vm, pred, item));
+  }
+
+  hll_gc_close_scope(vm->gc, scope);
+  return hll_int(count);
+}
+
+// Calls function with two arguments. Arguments must be reachable by garbage
+// collector.
+static hll_value call_binary(struct hll_vm *vm, hll_handle args, hll_value fn,
+                             hll_value a, hll_value b) {
+  hll_gc_set(vm->gc, args, hll_new_cons(vm, b, hll_nil()));
+  hll_gc_set(vm->gc, args, hll_new_cons(vm, a, hll_gc_get(vm->gc, args)));
+  return hll_call(vm, fn, hll_gc_get(vm->gc, args));
+}
+
+// Right-folds items pushed to the stack above base and pops them. Returns nil
+// if there are no items.
+static hll_value reduce_stack(struct hll_vm *vm, hll_handle call_args,
+                              hll_value form, size_t base) {
+  if (hll_sb_len(vm->stack) == base) {
+    return hll_nil();
+  }
+
+  while (hll_sb_len(vm->stack) > base + 1) {
+    hll_value *top = &hll_sb_last(vm->stack);
+    hll_value acc = call_binary(vm, call_args, form, top[-1], top[0]);
+    (void)hll_sb_pop(vm->stack);
+    hll_sb_last(vm->stack) = acc;
+  }
+
+  return hll_sb_pop(vm->stack);
+}
+
+static hll_value builtin_reduce(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 2, "reduce");
+  hll_value form = hll_car(vm, args);
+  hll_value seq = hll_car(vm, hll_cdr(vm, args));
+
+  // Reduction is right fold: (form x1 (form x2 ... (form xn-1 xn))).
+  hll_handle_scope scope = hll_gc_open_scope(vm->gc);
+  hll_handle call_args = hll_gc_handle(vm->gc, hll_nil());
+  hll_value result = hll_nil();
+  if (hll_get_value_kind(seq) == HLL_VALUE_RANGE) {
+    // Items of range can be computed from the end directly. Range is kept
+    // alive by arguments.
+    hll_obj_range *range = hll_unwrap_range(seq);
+    if (range->length != 0) {
+      hll_handle acc = hll_gc_handle(
+          vm->gc, hll_range_item(range, range->length - 1));
+      for (size_t i = range->length - 1; i-- > 0;) {
+        hll_gc_set(vm->gc, acc,
+                   call_binary(vm, call_args, form, hll_range_item(range, i),
+                               hll_gc_get(vm->gc, acc)));
+      }
+      result = hll_gc_get(vm->gc, acc);
+    }
+  } else {
+    // Items of list are pushed to the stack so they can be visited from the
+    // end, and accumulator takes place of the last item.
+    size_t base = hll_sb_len(vm->stack);
+    hll_seq_iter iter;
+    seq_iter_init(vm, &iter, seq, "reduce");
+    for (hll_value item; seq_iter_get(vm, &iter, &item);
+         seq_iter_next(vm, &iter)) {
+      hll_sb_push(vm->stack, item);
+    }
+    result = reduce_stack(vm, call_args, form, base);
+  }
+
+  hll_gc_close_scope(vm->gc, scope);
+  return result;
+}
+
+static hll_value builtin_repeat(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 2, "repeat");
+  double count = expect_num(vm, hll_car(vm, args), "repeat");
+  hll_value item = hll_car(vm, hll_cdr(vm, args));
+
+  hll_handle_scope scope = hll_gc_open_scope(vm->gc);
+  hll_list_builder builder;
+  list_builder_init(vm, &builder);
+  for (; count > 0; --count) {
+    list_builder_push(vm, &builder, item);
+  }
+
+  hll_value result = hll_gc_get(vm->gc, builder.head);
+  hll_gc_close_scope(vm->gc, scope);
+  return result;
+}
+
+static int64_t expect_range_bound(struct hll_vm *vm, hll_value value) {
+  double bound = floor(expect_num(vm, value, "irange"));
+  if (HLL_UNLIKELY(bound < HLL_INT_MIN || bound > HLL_INT_MAX)) {
+    hll_runtime_error(vm, "'irange' argument %g is out of range", bound);
+  }
+
+  return bound;
+}
+
+// Creates lazy range. Unlike range, arguments are (irange [start] end [step]).
+static hll_value builtin_irange(struct hll_vm *vm, hll_value args) {
+  size_t arg_count = hll_list_length(args);
+  if (HLL_UNLIKELY(arg_count < 1 || arg_count > 3)) {
+    hll_runtime_error(vm, "'irange' expects 1 to 3 arguments (got %zu)",
+                      arg_count);
+    return hll_nil();
+  }
+
+  int64_t start = 0;
+  int64_t step = 1;
+  int64_t end = expect_range_bound(vm, hll_car(vm, args));
+  if (arg_count > 1) {
+    start = end;
+    args = hll_cdr(vm, args);
+    end = expect_range_bound(vm, hll_car(vm, args));
+  }
+  if (arg_count > 2) {
+    step = expect_range_bound(vm, hll_car(vm, hll_cdr(vm, args)));
+    if (HLL_UNLIKELY(step == 0)) {
+      hll_runtime_error(vm, "'irange' step must not be zero");
+    }
+  }
+
+  size_t length = 0;
+  if (step > 0 && end > start) {
+    length = (end - start + step - 1) / step;
+  } else if (step < 0 && end < start) {
+    length = (start - end - step - 1) / -step;
+  }
+
+  return hll_new_range(vm, start, step, length);
+}
+
+typedef enum {
+  HLL_SEQ_STAGE_MAP,
+  HLL_SEQ_STAGE_FILTER,
+  HLL_SEQ_STAGE_REDUCE,
+  HLL_SEQ_STAGE_COUNT,
+  HLL_SEQ_STAGE_ANY,
+  HLL_SEQ_STAGE_ALL,
+  HLL_SEQ_STAGE_OTHER,
+} hll_seq_stage_kind;
+
+// Longest chain that is fused. Longer ones are evaluated as written.
+#define HLL_MAX_FUSED_STAGES 16
+
+static hll_seq_stage_kind get_seq_stage_kind(hll_value op) {
+  if (hll_get_value_kind(op) != HLL_VALUE_BIND) {
+    return HLL_SEQ_STAGE_OTHER;
+  }
+
+  hll_value (*bind)(struct hll_vm *, hll_value) = hll_unwrap_bind(op)->bind;
+  hll_seq_stage_kind kind = HLL_SEQ_STAGE_OTHER;
+  if (bind == builtin_map) {
+    kind = HLL_SEQ_STAGE_MAP;
+  } else if (bind == builtin_filter) {
+    kind = HLL_SEQ_STAGE_FILTER;
+  } else if (bind == builtin_reduce) {
+    kind = HLL_SEQ_STAGE_REDUCE;
+  } else if (bind == builtin_count) {
+    kind = HLL_SEQ_STAGE_COUNT;
+  } else if (bind == builtin_any) {
+    kind = HLL_SEQ_STAGE_ANY;
+  } else if (bind == builtin_all) {
+    kind = HLL_SEQ_STAGE_ALL;
+  }
+
+  return kind;
+}
+
+// Evaluates chain the way it is written: each stage is called with list
+// produced by the stage after it.
+static hll_value call_seq_stages(struct hll_vm *vm, hll_value stages) {
+  if (!hll_is_cons(hll_cdr(vm, stages))) {
+    return hll_car(vm, stages);
+  }
+
+  hll_value op = hll_car(vm, stages);
+  hll_value fn = hll_car(vm, hll_cdr(vm, stages));
+  hll_handle_scope scope = hll_gc_open_scope(vm->gc);
+  hll_handle call_args = hll_gc_handle(
+      vm->gc, call_seq_stages(vm, hll_cdr(vm, hll_cdr(vm, stages))));
+  hll_gc_set(vm->gc, call_args,
+             hll_new_cons(vm, hll_gc_get(vm->gc, call_args), hll_nil()));
+  hll_gc_set(vm->gc, call_args,
+             hll_new_cons(vm, fn, hll_gc_get(vm->gc, call_args)));
+  hll_value result = hll_call(vm, op, hll_gc_get(vm->gc, call_args));
+  hll_gc_close_scope(vm->gc, scope);
+  return result;
+}
+
+// Runs chain of nested sequence functions. Compiler turns
+// (reduce + (map f (filter p xs))) into call of this builtin with arguments
+// (reduce + map f filter p xs).
+// Each item goes through all stages before next one is taken, so no
+// intermediate lists are created. If any of the functions was rebound, chain
+// is evaluated as written.
+static hll_value builtin_fused(struct hll_vm *vm, hll_value args) {
+  size_t arg_count = hll_list_length(args);
+  if (HLL_UNLIKELY(arg_count < 3 || arg_count % 2 == 0)) {
+    hll_runtime_error(vm,
+                      "fused call expects odd number of arguments (got %zu)",
+                      arg_count);
+    return hll_nil();
+  }
+
+  // Stages are stored innermost first, so terminal stage is the last one.
+  size_t stage_count = arg_count / 2;
+  hll_seq_stage_kind kinds[HLL_MAX_FUSED_STAGES];
+  hll_value fns[HLL_MAX_FUSED_STAGES];
+  bool is_fusable = stage_count <= HLL_MAX_FUSED_STAGES;
+  hll_value stage = args;
+  for (size_t i = stage_count; is_fusable && i-- > 0;) {
+    hll_seq_stage_kind kind = get_seq_stage_kind(hll_unwrap_car(stage));
+    stage = hll_unwrap_cdr(stage);
+    is_fusable = kind == HLL_SEQ_STAGE_MAP || kind == HLL_SEQ_STAGE_FILTER ||
+                 (i == stage_count - 1 && kind != HLL_SEQ_STAGE_OTHER);
+    kinds[i] = kind;
+    fns[i] = hll_unwrap_car(stage);
+    stage = hll_unwrap_cdr(stage);
+  }
+  if (!is_fusable) {
+    return call_seq_stages(vm, args);
+  }
+
+  // Functions are reachable from arguments.
+  hll_handle_scope scope = hll_gc_open_scope(vm->gc);
+  hll_seq_iter iter;
+  static const char *names[] = {"map", "filter", "reduce",
+                                 "count", "any", "all"};
+  seq_iter_init(vm, &iter, hll_unwrap_car(stage), names[kinds[0]]);
+  hll_handle current = hll_gc_handle(vm->gc, hll_nil());
+  hll_list_builder builder;
+  list_builder_init(vm, &builder);
+  size_t base = hll_sb_len(vm->stack);
+  hll_seq_stage_kind terminal = kinds[stage_count - 1];
+  hll_value terminal_fn = fns[stage_count - 1];
+  hll_value result = terminal == HLL_SEQ_STAGE_ALL ? hll_true() : hll_nil();
+  int64_t count = 0;
+  bool is_done = false;
+  for (hll_value item; !is_done && seq_iter_get(vm, &iter, &item);
+       seq_iter_next(vm, &iter)) {
+    hll_gc_set(vm->gc, current, item);
+    bool is_kept = true;
+    for (size_t i = 0; is_kept && i < stage_count - 1; ++i) {
+      hll_value value = call_unary(vm, fns[i], hll_gc_get(vm->gc, current));
+      if (kinds[i] == HLL_SEQ_STAGE_MAP) {
+        hll_gc_set(vm->gc, current, value);
+      } else {
+        is_kept = !hll_is_nil(value);
+      }
+    }
+    if (!is_kept) {
+      continue;
+    }
+
+    hll_value value = hll_gc_get(vm->gc, current);
+    switch (terminal) {
+    case HLL_SEQ_STAGE_MAP:
+      list_builder_push(vm, &builder, call_unary(vm, terminal_fn, value));
+      break;
+    case HLL_SEQ_STAGE_FILTER:
+      if (!hll_is_nil(call_unary(vm, terminal_fn, value))) {
+        list_builder_push(vm, &builder, hll_gc_get(vm->gc, current));
+      }
+      break;
+    case HLL_SEQ_STAGE_REDUCE:
+      hll_sb_push(vm->stack, value);
+      break;
+    case HLL_SEQ_STAGE_COUNT:
+      count += !hll_is_nil(call_unary(vm, terminal_fn, value));
+      break;
+    case HLL_SEQ_STAGE_ANY:
+      result = call_unary(vm, terminal_fn, value);
+      is_done = !hll_is_nil(result);
+      break;
+    case HLL_SEQ_STAGE_ALL:
+      is_done = hll_is_nil(call_unary(vm, terminal_fn, value));
+      if (is_done) {
+        result = hll_nil();
+      }
+      break;
+    default:
+      HLL_UNREACHABLE;
+      break;
+    }
+  }
+
+  switch (terminal) {
+  case HLL_SEQ_STAGE_MAP:
+  case HLL_SEQ_STAGE_FILTER:
+    result = hll_gc_get(vm->gc, builder.head);
+    break;
+  case HLL_SEQ_STAGE_REDUCE:
+    result = reduce_stack(vm, current, terminal_fn, base);
+    break;
+  case HLL_SEQ_STAGE_COUNT:
+    result = hll_int(count);
+    break;
+  default:
+    break;
+  }
+
+  hll_gc_close_scope(vm->gc, scope);
+  return result;
+}
+
+// Comparison used by sort.
+typedef struct {
+  hll_value less;
+  // Comparisons with builtin < and > are done directly instead of calling
+  // comparator. 1 for <, -1 for >, 0 if comparator has to be called.
+  int direct;
+  // Roots arguments list while it is being allocated.
+  hll_handle args;
+} hll_sort_cmp;
+
+static bool sort_less(struct hll_vm *vm, hll_sort_cmp *cmp, hll_value a,
+                      hll_value b) {
+  if (cmp->direct != 0) {
+    if (HLL_UNLIKELY(!hll_is_num(a) || !hll_is_num(b))) {
+      hll_runtime_error(vm, "'sort' expects numbers to compare (got %s)",
+                        hll_get_value_kind_str(
+                            hll_get_value_kind(hll_is_num(a) ? b : a)));
+    }
+    return cmp->direct > 0 ? hll_unwrap_num(a) < hll_unwrap_num(b)
+                           : hll_unwrap_num(a) > hll_unwrap_num(b);
+  }
+
+  // Both values are reachable from sorted sequence.
+  hll_gc_set(vm->gc, cmp->args, hll_new_cons(vm, b, hll_nil()));
+  hll_value args = hll_new_cons(vm, a, hll_gc_get(vm->gc, cmp->args));
+  return !hll_is_nil(hll_call(vm, cmp->less, args));
+}
+
+// Sorts list by relinking its conses, without allocating. This is bottom-up
+// merge sort: each pass merges neighbouring sorted runs, doubling their size.
+// Equal items are taken from left run first, so sort is stable.
+static hll_value sort_list(struct hll_vm *vm, hll_sort_cmp *cmp,
+                           hll_value list) {
+  // Comparator may trigger garbage collection while list is split into
+  // parts. Merged part and heads of both runs cover all of them.
+  hll_handle merged = hll_gc_handle(vm->gc, list);
+  hll_handle left = hll_gc_handle(vm->gc, hll_nil());
+  hll_handle right = hll_gc_handle(vm->gc, hll_nil());
+
+  for (size_t run_size = 1;; run_size *= 2) {
+    hll_value p = hll_gc_get(vm->gc, merged);
+    hll_value head = hll_nil();
+    hll_value tail = hll_nil();
+    size_t merge_count = 0;
+    while (!hll_is_nil(p)) {
+      ++merge_count;
+      hll_value q = p;
+      size_t p_size = 0;
+      for (; p_size < run_size && !hll_is_nil(q); ++p_size) {
+        q = hll_cdr(vm, q);
+      }
+
+      size_t q_size = run_size;
+      while (p_size != 0 || (q_size != 0 && !hll_is_nil(q))) {
+        hll_gc_set(vm->gc, left, p);
+        hll_gc_set(vm->gc, right, q);
+        hll_value cons;
+        if (p_size == 0) {
+          cons = q;
+          q = hll_cdr(vm, q);
+          --q_size;
+        } else if (q_size == 0 || hll_is_nil(q) ||
+                   !sort_less(vm, cmp, hll_car(vm, q), hll_car(vm, p))) {
+          cons = p;
+          p = hll_cdr(vm, p);
+          --p_size;
+        } else {
+          cons = q;
+          q = hll_cdr(vm, q);
+          --q_size;
+        }
+
+        if (hll_is_nil(tail)) {
+          head = cons;
+          hll_gc_set(vm->gc, merged, head);
+        } else {
+          hll_unwrap_cons(tail)->cdr = cons;
+          hll_gc_write_barrier(vm->gc, tail);
+        }
+        tail = cons;
+      }
+      p = q;
+    }
+
+    if (!hll_is_nil(tail)) {
+      hll_unwrap_cons(tail)->cdr = hll_nil();
+      hll_gc_write_barrier(vm->gc, tail);
+    }
+    if (merge_count <= 1) {
+      return head;
+    }
+  }
+}
+
+// Sorts array of records by their first value using bottom-up merge sort.
+// Record consists of stride values. tmp must be of the same size as items.
+static void sort_array(struct hll_vm *vm, hll_sort_cmp *cmp, hll_value *items,
+                       hll_value *tmp, size_t count, size_t stride) {
+  hll_value *src = items;
+  hll_value *dst = tmp;
+  for (size_t width = 1; width < count; width *= 2) {
+    for (size_t lo = 0; lo < count; lo += 2 * width) {
+      size_t mid = lo + width < count ? lo + width : count;
+      size_t hi = lo + 2 * width < count ? lo + 2 * width : count;
+      size_t i = lo;
+      size_t j = mid;
+      size_t k = lo;
+      // Runs that are already in order are copied as is, so sorted input
+      // takes single comparison per run.
+      if (j != hi && sort_less(vm, cmp, src[j * stride],
+                               src[(j - 1) * stride])) {
+        while (i < mid && j < hi) {
+          if (sort_less(vm, cmp, src[j * stride], src[i * stride])) {
+            memcpy(dst + k++ * stride, src + j++ * stride,
+                   stride * sizeof(hll_value));
+          } else {
+            memcpy(dst + k++ * stride, src + i++ * stride,
+                   stride * sizeof(hll_value));
+          }
+        }
+      }
+      memcpy(dst + k * stride, src + i * stride,
+             (mid - i) * stride * sizeof(hll_value));
+      k += mid - i;
+      memcpy(dst + k * stride, src + j * stride,
+             (hi - j) * stride * sizeof(hll_value));
+    }
+
+    hll_value *swap = src;
+    src = dst;
+    dst = swap;
+  }
+
+  if (src != items) {
+    memcpy(items, src, count * stride * sizeof(hll_value));
+  }
+}
+
+static hll_value builtin_sort(struct hll_vm *vm, hll_value args) {
+  size_t arg_count = hll_list_length(args);
+  if (HLL_UNLIKELY(arg_count < 1 || arg_count > 3)) {
+    hll_runtime_error(vm, "'sort' expects 1 to 3 arguments (got %zu)",
+                      arg_count);
+    return hll_nil();
+  }
+
+  hll_value seq = hll_car(vm, args);
+  hll_value less = hll_car(vm, hll_cdr(vm, args));
+  hll_value key = hll_car(vm, hll_cdr(vm, hll_cdr(vm, args)));
+
+  hll_handle_scope scope = hll_gc_open_scope(vm->gc);
+  hll_sort_cmp cmp = {0};
+  cmp.less = less;
+  cmp.args = hll_gc_handle(vm->gc, hll_nil());
+  if (hll_is_nil(less)) {
+    cmp.direct = 1;
+  } else if (hll_get_value_kind(less) == HLL_VALUE_BIND) {
+    hll_obj_bind *bind = hll_unwrap_bind(less);
+    if (bind->bind == builtin_num_lt) {
+      cmp.direct = 1;
+    } else if (bind->bind == builtin_num_gt) {
+      cmp.direct = -1;
+    }
+  }
+
+  size_t count;
+  switch (hll_get_value_kind(seq)) {
+  case HLL_VALUE_NIL:
+    count = 0;
+    break;
+  case HLL_VALUE_CONS:
+    count = 0;
+    for (hll_value obj = seq; !hll_is_nil(obj); obj = hll_cdr(vm, obj)) {
+      ++count;
+    }
+    break;
+  case HLL_VALUE_VEC:
+    count = hll_unwrap_vec(seq)->length;
+    break;
+  default:
+    hll_runtime_error(vm, "'sort' expects list or vector (got %s)",
+                      hll_get_value_kind_str(hll_get_value_kind(seq)));
+    return hll_nil();
+  }
+
+  hll_value result = seq;
+  if (hll_is_cons(seq) && hll_is_nil(key)) {
+    result = sort_list(vm, &cmp, seq);
+  } else if (count > 1) {
+    // Keys are computed once and sorted together with items. Vectors without
+    // key use items themselves. Scratch vector holds records and space for
+    // merging.
+    size_t stride = hll_is_nil(key) ? 1 : 2;
+    hll_value scratch = hll_new_vec(vm, 2 * count * stride);
+    hll_gc_handle(vm->gc, scratch);
+    hll_value *records = hll_unwrap_vec(scratch)->items;
+    hll_value obj = seq;
+    for (size_t i = 0; i < count; ++i) {
+      hll_value item;
+      if (hll_is_cons(seq)) {
+        item = hll_car(vm, obj);
+        obj = hll_cdr(vm, obj);
+      } else {
+        item = hll_unwrap_vec(seq)->items[i];
+      }
+      records[i * stride + stride - 1] = item;
+    }
+    if (stride == 2) {
+      for (size_t i = 0; i < count; ++i) {
+        records[i * 2] = call_unary(vm, key, records[i * 2 + 1]);
+      }
+    }
+
+    sort_array(vm, &cmp, records, records + count * stride, count, stride);
+
+    obj = seq;
+    for (size_t i = 0; i < count; ++i) {
+      hll_value item = records[i * stride + stride - 1];
+      if (hll_is_cons(seq)) {
+        if (HLL_UNLIKELY(!hll_is_cons(obj))) {
+          hll_runtime_error(vm, "list was modified while being sorted");
+        }
+        hll_unwrap_cons(obj)->car = item;
+        hll_gc_write_barrier(vm->gc, obj);
+        obj = hll_unwrap_cdr(obj);
+      } else {
+        hll_unwrap_vec(seq)->items[i] = item;
+      }
+    }
+    if (!hll_is_cons(seq)) {
+      hll_gc_write_barrier(vm->gc, seq);
+    }
+  }
+
+  hll_gc_close_scope(vm->gc, scope);
+  return result;
+}
+
+static hll_obj_str *expect_str(struct hll_vm *vm, hll_value value,
+                               const char *name) {
+  if (HLL_UNLIKELY(hll_get_value_kind(value) != HLL_VALUE_STR)) {
+    hll_runtime_error(vm, "'%s' expects string (got %s)", name,
+                      hll_get_value_kind_str(hll_get_value_kind(value)));
+  }
+
+  return hll_unwrap_str(value);
+}
+
+static hll_obj_builder *expect_builder(struct hll_vm *vm, hll_value value,
+                                       const char *name) {
+  if (HLL_UNLIKELY(hll_get_value_kind(value) != HLL_VALUE_BUILDER)) {
+    hll_runtime_error(vm, "'%s' expects string builder (got %s)", name,
+                      hll_get_value_kind_str(hll_get_value_kind(value)));
+  }
+
+  return hll_unwrap_builder(value);
+}
+
+static hll_value builtin_stringp(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 1, "string?");
+  return hll_get_value_kind(hll_car(vm, args)) == HLL_VALUE_STR ? hll_true()
+                                                                 : hll_nil();
+}
+
+static hll_value builtin_string_length(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 1, "string-length");
+  return hll_int(expect_str(vm, hll_car(vm, args), "string-length")->length);
+}
+
+static int64_t expect_index(struct hll_vm *vm, hll_value value,
+                            const char *name) {
+  if (HLL_UNLIKELY(!hll_is_int(value))) {
+    hll_runtime_error(vm, "'%s' expects integer index (got %s)", name,
+                      hll_get_value_kind_str(hll_get_value_kind(value)));
+  }
+
+  return hll_unwrap_int(value);
+}
+
+static hll_value builtin_substring(struct hll_vm *vm, hll_value args) {
+  size_t arg_count = hll_list_length(args);
+  if (HLL_UNLIKELY(arg_count != 2 && arg_count != 3)) {
+    hll_runtime_error(vm, "'substring' expects 2 or 3 arguments (got %zu)",
+                      arg_count);
+    return hll_nil();
+  }
+
+  hll_value str = hll_car(vm, args);
+  size_t length = expect_str(vm, str, "substring")->length;
+  int64_t start = expect_index(vm, hll_car(vm, hll_cdr(vm, args)), "substring");
+  int64_t end = length;
+  if (arg_count == 3) {
+    end = expect_index(vm, hll_car(vm, hll_cdr(vm, hll_cdr(vm, args))),
+                       "substring");
+  }
+  if (HLL_UNLIKELY(start < 0 || end < start || (size_t)end > length)) {
+    hll_runtime_error(vm,
+                      "'substring' range %" PRId64 "..%" PRId64
+                      " is out of bounds for string of length %zu",
+                      start, end, length);
+    return hll_nil();
+  }
+
+  // Substring shares bytes with original string instead of copying them.
+  return hll_new_str_view(vm, str, start, end - start);
+}
+
+static hll_value builtin_string_append(struct hll_vm *vm, hll_value args) {
+  size_t length = 0;
+  for (hll_value obj = args; hll_is_cons(obj); obj = hll_cdr(vm, obj)) {
+    length += expect_str(vm, hll_car(vm, obj), "string-append")->length;
+  }
+
+  // Arguments are rooted by caller and strings are never moved, so they can
+  // be copied after allocation.
+  hll_value result = hll_new_str(vm, NULL, length);
+  char *cursor = hll_unwrap_str(result)->data;
+  for (hll_value obj = args; hll_is_cons(obj); obj = hll_cdr(vm, obj)) {
+    hll_obj_str *str = hll_unwrap_str(hll_car(vm, obj));
+    if (str->length != 0) {
+      memcpy(cursor, str->bytes, str->length);
+      cursor += str->length;
+    }
+  }
+
+  return result;
+}
+
+static hll_value builtin_string_eq(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 2, "string=?");
+  hll_obj_str *a = expect_str(vm, hll_car(vm, args), "string=?");
+  hll_obj_str *b = expect_str(vm, hll_car(vm, hll_cdr(vm, args)), "string=?");
+  if (a->length != b->length ||
+      (a->length != 0 && memcmp(a->bytes, b->bytes, a->length) != 0)) {
+    return hll_nil();
+  }
+
+  return hll_true();
+}
+
+static hll_value builtin_symbol_to_string(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 1, "symbol->string");
+  hll_value symb = hll_car(vm, args);
+  if (HLL_UNLIKELY(!hll_is_symb(symb))) {
+    hll_runtime_error(vm, "'symbol->string' expects symbol (got %s)",
+                      hll_get_value_kind_str(hll_get_value_kind(symb)));
+    return hll_nil();
+  }
+
+  hll_obj_symb *obj = hll_unwrap_symb(symb);
+  return hll_new_str(vm, obj->symb, obj->length);
+}
+
+static hll_value builtin_string_to_symbol(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 1, "string->symbol");
+  hll_obj_str *str = expect_str(vm, hll_car(vm, args), "string->symbol");
+  if (HLL_UNLIKELY(str->length == 0)) {
+    hll_runtime_error(vm, "'string->symbol' expects non-empty string");
+    return hll_nil();
+  }
+
+  return hll_new_symbol(vm, str->bytes, str->length);
+}
+
+static hll_value builtin_number_to_string(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 1, "number->string");
+  hll_value num = hll_car(vm, args);
+  expect_num(vm, num, "number->string");
+
+  char buffer[64];
+  size_t length = hll_format_num(buffer, sizeof(buffer), num);
+  assert(length < sizeof(buffer));
+  return hll_new_str(vm, buffer, length);
+}
+
+static hll_value builtin_string_to_number(struct hll_vm *vm, hll_value args) {
+  expect_arg_count(vm, args, 1, "string->number");
+  hll_obj_str *str = expect_str(vm, hll_car(vm, args), "string->number");
+  // Only decimal numbers are accepted. Whitespace, which strtod skips, and
+  // forms like inf, nan(...) and hexadecimal ones are rejected.
+  bool has_digit = false;
+  for (size_t i = 0; i < str->length; ++i) {
+    char c = str->bytes[i];
+    if (isdigit((unsigned char)c)) {
+      has_digit = true;
+    } else if (strchr("+-.eE", c) == NULL) {
+      return hll_nil();
+    }
+  }
+  if (!has_digit) {
+    return hll_nil();
+  }
+
+  // Views are not zero-terminated, so copy bytes before calling strtod.
+
+  char *text = hll_alloc(str->length + 1);
+  memcpy(text, str->bytes, str->length);
+  char *end;
+  double value = strtod(text, &end);
+  bool is_valid = end == text + str->length;
+  hll_free(text, str->length + 1);
+
+  return is_valid ? hll_num(value) : hll_nil();
+}
+
+static hll_value builtin_make_string_builder(struct hll_vm *vm,
+                                             hll_value args) {
+  expect_arg_count(vm, args, 0, "make-string-builder");
+  return hll_new_builder(vm);
+}
+
+static hll_value builtin_string_builder_append(struct hll_vm *vm,
+                                               hll_value args) {
+  expect_arg_count(vm, args, 2, "string-builder-append!");
+  hll_value builder = hll_car(vm, args);
+  expect_builder(vm, builder, "string-builder-append!");
+
+  hll_value value = hll_car(vm, hll_cdr(vm, args));
+  switch (hll_get_value_kind(value)) {
+  case HLL_VALUE_STR: {
+    hll_obj_str *str = hll_unwrap_str(value);
+    hll_builder_append(vm, builder, str->bytes, str->length);
+  } break;
+  case HLL_VALUE_SYMB: {
+    hll_obj_symb *symb = hll_unwrap_symb(value);
+    hll_builder_append(vm, builder, symb->symb, symb->length);
+  } break;
+  case HLL_VALUE_NUM: {
+    char buffer[64];
+    size_t length = hll_format_num(buffer, sizeof(buffer), value);
+    assert(length < sizeof(buffer));
+    hll_builder_append(vm, builder, buffer, length);
+  } break;
+  default:
+    hll_runtime_error(vm,
+                      "'string-builder-append!' expects string, symbol or "
+                      "number (got %s)",
+                      hll_get_value_kind_str(hll_get_value_kind(value)));
+    break;
+  }
+
+  return builder;
+}
+
+static hll_value builtin_string_builder_to_string(struct hll_vm *vm,
+                                                  hll_value args) {
+  expect_arg_count(vm, args, 1, "string-builder->string");
+  hll_obj_builder *builder =
+      expect_builder(vm, hll_car(vm, args), "string-builder->string");
+  // Builder is not moved by allocation and its buffer is not modified.
+  return hll_new_str(vm, builder->bytes, hll_sb_len(builder->bytes));
+}
+
+static hll_value builtin_heap_profile(struct hll_vm *vm, hll_value args) {
+  (void)args;
+  if (HLL_UNLIKELY(vm->config.heap_profile_rate == 0)) {
+    hll_runtime_error(vm, "'heap-profile' requires heap profiling to be "
+                          "enabled");
+    return hll_nil();
+  }
+
+  hll_dump_heap_profile(vm);
+  return hll_nil();
+}
+
 void add_builtins(struct hll_vm *vm) {
+  vm->fused_bind = hll_new_bind(vm, builtin_fused);
   hll_add_binding(vm, "print", builtin_print);
   hll_add_binding(vm, "+", builtin_add);
   hll_add_binding(vm, "-", builtin_sub);
@@ -832,77 +2442,80 @@ void add_builtins(struct hll_vm *vm) {
   hll_add_binding(vm, "range", builtin_range);
   hll_add_binding(vm, "gensym", builtin_gensym);
   hll_add_binding(vm, "eq?", builtin_eq);
+  hll_add_binding(vm, "vector", builtin_vector);
+  hll_add_binding(vm, "make-vector", builtin_make_vector);
+  hll_add_binding(vm, "vector-length", builtin_vector_length);
+  hll_add_binding(vm, "vector?", builtin_vectorp);
+  hll_add_binding(vm, "list->vector", builtin_list_to_vector);
+  hll_add_binding(vm, "vector->list", builtin_vector_to_list);
+  hll_add_binding(vm, "f64array", builtin_f64array);
+  hll_add_binding(vm, "make-f64array", builtin_make_f64array);
+  hll_add_binding(vm, "list->f64array", builtin_list_to_f64array);
+  hll_add_binding(vm, "f64array->list", builtin_f64array_to_list);
+  hll_add_binding(vm, "f64array-length", builtin_f64array_length);
+  hll_add_binding(vm, "f64array?", builtin_f64arrayp);
+  hll_add_binding(vm, "f64array-ref", builtin_f64array_ref);
+  hll_add_binding(vm, "f64array-set!", builtin_f64array_set);
+  hll_add_binding(vm, "f64+", builtin_f64_add);
+  hll_add_binding(vm, "f64-", builtin_f64_sub);
+  hll_add_binding(vm, "f64*", builtin_f64_mul);
+  hll_add_binding(vm, "f64-scale", builtin_f64_scale);
+  hll_add_binding(vm, "f64-fma", builtin_f64_fma);
+  hll_add_binding(vm, "f64<", builtin_f64_lt);
+  hll_add_binding(vm, "f64<=", builtin_f64_le);
+  hll_add_binding(vm, "f64>", builtin_f64_gt);
+  hll_add_binding(vm, "f64>=", builtin_f64_ge);
+  hll_add_binding(vm, "f64=", builtin_f64_eq);
+  hll_add_binding(vm, "f64-sum", builtin_f64_sum);
+  hll_add_binding(vm, "f64-min", builtin_f64_min);
+  hll_add_binding(vm, "f64-max", builtin_f64_max);
+  hll_add_binding(vm, "f64-dot", builtin_f64_dot);
+  hll_add_binding(vm, "make-hash", builtin_make_hash);
+  hll_add_binding(vm, "hash?", builtin_hashp);
+  hll_add_binding(vm, "hash-ref", builtin_hash_ref);
+  hll_add_binding(vm, "hash-set!", builtin_hash_set);
+  hll_add_binding(vm, "hash-remove!", builtin_hash_remove);
+  hll_add_binding(vm, "hash-count", builtin_hash_count);
+  hll_add_binding(vm, "hash-keys", builtin_hash_keys);
+  hll_add_binding(vm, "hash-values", builtin_hash_values);
+  hll_add_binding(vm, "hash->alist", builtin_hash_to_alist);
+  hll_add_binding(vm, "map", builtin_map);
+  hll_add_binding(vm, "filter", builtin_filter);
+  hll_add_binding(vm, "mapcat", builtin_mapcat);
+  hll_add_binding(vm, "any", builtin_any);
+  hll_add_binding(vm, "all", builtin_all);
+  hll_add_binding(vm, "count", builtin_count);
+  hll_add_binding(vm, "reduce", builtin_reduce);
+  hll_add_binding(vm, "repeat", builtin_repeat);
+  hll_add_binding(vm, "irange", builtin_irange);
+  hll_add_binding(vm, "sort", builtin_sort);
+  hll_add_binding(vm, "string?", builtin_stringp);
+  hll_add_binding(vm, "string-length", builtin_string_length);
+  hll_add_binding(vm, "substring", builtin_substring);
+  hll_add_binding(vm, "string-append", builtin_string_append);
+  hll_add_binding(vm, "string=?", builtin_string_eq);
+  hll_add_binding(vm, "symbol->string", builtin_symbol_to_string);
+  hll_add_binding(vm, "string->symbol", builtin_string_to_symbol);
+  hll_add_binding(vm, "number->string", builtin_number_to_string);
+  hll_add_binding(vm, "string->number", builtin_string_to_number);
+  hll_add_binding(vm, "make-string-builder", builtin_make_string_builder);
+  hll_add_binding(vm, "string-builder-append!", builtin_string_builder_append);
+  hll_add_binding(vm, "string-builder->string",
+                  builtin_string_builder_to_string);
+  hll_add_binding(vm, "heap-profile", builtin_heap_profile);
   hll_interpret(vm,
-                "(defmacro (and expr . rest)\n"
-                "  (if rest\n"
-                "    (list 'if expr (cons 'and rest))\n"
-                "  expr))\n"
-                "(defmacro (or expr . rest)\n"
-                "  (if rest\n"
-                "      (let ((var (gensym)))\n"
-                "           (list 'let (list (list var expr))\n"
-                "                 (list 'if var var (cons 'or rest))))\n"
-                "      expr))\n"
-                "(defmacro (not x) (list 'if x () 't))\n"
-                "(defmacro (when expr . body)\n"
-                "  (cons 'if (cons expr (list (cons 'progn body)))))\n"
-                "(defmacro (unless expr . body)\n"
-                "  (cons 'if (cons expr (cons () body))))\n"
                 "(define (tail lis)\n"
                 "  (if (cdr lis)\n"
                 "      (tail (cdr lis))\n"
                 "      (car lis)))\n"
-                "(define (count pred lis)\n"
-                "  (if lis\n"
-                "      (+ (if (pred (car lis)) 1 0) (count pred (cdr lis)))\n"
-                "      0))\n"
                 "(define (heads lis)\n"
                 "  (when lis\n"
                 "     (cons (caar lis) (heads (cdr lis)))))\n"
                 "(define (tails lis)\n"
                 "  (when lis\n"
-                "    (cons (tail (car lis)) (tails (cdr lis)))))\n"
-                "(define (map fn . lis)\n"
-                "  (when lis\n"
-                "    (cons (fn (heads lis))\n"
-                "          (map fn (cdr lis)))))\n"
-                "(define (any pred lis)\n"
-                "  (when lis\n"
-                "    (or (pred (car lis))\n"
-                "        (any pred (cdr lis)))))\n"
-                "(define (filter pred lis)\n"
-                "  (when lis\n"
-                "    (let ((value (pred (car lis))))\n"
-                "      (if value\n"
-                "          (cons (car lis) (filter pred (cdr lis)))\n"
-                "          (filter pred (cdr lis))))))\n"
-                "(define (all pred lis)\n"
-                "  (if lis\n"
-                "      (and (pred (car lis)) (all pred (cdr lis)))\n"
-                "      t))\n",
+                "    (cons (tail (car lis)) (tails (cdr lis)))))\n",
                 "builtins1", 0);
   hll_interpret(vm,
-                "(define (any pred lis)\n"
-                "  (when lis\n"
-                "    (or (pred (car lis))\n"
-                "        (any pred (cdr lis)))))\n"
-                "(define (filter pred lis)\n"
-                "  (when lis\n"
-                "    (let ((value (pred (car lis))))\n"
-                "      (if value\n"
-                "          (cons (car lis) (filter pred (cdr lis)))\n"
-                "          (filter pred (cdr lis))))))\n"
-                "(define (all pred lis)\n"
-                "  (if lis\n"
-                "      (and (pred (car lis)) (all pred (cdr lis)))\n"
-                "      t))\n"
-                "(define (reduce form lis)\n"
-                "  (if (cdr lis)\n"
-                "      (form (car lis) (reduce form (cdr lis)))\n"
-                "      (car lis)))\n"
-                "(define (repeat n x)\n"
-                "  (when (positive? n)\n"
-                "    (cons x (repeat (- n 1) x))))\n"
                 "(defmacro (amap fn-body lis)\n"
                 "  (list 'map (list 'lambda (list 'it) fn-body) lis))\n"
                 "(defmacro (afilter fn-body lis)\n"
@@ -912,15 +2525,6 @@ void add_builtins(struct hll_vm *vm) {
                 "(defmacro (inc! val)\n"
                 "  (list 'set! val (list '+ val 1)))\n"
                 "(defmacro (dec! val)\n"
-                "  (list 'set! val (list '- val 1)))\n"
-                "(define (mapcat func lis)\n"
-                "  (define (cat lis)\n"
-                "    (when lis\n"
-                "      (append (car lis) (cat (cdr lis)))))\n"
-                "  (cat (map func lis)))\n"
-                "(define (map fn lis)\n"
-                "  (when lis\n"
-                "    (cons (fn (car lis))\n"
-                "          (map fn (cdr lis)))))\n",
+                "  (list 'set! val (list '- val 1)))\n",
                 "builtins2", 0);
 }
@@ -4,82 +4,138 @@
 #include <inttypes.h>
 #include <stdio.h>
 
+#include "hll_debug.h"
 #include "hll_mem.h"
 #include "hll_value.h"
 
 static const char *get_op_str(hll_bytecode_op op) {
   static const char *strs[] = {
-      "END",    "NIL",  "TRUE",     "CONST",  "APPEND", "POP",
-      "FIND",   "CALL", "MBTRCALL", "JN",     "LET",    "PUSHENV",
-      "POPENV", "CAR",  "CDR",      "SETCAR", "SETCDR", "MAKEFUN",
+      "END",     "NIL",  "TRUE",     "CONST",   "APPEND", "POP",
+      "FIND",    "CALL", "MBTRCALL", "JN",      "LET",    "PUSHENV",
+      "POPENV",  "CAR",  "CDR",      "SETCAR",  "SETCDR", "MAKEFUN",
+      "VREF",    "VSET", "DOTIMES",  "DOLIST",  "JMP",    "LOADVAR",
+      "CONS",    "JT",   "WIDE",     "JTK",     "SWITCH", "CALLNATIVE",
   };
 
   assert(op < sizeof(strs) / sizeof(strs[0]));
   return strs[op];
 }
 
+// Returns true if jump offset of instruction is two's complement, so it can
+// jump backward.
+static bool has_signed_offset(hll_bytecode_op op) {
+  return op == HLL_BC_JN || op == HLL_BC_JT || op == HLL_BC_JMP ||
+         op == HLL_BC_JTK;
+}
+
+static bool is_jump(hll_bytecode_op op) {
+  return has_signed_offset(op) || op == HLL_BC_DOTIMES ||
+         op == HLL_BC_DOLIST;
+}
+
+static bool has_const_operand(hll_bytecode_op op) {
+  return op == HLL_BC_CONST || op == HLL_BC_MAKEFUN || op == HLL_BC_LOADVAR ||
+         op == HLL_BC_SWITCH;
+}
+
+static bool has_varint_operand(hll_bytecode_op op) {
+  return has_const_operand(op) || op == HLL_BC_CALLNATIVE;
+}
+
+// Decodes instruction starting at given byte. Offsets of jumps that can go
+// backward are sign-extended. Argument count is only set for CALLNATIVE.
+// Returns pointer past the instruction.
+static const uint8_t *read_insn(const uint8_t *data, hll_bytecode_op *op,
+                                int64_t *operand, uint8_t *arg_count) {
+  bool is_wide = *data == HLL_BC_WIDE;
+  data += is_wide;
+  *op = *data++;
+  *operand = 0;
+  *arg_count = 0;
+  if (has_varint_operand(*op)) {
+    uint32_t value = 0;
+    uint8_t byte;
+    do {
+      byte = *data++;
+      value = value << 7 | (byte & 0x7F);
+    } while (byte & 0x80);
+    *operand = value;
+    if (*op == HLL_BC_CALLNATIVE) {
+      *arg_count = *data++;
+    }
+  } else if (is_jump(*op)) {
+    size_t size = is_wide ? 4 : 2;
+    uint32_t value = 0;
+    for (size_t i = 0; i < size; ++i) {
+      value = value << 8 | *data++;
+    }
+    *operand = value;
+    if (has_signed_offset(*op)) {
+      *operand = is_wide ? (int64_t)(int32_t)value : (int64_t)(int16_t)value;
+    }
+  }
+
+  return data;
+}
+
 void hll_dump_bytecode(void *file, const hll_bytecode *bytecode) {
-  uint8_t *instruction = bytecode->ops;
+  const uint8_t *instruction = bytecode->ops;
   if (instruction == NULL) {
     fprintf(file, "(null)\n");
     return;
   }
 
-  hll_bytecode_op op;
+  // Optimized bytecode may return from the middle, so whole array is dumped.
+  const uint8_t *end = instruction + hll_sb_len(bytecode->ops);
   size_t op_idx = 0;
-  while ((op = *instruction++) != HLL_BC_END) {
+  while (instruction < end) {
     fprintf(file, "%4llX:#%-4llX ", (long long unsigned)op_idx,
-            (long long unsigned)(instruction - bytecode->ops - 1));
+            (long long unsigned)(instruction - bytecode->ops));
     ++op_idx;
 
+    if (*instruction == HLL_BC_WIDE) {
+      fprintf(file, "WIDE ");
+    }
+    hll_bytecode_op op;
+    int64_t operand;
+    uint8_t arg_count;
+    instruction = read_insn(instruction, &op, &operand, &arg_count);
     fprintf(file, "%s", get_op_str(op));
     switch (op) {
-    case HLL_BC_JN: {
-      uint8_t high = *instruction++;
-      uint8_t low = *instruction++;
-      uint16_t offset = ((uint16_t)high) << 8 | low;
-      fprintf(file, " 0x%" PRIx16 " (->#%llX)", offset,
-              (long long unsigned)(instruction + offset - bytecode->ops));
-    } break;
-    case HLL_BC_MAKEFUN: {
-      uint8_t high = *instruction++;
-      uint8_t low = *instruction++;
-      uint16_t idx = ((uint16_t)high) << 8 | low;
-      if (idx >= hll_sb_len(bytecode->constant_pool)) {
-        fprintf(file, "<err>");
-      } else {
-        fprintf(file, " 0x%" PRIx16 " ", idx);
-        hll_dump_value(file, bytecode->constant_pool[idx]);
-      }
-    } break;
-    case HLL_BC_CONST: {
-      uint8_t high = *instruction++;
-      uint8_t low = *instruction++;
-      uint16_t idx = ((uint16_t)high) << 8 | low;
-      if (idx >= hll_sb_len(bytecode->constant_pool)) {
+    case HLL_BC_JN:
+    case HLL_BC_JT:
+    case HLL_BC_JTK:
+    case HLL_BC_JMP:
+    case HLL_BC_DOTIMES:
+    case HLL_BC_DOLIST:
+      fprintf(file, " %" PRId64 " (->#%llX)", operand,
+              (long long unsigned)(instruction + operand - bytecode->ops));
+      break;
+    case HLL_BC_MAKEFUN:
+    case HLL_BC_CONST:
+    case HLL_BC_LOADVAR:
+      if ((size_t)operand >= hll_sb_len(bytecode->constant_pool)) {
         fprintf(file, "<err>");
       } else {
-        fprintf(file, " 0x%" PRIx16 " ", idx);
-        hll_dump_value(file, bytecode->constant_pool[idx]);
+        fprintf(file, " 0x%" PRIx64 " ", operand);
+        hll_dump_value(file, bytecode->constant_pool[operand]);
       }
-    } break;
+      break;
+    case HLL_BC_CALLNATIVE:
+      fprintf(file, " %" PRId64 " %u", operand, (unsigned)arg_count);
+      break;
     default:
       break;
     }
     fprintf(file, "\n");
   }
-
-  fprintf(file, "%4llX:#%-4llX END\n", (long long unsigned)op_idx,
-          (long long unsigned)(instruction - bytecode->ops - 1));
 }
 
-size_t hll_bytecode_op_body_size(hll_bytecode_op op) {
-  size_t s = 0;
-  if (op == HLL_BC_CONST || op == HLL_BC_MAKEFUN || op == HLL_BC_JN) {
-    s = 2;
-  }
-
-  return s;
+size_t hll_bytecode_insn_size(const uint8_t *insn) {
+  hll_bytecode_op op;
+  int64_t operand;
+  uint8_t arg_count;
+  return read_insn(insn, &op, &operand, &arg_count) - insn;
 }
 
 hll_bytecode *hll_new_bytecode(hll_value name) {
@@ -100,6 +156,7 @@ void hll_bytecode_dec_refcount(hll_bytecode *bytecode) {
   if (bytecode->refcount == 0) {
     hll_sb_free(bytecode->ops);
     hll_sb_free(bytecode->constant_pool);
+    hll_sb_free(bytecode->loc_rle);
     hll_free(bytecode, sizeof(hll_bytecode));
   }
 }
@@ -120,6 +177,25 @@ size_t hll_bytecode_emit_u16(hll_bytecode *bytecode, uint16_t value) {
   return idx;
 }
 
+size_t hll_bytecode_emit_u32(hll_bytecode *bytecode, uint32_t value) {
+  size_t idx = hll_bytecode_emit_u16(bytecode, (value >> 16) & 0xFFFF);
+  hll_bytecode_emit_u16(bytecode, value & 0xFFFF);
+  return idx;
+}
+
+size_t hll_bytecode_emit_varint(hll_bytecode *bytecode, uint32_t value) {
+  size_t idx = hll_bytecode_op_idx(bytecode);
+  int shift = 28;
+  while (shift != 0 && (value >> shift) == 0) {
+    shift -= 7;
+  }
+  for (; shift != 0; shift -= 7) {
+    hll_bytecode_emit_u8(bytecode, ((value >> shift) & 0x7F) | 0x80);
+  }
+  hll_bytecode_emit_u8(bytecode, value & 0x7F);
+  return idx;
+}
+
 size_t hll_bytecode_emit_op(hll_bytecode *bytecode, hll_bytecode_op op) {
   assert(op <= 0xFF);
   return hll_bytecode_emit_u8(bytecode, op);
@@ -162,6 +238,62 @@ void hll_dump_value(void *file, hll_value value) {
     dump_function_info(file, value);
     fprintf(file, "}");
     break;
+  case HLL_VALUE_VEC: {
+    hll_obj_vec *vec = hll_unwrap_vec(value);
+    fprintf(file, ", \"items\": [");
+    for (size_t i = 0; i < vec->length; ++i) {
+      if (i != 0) {
+        fprintf(file, ", ");
+      }
+      hll_dump_value(file, vec->items[i]);
+    }
+    fprintf(file, "]");
+  } break;
+  case HLL_VALUE_F64ARRAY: {
+    hll_obj_f64array *array = hll_unwrap_f64array(value);
+    fprintf(file, ", \"items\": [");
+    for (size_t i = 0; i < array->length; ++i) {
+      if (i != 0) {
+        fprintf(file, ", ");
+      }
+      fprintf(file, "%lf", array->items[i]);
+    }
+    fprintf(file, "]");
+  } break;
+  case HLL_VALUE_STR: {
+    hll_obj_str *str = hll_unwrap_str(value);
+    fprintf(file, ", \"str\": \"%.*s\"", (int)str->length, str->bytes);
+  } break;
+  case HLL_VALUE_BUILDER:
+    break;
+  case HLL_VALUE_RANGE: {
+    hll_obj_range *range = hll_unwrap_range(value);
+    fprintf(file,
+            ", \"start\": %" PRId64 ", \"step\": %" PRId64
+            ", \"length\": %zu",
+            range->start, range->step, range->length);
+  } break;
+  case HLL_VALUE_HASH: {
+    hll_obj_hash *hash = hll_unwrap_hash(value);
+    fprintf(file, ", \"entries\": [");
+    bool is_first = true;
+    for (size_t i = 0; i < hash->capacity; ++i) {
+      hll_hash_entry *entry = hash->entries + i;
+      if (!hll_hash_entry_is_live(entry)) {
+        continue;
+      }
+      if (!is_first) {
+        fprintf(file, ", ");
+      }
+      is_first = false;
+      fprintf(file, "{ \"key\": ");
+      hll_dump_value(file, entry->key);
+      fprintf(file, ", \"value\": ");
+      hll_dump_value(file, entry->value);
+      fprintf(file, " }");
+    }
+    fprintf(file, "]");
+  } break;
   }
   fprintf(file, "}");
 }
@@ -176,7 +308,31 @@ void dump_function_info(void *file, hll_value value) {
       fprintf(file, ",");
     }
   }
-  fprintf(file, "],"); // params
+  fprintf(file, "]"); // params
+
+  hll_bytecode *bytecode = func->bytecode;
+  size_t op_count = 0;
+  for (size_t i = 0; i < hll_sb_len(bytecode->ops);
+       i += hll_bytecode_insn_size(bytecode->ops + i)) {
+    ++op_count;
+  }
+  fprintf(file,
+          ", \"op_count\": { \"before\": %" PRIu32 ", \"after\": %zu }",
+          bytecode->unoptimized_op_count, op_count);
+  fprintf(file, ", \"functions\": [");
+  bool is_first = true;
+  for (size_t i = 0; i < hll_sb_len(bytecode->constant_pool); ++i) {
+    hll_value constant = bytecode->constant_pool[i];
+    if (hll_get_value_kind(constant) != HLL_VALUE_FUNC) {
+      continue;
+    }
+    if (!is_first) {
+      fprintf(file, ", ");
+    }
+    is_first = false;
+    hll_dump_value(file, constant);
+  }
+  fprintf(file, "]"); // functions
 
 #if 0
   hll_bytecode *bc = func->bytecode;
@@ -196,7 +352,9 @@ void dump_function_info(void *file, hll_value value) {
     switch (op) {
     case HLL_BC_CONST:
     case HLL_BC_MAKEFUN:
-    case HLL_BC_JN: {
+    case HLL_BC_JN:
+    case HLL_BC_DOTIMES:
+    case HLL_BC_DOLIST: {
       uint8_t high = *instruction++;
       uint8_t low = *instruction++;
       uint16_t offset = ((uint16_t)high) << 8 | low;
@@ -251,63 +409,338 @@ void hll_dump_program_info(void *file, hll_value program) {
   hll_dump_value(file, program);
 }
 
-static void investigate_call_op(hll_bytecode *bytecode, size_t call_idx) {
-  assert(bytecode->ops[call_idx] == HLL_BC_CALL);
-  uint8_t *cursor = bytecode->ops + call_idx + 1;
-  uint8_t *end = &hll_sb_last(bytecode->ops) + 1;
-  while (cursor < end) {
-    hll_bytecode_op op = *cursor;
-    switch (op) {
-    case HLL_BC_NIL:
-      // unconditional jump like seen in if's
-      if (cursor[1] == HLL_BC_JN) {
-        cursor += 2;
-        uint8_t high = *cursor++;
-        uint8_t low = *cursor++;
-        uint16_t offset = ((uint16_t)high) << 8 | low;
-        cursor += offset;
-        continue;
+// Instruction decoded for optimization. Jump targets are stored as
+// instruction indices, so instructions can be removed and resized without
+// tracking byte offsets.
+typedef struct {
+  hll_bytecode_op op;
+  // Constant or native index, or index of target instruction for jumps.
+  uint32_t operand;
+  // Number of arguments of CALLNATIVE.
+  uint8_t arg_count;
+  // Location of instruction in debug info, or UINT32_MAX if there is none.
+  uint32_t loc_idx;
+  // Number of jumps that target this instruction.
+  uint32_t jump_count;
+  // Removed instructions are dropped when instructions are compacted. Jumps
+  // to them go to the next instruction.
+  bool is_removed;
+  // Entries of jump tables are indexed by position, so they are kept wide and
+  // are not rewritten.
+  bool is_fixed;
+} hll_insn;
+
+static hll_insn *decode_insns(const hll_bytecode *bytecode) {
+  hll_insn *insns = NULL;
+  size_t *offsets = NULL;
+  // Byte offsets of jump targets. Jump offsets are relative to the next
+  // instruction.
+  size_t *targets = NULL;
+  size_t len = hll_sb_len(bytecode->ops);
+  const hll_bytecode_rle *rle = bytecode->loc_rle;
+  const hll_bytecode_rle *rle_end = rle + hll_sb_len(bytecode->loc_rle);
+  size_t rle_start = 0;
+  for (size_t offset = 0; offset < len;) {
+    hll_insn insn = {0};
+    int64_t operand;
+    size_t next = read_insn(bytecode->ops + offset, &insn.op, &operand,
+                            &insn.arg_count) -
+                  bytecode->ops;
+    while (rle != rle_end && offset >= rle_start + rle->length) {
+      rle_start += rle->length;
+      ++rle;
+    }
+    insn.loc_idx = rle != rle_end ? rle->loc_idx : UINT32_MAX;
+    insn.operand = operand;
+    hll_sb_push(insns, insn);
+    hll_sb_push(offsets, offset);
+    hll_sb_push(targets, next + operand);
+    offset = next;
+  }
+
+  // Resolve jump offsets to instruction indices.
+  for (size_t i = 0; i < hll_sb_len(insns); ++i) {
+    hll_insn *insn = insns + i;
+    if (!is_jump(insn->op)) {
+      continue;
+    }
+
+    size_t target = targets[i];
+    size_t lo = 0;
+    size_t hi = hll_sb_len(offsets);
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (offsets[mid] < target) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
       }
-      // fallthrough
-    case HLL_BC_TRUE:
-    case HLL_BC_CONST:
-    case HLL_BC_APPEND:
-    case HLL_BC_POP:
-    case HLL_BC_FIND:
-    case HLL_BC_CALL:
-    case HLL_BC_MBTRCALL:
-    case HLL_BC_JN:
-    case HLL_BC_LET:
-    case HLL_BC_PUSHENV:
-    case HLL_BC_CAR:
-    case HLL_BC_CDR:
-    case HLL_BC_SETCAR:
-    case HLL_BC_SETCDR:
-    case HLL_BC_MAKEFUN:
-      return;
-    case HLL_BC_END:
-    case HLL_BC_POPENV:
-      ++cursor;
-      break;
     }
+    assert(lo < hll_sb_len(offsets) && offsets[lo] == target);
+    insn->operand = lo;
   }
 
-  bytecode->ops[call_idx] = HLL_BC_MBTRCALL;
+  for (size_t i = 0; i < hll_sb_len(insns); ++i) {
+    if (insns[i].op != HLL_BC_SWITCH) {
+      continue;
+    }
+
+    hll_value table = bytecode->constant_pool[insns[i].operand];
+    size_t entry_count = hll_unwrap_hash(table)->count + 1;
+    for (size_t j = 1; j <= entry_count; ++j) {
+      assert(insns[i + j].op == HLL_BC_JMP);
+      insns[i + j].is_fixed = true;
+    }
+  }
+
+  hll_sb_free(targets);
+  hll_sb_free(offsets);
+  return insns;
 }
 
-static void mark_tail_calls(hll_bytecode *bytecode) {
-  size_t len = hll_sb_len(bytecode->ops);
+static void count_jumps(hll_insn *insns) {
+  for (size_t i = 0; i < hll_sb_len(insns); ++i) {
+    insns[i].jump_count = 0;
+  }
+  for (size_t i = 0; i < hll_sb_len(insns); ++i) {
+    if (is_jump(insns[i].op)) {
+      ++insns[insns[i].operand].jump_count;
+    }
+  }
+}
+
+// Drops removed instructions and retargets jumps.
+static void compact_insns(hll_insn *insns) {
+  size_t len = hll_sb_len(insns);
+  uint32_t *new_idx = hll_alloc(len * sizeof(uint32_t));
+  uint32_t live = 0;
+  for (size_t i = 0; i < len; ++i) {
+    new_idx[i] = live;
+    live += !insns[i].is_removed;
+  }
+  for (size_t i = 0; i < len; ++i) {
+    if (insns[i].is_removed) {
+      continue;
+    }
+    hll_insn insn = insns[i];
+    if (is_jump(insn.op)) {
+      insn.operand = new_idx[insn.operand];
+    }
+    insns[new_idx[i]] = insn;
+  }
+  hll_sb_size(insns) = live;
+  hll_free(new_idx, len * sizeof(uint32_t));
+}
+
+// Rewrites fixed instruction sequences into shorter ones. Instruction that is
+// jumped to can't be merged into preceding one. Returns true if anything was
+// changed.
+static bool peephole_pass(hll_insn *insns) {
+  count_jumps(insns);
+  bool is_changed = false;
+  size_t len = hll_sb_len(insns);
+  for (size_t i = 0; i < len; ++i) {
+    hll_insn *insn = insns + i;
+    hll_insn *next = i + 1 < len ? insn + 1 : NULL;
+    hll_insn *next2 = i + 2 < len ? insn + 2 : NULL;
+    if (insn->is_removed || insn->is_fixed) {
+      continue;
+    }
+
+    bool is_const_cond = (insn->op == HLL_BC_NIL || insn->op == HLL_BC_TRUE) &&
+                         next != NULL && next->jump_count == 0 &&
+                         (next->op == HLL_BC_JN || next->op == HLL_BC_JT);
+    if (is_const_cond &&
+        (insn->op == HLL_BC_NIL) == (next->op == HLL_BC_JN)) {
+      // Conditional jump that is always taken is unconditional.
+      insn->op = HLL_BC_JMP;
+      insn->operand = next->operand;
+      next->is_removed = true;
+      is_changed = true;
+    } else if (is_const_cond) {
+      // Conditional jump that is never taken does nothing.
+      --insns[next->operand].jump_count;
+      insn->is_removed = next->is_removed = true;
+      is_changed = true;
+    } else if ((insn->op == HLL_BC_NIL || insn->op == HLL_BC_TRUE) &&
+               next != NULL && next->jump_count == 0 &&
+               next->op == HLL_BC_JTK) {
+      // Constant is either kept and jumped with, or popped.
+      if (insn->op == HLL_BC_TRUE) {
+        next->op = HLL_BC_JMP;
+      } else {
+        --insns[next->operand].jump_count;
+        insn->is_removed = next->is_removed = true;
+      }
+      is_changed = true;
+    } else if (insn->op == HLL_BC_CONST && next != NULL &&
+               next->op == HLL_BC_FIND && next->jump_count == 0 &&
+               next2 != NULL && next2->op == HLL_BC_CDR &&
+               next2->jump_count == 0) {
+      insn->op = HLL_BC_LOADVAR;
+      next->is_removed = next2->is_removed = true;
+      is_changed = true;
+    } else if ((insn->op == HLL_BC_NIL || insn->op == HLL_BC_TRUE ||
+                insn->op == HLL_BC_CONST) &&
+               next != NULL && next->op == HLL_BC_POP &&
+               next->jump_count == 0) {
+      // Value without side effects is discarded.
+      insn->is_removed = next->is_removed = true;
+      is_changed = true;
+    } else if (has_signed_offset(insn->op)) {
+      hll_insn *target = insns + insn->operand;
+      if (target->op == HLL_BC_JMP && target->operand != insn->operand) {
+        // Jump to jump goes directly to the final target.
+        --target->jump_count;
+        insn->operand = target->operand;
+        ++insns[insn->operand].jump_count;
+        is_changed = true;
+      } else if (insn->op == HLL_BC_JMP && target->op == HLL_BC_END) {
+        insn->op = HLL_BC_END;
+        --target->jump_count;
+        is_changed = true;
+      } else if (insn->op == HLL_BC_JMP && insn->operand == i + 1) {
+        insn->is_removed = true;
+        --target->jump_count;
+        is_changed = true;
+      }
+    }
+  }
+
+  compact_insns(insns);
+  return is_changed;
+}
+
+// Marks calls that are followed only by function return as possible tail
+// calls.
+static void mark_tail_calls(hll_insn *insns) {
+  for (size_t i = 0; i < hll_sb_len(insns); ++i) {
+    if (insns[i].op != HLL_BC_CALL) {
+      continue;
+    }
+
+    size_t cursor = i + 1;
+    for (;;) {
+      hll_bytecode_op op = insns[cursor].op;
+      if (op == HLL_BC_JMP && insns[cursor].operand > cursor) {
+        // Only forward jumps are followed, so this terminates.
+        cursor = insns[cursor].operand;
+      } else if (op == HLL_BC_POPENV) {
+        ++cursor;
+      } else {
+        if (op == HLL_BC_END) {
+          insns[i].op = HLL_BC_MBTRCALL;
+        }
+        break;
+      }
+    }
+  }
+}
+
+// Returns operand of instruction as it is encoded. Jumps are encoded as
+// offsets relative to the next instruction.
+static int64_t get_encoded_operand(const hll_insn *insns, const size_t *offsets,
+                                   size_t idx) {
+  int64_t operand = insns[idx].operand;
+  if (is_jump(insns[idx].op)) {
+    operand = (int64_t)offsets[operand] - (int64_t)offsets[idx + 1];
+  }
+  return operand;
+}
+
+static bool fits_short_operand(hll_bytecode_op op, int64_t operand) {
+  if (has_signed_offset(op)) {
+    return operand >= INT16_MIN && operand <= INT16_MAX;
+  }
+  return operand >= 0 && operand <= UINT16_MAX;
+}
+
+static size_t get_insn_size(const hll_insn *insn, bool is_wide) {
+  size_t size = 1;
+  if (has_varint_operand(insn->op)) {
+    size += 1 + (insn->op == HLL_BC_CALLNATIVE);
+    for (uint32_t value = insn->operand >> 7; value != 0; value >>= 7) {
+      ++size;
+    }
+  } else if (is_jump(insn->op)) {
+    size = is_wide ? 6 : 3;
+  }
+
+  return size;
+}
+
+static void encode_insns(hll_bytecode *bytecode, const hll_insn *insns) {
+  size_t len = hll_sb_len(insns);
+  size_t *offsets = hll_alloc((len + 1) * sizeof(size_t));
+  bool *is_wide = hll_alloc(len * sizeof(bool));
+  for (size_t i = 0; i < len; ++i) {
+    is_wide[i] = insns[i].is_fixed;
+  }
+  // Jump offsets depend on sizes of instructions between jump and its target,
+  // so sizes are recomputed until all offsets fit. Jumps only grow, so this
+  // terminates.
+  for (bool is_changed = true; is_changed;) {
+    for (size_t i = 0; i < len; ++i) {
+      offsets[i + 1] = offsets[i] + get_insn_size(insns + i, is_wide[i]);
+    }
+
+    is_changed = false;
+    for (size_t i = 0; i < len; ++i) {
+      if (is_jump(insns[i].op) && !is_wide[i] &&
+          !fits_short_operand(insns[i].op,
+                              get_encoded_operand(insns, offsets, i))) {
+        is_wide[i] = is_changed = true;
+      }
+    }
+  }
+
+  hll_sb_purge(bytecode->ops);
+  hll_sb_purge(bytecode->loc_rle);
   for (size_t i = 0; i < len; ++i) {
-    hll_bytecode_op op = bytecode->ops[i];
-    if (op == HLL_BC_CALL) {
-      investigate_call_op(bytecode, i);
+    const hll_insn *insn = insns + i;
+    if (is_wide[i]) {
+      hll_bytecode_emit_op(bytecode, HLL_BC_WIDE);
+    }
+    hll_bytecode_emit_op(bytecode, insn->op);
+    int64_t operand = get_encoded_operand(insns, offsets, i);
+    if (has_varint_operand(insn->op)) {
+      hll_bytecode_emit_varint(bytecode, operand);
+      if (insn->op == HLL_BC_CALLNATIVE) {
+        hll_bytecode_emit_u8(bytecode, insn->arg_count);
+      }
+    } else if (is_wide[i]) {
+      assert(operand >= INT32_MIN && operand <= INT32_MAX);
+      hll_bytecode_emit_u32(bytecode, (uint32_t)operand);
+    } else if (is_jump(insn->op)) {
+      hll_bytecode_emit_u16(bytecode, (uint16_t)operand);
+    }
+    assert(hll_sb_len(bytecode->ops) == offsets[i + 1]);
+
+    // Instruction without location extends preceding run, so that locations
+    // of following instructions don't shift.
+    uint32_t size = offsets[i + 1] - offsets[i];
+    if (hll_sb_len(bytecode->loc_rle) != 0 &&
+        (insn->loc_idx == UINT32_MAX ||
+         hll_sb_last(bytecode->loc_rle).loc_idx == insn->loc_idx)) {
+      hll_sb_last(bytecode->loc_rle).length += size;
+    } else if (insn->loc_idx != UINT32_MAX) {
+      hll_bytecode_rle rle = {.length = size, .loc_idx = insn->loc_idx};
+      hll_sb_push(bytecode->loc_rle, rle);
     }
-    i += hll_bytecode_op_body_size(op);
   }
+
+  hll_free(is_wide, len * sizeof(bool));
+  hll_free(offsets, (len + 1) * sizeof(size_t));
 }
 
 void hll_optimize_bytecode(hll_bytecode *bytecode) {
+  hll_insn *insns = decode_insns(bytecode);
+  bytecode->unoptimized_op_count = hll_sb_len(insns);
+  while (peephole_pass(insns)) {
+  }
   if (!hll_is_nil(bytecode->name)) {
-    mark_tail_calls(bytecode);
+    mark_tail_calls(insns);
   }
+  encode_insns(bytecode, insns);
+  hll_sb_free(insns);
 }
@@ -20,9 +20,15 @@
 // contains series of instructions forming function body, as well as
 // separate list of constants.
 //
+// Constant indices are encoded as varints: 7 bits per byte, most significant
+// first, with high bit set on all bytes but the last. Most functions have
+// less than 128 constants, so index takes single byte, and constant pool
+// size is not limited.
+//
 #ifndef HLL_BC_H
 #define HLL_BC_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -38,7 +44,7 @@ typedef enum {
   HLL_BC_NIL,
   // Pushes true on stack
   HLL_BC_TRUE,
-  // Pushes constant on stack (u16 index)
+  // Pushes constant on stack (varint index)
   HLL_BC_CONST,
   // Uses 3 last items on stack. First two are considered list head and tail,
   // 3 is element that needs to be appended to list. Pops last element
@@ -59,7 +65,7 @@ typedef enum {
   // Maybe tail recursive call. Compiler marks calls that are tail-ones,
   // and when vm sees this instruction it possibly do self tail recursion.
   HLL_BC_MBTRCALL,
-  // Jump if nil (u16 offset, two's complement).
+  // Jump if nil (i16 offset, two's complement). Pops the condition.
   HLL_BC_JN,
   // Defines new variable with given name in current env (lexical env).
   // If variable with same name is defined in current env, error.
@@ -79,11 +85,57 @@ typedef enum {
   HLL_BC_SETCAR,
   // Sets cdr of 2-nd object on stack. Pops the value.
   HLL_BC_SETCDR,
-  // Creates function object using constant index (u16). Object in constant slot
-  // should be compiled function object. It is copied and pushed on top of the
-  // stack.
+  // Creates function object using constant index (varint). Object in constant
+  // slot should be compiled function object. It is copied and pushed on top of
+  // the stack.
   // Then all symbols referenced in function definition are captured.
   HLL_BC_MAKEFUN,
+  // Pops index and vector from stack and pushes item of vector at that index.
+  HLL_BC_VREF,
+  // Sets item of 3-rd object on stack at index that is 2-nd object on stack.
+  // Pops the value and index.
+  HLL_BC_VSET,
+  // Steps dotimes loop. Uses two elements on stack: count limit and variable
+  // storage cons. Increments variable in place, and if it is no longer less
+  // than limit pops both and jumps forward (u16 offset).
+  HLL_BC_DOTIMES,
+  // Steps dolist loop. Uses three elements on stack: sequence, index and
+  // variable storage cons. Sequence is either rest of list, which is replaced
+  // with its cdr, or range, which is iterated using index. If sequence is
+  // exhausted pops all three and jumps forward (u16 offset). Otherwise stores
+  // next item into variable.
+  HLL_BC_DOLIST,
+  // Unconditional jump (i16 offset, two's complement). Jumps backward close
+  // loop bodies.
+  HLL_BC_JMP,
+  // Pushes value of variable named by constant (varint index). Same as CONST,
+  // FIND and CDR.
+  HLL_BC_LOADVAR,
+  // Pops cdr and car and pushes new cons made of them.
+  HLL_BC_CONS,
+  // Jump if not nil (i16 offset, two's complement). Pops the condition.
+  HLL_BC_JT,
+  // Prefix that makes operand of following jump instruction 4 bytes long.
+  // Jump offsets are counted from the end of the whole instruction.
+  // Compiler emits all jumps in this form and optimizer shrinks the ones that
+  // fit in 2 bytes, so jumps inside function of any size are encoded
+  // correctly.
+  HLL_BC_WIDE,
+  // Jump if not nil (i16 offset, two's complement) leaving the condition on
+  // stack. Pops the condition if it is nil. Used by or, which returns first
+  // value that is not nil.
+  HLL_BC_JTK,
+  // Pops key and jumps to entry of jump table that follows the instruction.
+  // Entry is selected by hash table in constant slot (varint index), which
+  // maps keys to entry indices. Entries are wide JMP instructions, one for
+  // each key of table and the last one for keys that are not in table.
+  HLL_BC_SWITCH,
+  // Calls builtin by its index in native table of vm (varint) with given
+  // number of arguments (u8) that are on top of stack. Pops arguments and
+  // pushes result. Compiler emits it for calls to builtins that are not
+  // redefined in translation unit. If builtin is redefined later, call is
+  // done to current value of its variable.
+  HLL_BC_CALLNATIVE,
 } hll_bytecode_op;
 
 // Contains unit of bytecode. This is typically some compiled function
@@ -97,7 +149,14 @@ typedef struct hll_bytecode {
   // Constant pool dynamic array
   hll_value *constant_pool;
   uint32_t translation_unit;
+  // Source locations of instructions. Dynamic array.
+  struct hll_bytecode_rle *loc_rle;
   hll_value name;
+  // All values in constant pool are permanent. Garbage collector does not need
+  // to trace them.
+  bool is_perm;
+  // Number of instructions before optimization.
+  uint32_t unoptimized_op_count;
 } hll_bytecode;
 
 //
@@ -112,13 +171,17 @@ void hll_bytecode_dec_refcount(hll_bytecode *bytecode);
 // Functions used to generate bytecode
 //
 
-size_t hll_bytecode_op_body_size(hll_bytecode_op op);
+// Returns size of instruction starting at given byte, including wide prefix.
+size_t hll_bytecode_insn_size(const uint8_t *insn);
 
 size_t hll_bytecode_op_idx(const hll_bytecode *bytecode);
 size_t hll_bytecode_emit_u8(hll_bytecode *bytecode, uint8_t byte);
 size_t hll_bytecode_emit_u16(hll_bytecode *bytecode, uint16_t value);
+size_t hll_bytecode_emit_u32(hll_bytecode *bytecode, uint32_t value);
+size_t hll_bytecode_emit_varint(hll_bytecode *bytecode, uint32_t value);
 size_t hll_bytecode_emit_op(hll_bytecode *bytecode, hll_bytecode_op op);
 
+// Runs peephole optimizations on finished bytecode and marks tail calls.
 void hll_optimize_bytecode(hll_bytecode *bytecode);
 
 //
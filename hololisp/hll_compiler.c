@@ -27,7 +27,9 @@ typedef enum {
   HLL_LEX_EQC_EOF,
   HLL_LEX_EQC_SPACE,
   HLL_LEX_EQC_NEWLINE,
-  HLL_LEX_EQC_COMMENT, // ;
+  HLL_LEX_EQC_COMMENT,   // ;
+  HLL_LEX_EQC_DQUOTE,    // "
+  HLL_LEX_EQC_BACKSLASH, // \ (escapes in strings)
 } hll_lexer_equivalence_class;
 
 typedef enum {
@@ -37,6 +39,8 @@ typedef enum {
   HLL_LEX_SEEN_SIGN,
   HLL_LEX_DOTS,
   HLL_LEX_SYMB,
+  HLL_LEX_STRING,
+  HLL_LEX_STRING_ESCAPE,
   HLL_LEX_UNEXPECTED,
 
   HLL_LEX_FIN,
@@ -49,6 +53,8 @@ typedef enum {
   HLL_LEX_FIN_EOF,
   HLL_LEX_FIN_UNEXPECTED,
   HLL_LEX_FIN_COMMENT,
+  HLL_LEX_FIN_STRING,
+  HLL_LEX_FIN_UNTERMINATED_STRING,
 } hll_lexer_state;
 
 #define HLL_ENUMERATE_CAR_CDR                                                  \
@@ -83,6 +89,18 @@ typedef enum {
   HLL_FORM_LAMBDA,
   HLL_FORM_DEFINE,
   HLL_FORM_DEFMACRO,
+  HLL_FORM_VREF,
+  HLL_FORM_VSET,
+  HLL_FORM_WHILE,
+  HLL_FORM_DOTIMES,
+  HLL_FORM_DOLIST,
+  HLL_FORM_AND,
+  HLL_FORM_OR,
+  HLL_FORM_NOT,
+  HLL_FORM_WHEN,
+  HLL_FORM_UNLESS,
+  HLL_FORM_COND,
+  HLL_FORM_CASE,
 #define HLL_CAR_CDR(_, _letters) HLL_FORM_C##_letters##R,
   HLL_ENUMERATE_CAR_CDR
 #undef HLL_CAR_CDR
@@ -93,6 +111,7 @@ typedef enum {
   HLL_LOC_FORM_SYMB,
   HLL_LOC_FORM_NTH,
   HLL_LOC_FORM_NTHCDR,
+  HLL_LOC_FORM_VREF,
 #define HLL_CAR_CDR(_, _letters) HLL_LOC_FORM_C##_letters##R,
   HLL_ENUMERATE_CAR_CDR
 #undef HLL_CAR_CDR
@@ -158,14 +177,18 @@ bool hll_compile(struct hll_vm *vm, const char *source, const char *name,
   hll_reader reader;
   hll_reader_init(&reader, &lexer, &tu);
 
-  hll_push_forbid_gc(vm->gc);
+  hll_handle_scope scope = hll_gc_open_scope(vm->gc);
+  // Ast must outlive compilation because location table is keyed by
+  // addresses of its objects.
   hll_value ast = hll_read_ast(&reader);
+  hll_gc_handle(vm->gc, ast);
 
   if (lexer.error_count == 0 && reader.error_count == 0) {
     hll_compiler compiler;
     hll_compiler_init(&compiler, &tu, hll_nil());
+    compiler.is_toplevel = true;
     *compiled = hll_compile_ast(&compiler, ast);
-    hll_sb_free(compiler.loc_stack);
+    hll_compiler_free(&compiler);
 
     if (compiler.error_count != 0) {
       result = false;
@@ -174,7 +197,7 @@ bool hll_compile(struct hll_vm *vm, const char *source, const char *name,
     result = false;
   }
 
-  hll_pop_forbid_gc(vm->gc);
+  hll_gc_close_scope(vm->gc, scope);
   hll_delete_tu(&tu);
 
   return result;
@@ -191,6 +214,8 @@ static inline hll_lexer_equivalence_class get_equivalence_class(char symb) {
     case '\0': eqc = HLL_LEX_EQC_EOF; break;
     case '\n': eqc = HLL_LEX_EQC_NEWLINE; break;
     case ';': eqc = HLL_LEX_EQC_COMMENT; break;
+    case '"': eqc = HLL_LEX_EQC_DQUOTE; break;
+    case '\\': eqc = HLL_LEX_EQC_BACKSLASH; break;
     case '1': case '2': case '3':
     case '4': case '5': case '6':
     case '7': case '8': case '9':
@@ -227,8 +252,12 @@ static inline hll_lexer_state get_next_state(hll_lexer_state state,
     case HLL_LEX_EQC_NEWLINE: /* nop */
       break;
     case HLL_LEX_EQC_OTHER:
+    case HLL_LEX_EQC_BACKSLASH:
       state = HLL_LEX_UNEXPECTED;
       break;
+    case HLL_LEX_EQC_DQUOTE:
+      state = HLL_LEX_STRING;
+      break;
     case HLL_LEX_EQC_NUMBER:
       state = HLL_LEX_NUMBER;
       break;
@@ -325,6 +354,27 @@ static inline hll_lexer_state get_next_state(hll_lexer_state state,
       break;
     }
     break;
+  case HLL_LEX_STRING:
+    switch (eqc) {
+    case HLL_LEX_EQC_DQUOTE:
+      state = HLL_LEX_FIN_STRING;
+      break;
+    case HLL_LEX_EQC_BACKSLASH:
+      state = HLL_LEX_STRING_ESCAPE;
+      break;
+    case HLL_LEX_EQC_EOF:
+      state = HLL_LEX_FIN_UNTERMINATED_STRING;
+      break;
+    default: /* nop */
+      break;
+    }
+    break;
+  case HLL_LEX_STRING_ESCAPE:
+    // Escape sequences are validated by reader, lexer only needs to know
+    // that escaped quote does not end the string.
+    state = eqc == HLL_LEX_EQC_EOF ? HLL_LEX_FIN_UNTERMINATED_STRING
+                                   : HLL_LEX_STRING;
+    break;
   case HLL_LEX_UNEXPECTED:
     if (eqc != HLL_LEX_EQC_OTHER) {
       state = HLL_LEX_FIN_UNEXPECTED;
@@ -387,7 +437,9 @@ const hll_token *hll_lexer_next(hll_lexer *lexer) {
   case HLL_LEX_FIN_LPAREN:
   case HLL_LEX_FIN_RPAREN:
   case HLL_LEX_FIN_QUOTE:
+  case HLL_LEX_FIN_STRING:
     break;
+  case HLL_LEX_FIN_UNTERMINATED_STRING:
   case HLL_LEX_FIN_DOTS:
   case HLL_LEX_FIN_NUMBER:
   case HLL_LEX_FIN_SYMB:
@@ -426,6 +478,13 @@ const hll_token *hll_lexer_next(hll_lexer *lexer) {
   case HLL_LEX_FIN_COMMENT:
     lexer->next.kind = HLL_TOK_COMMENT;
     break;
+  case HLL_LEX_FIN_STRING:
+    lexer->next.kind = HLL_TOK_STRING;
+    break;
+  case HLL_LEX_FIN_UNTERMINATED_STRING:
+    lexer_error(lexer, "Unterminated string literal");
+    lexer->next.kind = HLL_TOK_STRING;
+    break;
   case HLL_LEX_FIN_DOTS: {
     if (lexer->next.length == 1) {
       lexer->next.kind = HLL_TOK_DOT;
@@ -463,6 +522,7 @@ hll_translation_unit hll_make_tu(struct hll_vm *vm, const char *source,
     tu.locs = hll_alloc(sizeof(*tu.locs));
     tu.translation_unit = hll_ds_init_tu(vm->debug, source, name);
   }
+  tu.symbols = hll_alloc(sizeof(*tu.symbols));
 
   return tu;
 }
@@ -472,6 +532,8 @@ void hll_delete_tu(hll_translation_unit *tu) {
     hll_sb_free(tu->locs->entries);
     hll_free(tu->locs, sizeof(*tu->locs));
   }
+  hll_sb_free(tu->symbols->entries);
+  hll_free(tu->symbols, sizeof(*tu->symbols));
 }
 
 void hll_reader_init(hll_reader *reader, hll_lexer *lexer,
@@ -551,11 +613,13 @@ static hll_value read_list(hll_reader *reader) {
     return hll_nil();
   }
 
-  hll_value list_head;
-  hll_value list_tail;
-  list_head = list_tail =
-      hll_new_cons(reader->tu->vm, read_expr(reader), hll_nil());
-  record_location(reader, list_head);
+  hll_gc *gc = reader->tu->vm->gc;
+  hll_handle_scope scope = hll_gc_open_scope(gc);
+  hll_handle ast = hll_gc_handle(gc, read_expr(reader));
+  hll_value list_tail =
+      hll_new_cons(reader->tu->vm, hll_gc_get(gc, ast), hll_nil());
+  hll_handle list_head = hll_gc_handle(gc, list_tail);
+  record_location(reader, list_tail);
 
   // Now enter the loop of parsing other list elements.
   for (;;) {
@@ -563,32 +627,75 @@ static hll_value read_list(hll_reader *reader) {
     if (reader->token->kind == HLL_TOK_EOF) {
       reader_error(reader, head_offset,
                    "Missing closing paren when reading list (eof encountered)");
-      return list_head;
+      break;
     } else if (reader->token->kind == HLL_TOK_RPAREN) {
       eat_token(reader);
-      return list_head;
+      break;
     } else if (reader->token->kind == HLL_TOK_DOT) {
       eat_token(reader);
-      hll_unwrap_cons(list_tail)->cdr = read_expr(reader);
+      hll_value cdr = read_expr(reader);
+      hll_unwrap_cons(list_tail)->cdr = cdr;
 
       peek_token(reader);
       if (reader->token->kind != HLL_TOK_RPAREN) {
         reader_error(reader, head_offset,
                      "Missing closing paren after dot when reading list");
-        return list_head;
+        break;
       }
       eat_token(reader);
-      return list_head;
+      break;
     }
 
-    hll_value ast = read_expr(reader);
-    hll_value cons = hll_new_cons(reader->tu->vm, ast, hll_nil());
+    hll_gc_set(gc, ast, read_expr(reader));
+    hll_value cons =
+        hll_new_cons(reader->tu->vm, hll_gc_get(gc, ast), hll_nil());
     hll_setcdr(list_tail, cons);
     list_tail = cons;
     record_location(reader, list_tail);
   }
 
-  HLL_UNREACHABLE;
+  hll_value result = hll_gc_get(gc, list_head);
+  hll_gc_close_scope(gc, scope);
+  return result;
+}
+
+// Creates string from string literal token, resolving escape sequences.
+static hll_value read_string(hll_reader *reader) {
+  const char *cursor = reader->lexer->input + reader->token->offset + 1;
+  const char *end =
+      reader->lexer->input + reader->token->offset + reader->token->length;
+  // Unterminated literal has no closing quote.
+  if (end > cursor && end[-1] == '"') {
+    --end;
+  }
+
+  char *bytes = NULL;
+  while (cursor < end) {
+    char c = *cursor++;
+    if (c == '\\' && cursor < end) {
+      c = *cursor++;
+      switch (c) {
+      case 'n':
+        c = '\n';
+        break;
+      case 't':
+        c = '\t';
+        break;
+      case '\\':
+      case '"':
+        break;
+      default:
+        reader_error(reader, cursor - 2 - reader->lexer->input,
+                     "Unknown escape sequence '\\%c'", c);
+        break;
+      }
+    }
+    hll_sb_push(bytes, c);
+  }
+
+  hll_value result = hll_new_str(reader->tu->vm, bytes, hll_sb_len(bytes));
+  hll_sb_free(bytes);
+  return result;
 }
 
 static hll_value read_expr(hll_reader *reader) {
@@ -601,6 +708,10 @@ static hll_value read_expr(hll_reader *reader) {
     eat_token(reader);
     ast = hll_num(reader->token->value);
     break;
+  case HLL_TOK_STRING:
+    eat_token(reader);
+    ast = read_string(reader);
+    break;
   case HLL_TOK_SYMB:
     eat_token(reader);
     if (reader->token->length == 1 &&
@@ -618,9 +729,15 @@ static hll_value read_expr(hll_reader *reader) {
     break;
   case HLL_TOK_QUOTE: {
     eat_token(reader);
-    ast = hll_new_cons(
-        reader->tu->vm, hll_new_symbolz(reader->tu->vm, "quote"),
-        hll_new_cons(reader->tu->vm, read_expr(reader), hll_nil()));
+    hll_vm *vm = reader->tu->vm;
+    hll_handle_scope scope = hll_gc_open_scope(vm->gc);
+    hll_handle quoted = hll_gc_handle(vm->gc, read_expr(reader));
+    hll_gc_set(vm->gc, quoted,
+               hll_new_cons(vm, hll_gc_get(vm->gc, quoted), hll_nil()));
+    hll_handle quote = hll_gc_handle(vm->gc, hll_new_symbolz(vm, "quote"));
+    ast = hll_new_cons(vm, hll_gc_get(vm->gc, quote),
+                       hll_gc_get(vm->gc, quoted));
+    hll_gc_close_scope(vm->gc, scope);
   } break;
   case HLL_TOK_COMMENT:
   case HLL_TOK_UNEXPECTED:
@@ -637,7 +754,10 @@ static hll_value read_expr(hll_reader *reader) {
 }
 
 hll_value hll_read_ast(hll_reader *reader) {
-  hll_value list_head = hll_nil();
+  hll_gc *gc = reader->tu->vm->gc;
+  hll_handle_scope scope = hll_gc_open_scope(gc);
+  hll_handle list_head = hll_gc_handle(gc, hll_nil());
+  hll_handle ast = hll_gc_handle(gc, hll_nil());
   hll_value list_tail = hll_nil();
 
   for (;;) {
@@ -646,19 +766,22 @@ hll_value hll_read_ast(hll_reader *reader) {
       break;
     }
 
-    hll_value ast = read_expr(reader);
-    hll_value cons = hll_new_cons(reader->tu->vm, ast, hll_nil());
+    hll_gc_set(gc, ast, read_expr(reader));
+    hll_value cons =
+        hll_new_cons(reader->tu->vm, hll_gc_get(gc, ast), hll_nil());
 
-    if (hll_is_nil(list_head)) {
-      list_head = list_tail = cons;
-      record_location(reader, list_head);
+    if (hll_is_nil(hll_gc_get(gc, list_head))) {
+      hll_gc_set(gc, list_head, cons);
+      record_location(reader, cons);
     } else {
       hll_unwrap_cons(list_tail)->cdr = cons;
-      list_tail = cons;
     }
+    list_tail = cons;
   }
 
-  return list_head;
+  hll_value result = hll_gc_get(gc, list_head);
+  hll_gc_close_scope(gc, scope);
+  return result;
 }
 
 void hll_compiler_init(hll_compiler *compiler, hll_translation_unit *tu,
@@ -669,6 +792,18 @@ void hll_compiler_init(hll_compiler *compiler, hll_translation_unit *tu,
   compiler->bytecode->translation_unit = tu->translation_unit;
 }
 
+void hll_compiler_free(hll_compiler *compiler) {
+  hll_sb_free(compiler->loc_stack);
+  if (compiler->constants.capacity != 0) {
+    hll_free(compiler->constants.slots,
+             compiler->constants.capacity * sizeof(uint32_t));
+  }
+  if (compiler->fold_cache.capacity != 0) {
+    hll_free(compiler->fold_cache.entries,
+             compiler->fold_cache.capacity * sizeof(hll_fold_entry));
+  }
+}
+
 __attribute__((format(printf, 3, 4))) static void
 compiler_error(hll_compiler *compiler, hll_value ast, const char *fmt, ...) {
   ++compiler->error_count;
@@ -710,9 +845,8 @@ static bool compiler_push_location(hll_compiler *compiler, hll_value value) {
   size_t current_op_idx = hll_bytecode_op_idx(compiler->bytecode);
   size_t section_size = current_op_idx - compiler->loc_op_idx;
   if (section_size) {
-    hll_bytecode_add_loc(compiler->tu->vm->debug,
-                         compiler->tu->translation_unit, section_size, e.cu,
-                         e.offset);
+    hll_bytecode_add_loc(compiler->tu->vm->debug, compiler->bytecode,
+                         section_size, e.cu, e.offset);
     compiler->loc_op_idx = current_op_idx;
   }
 
@@ -735,98 +869,721 @@ static void compiler_pop_location(hll_compiler *compiler, bool skip) {
     hll_compiler_loc_stack_entry *e = &hll_sb_last(compiler->loc_stack);
     size_t section_size = current_op_idx - compiler->loc_op_idx;
     if (section_size) {
-      hll_bytecode_add_loc(compiler->tu->vm->debug,
-                           compiler->tu->translation_unit, section_size, e->cu,
-                           e->offset);
+      hll_bytecode_add_loc(compiler->tu->vm->debug, compiler->bytecode,
+                           section_size, e->cu, e->offset);
     }
   }
   compiler->loc_op_idx = current_op_idx;
 }
 
-static hll_form_kind get_form_kind(const char *symb) {
-  hll_form_kind kind = HLL_FORM_REGULAR;
-  if (strcmp(symb, "quote") == 0) {
-    kind = HLL_FORM_QUOTE;
-  } else if (strcmp(symb, "if") == 0) {
-    kind = HLL_FORM_IF;
-  } else if (strcmp(symb, "set!") == 0) {
-    kind = HLL_FORM_SET;
-  } else if (strcmp(symb, "let") == 0) {
-    kind = HLL_FORM_LET;
-  } else if (strcmp(symb, "list") == 0) {
-    kind = HLL_FORM_LIST;
-  } else if (strcmp(symb, "cons") == 0) {
-    kind = HLL_FORM_CONS;
-  } else if (strcmp(symb, "setcar!") == 0) {
-    kind = HLL_FORM_SETCAR;
-  } else if (strcmp(symb, "setcdr!") == 0) {
-    kind = HLL_FORM_SETCDR;
-  } else if (strcmp(symb, "define") == 0) {
-    kind = HLL_FORM_DEFINE;
-  } else if (strcmp(symb, "progn") == 0) {
-    kind = HLL_FORM_PROGN;
-  } else if (strcmp(symb, "lambda") == 0) {
-    kind = HLL_FORM_LAMBDA;
-  } else if (strcmp(symb, "defmacro") == 0) {
-    kind = HLL_FORM_DEFMACRO;
-  }
+// Symbol that has special meaning for compiler. Symbol can be head of special
+// form, location of set! or sequence function that can be fused.
+typedef struct {
+  const char *name;
+  hll_form_kind form;
+  hll_location_form location;
+  bool is_seq_fn;
+  // Sequence function produces new sequence, like map does.
+  bool is_transform;
+} hll_special_symb;
+
+static const hll_special_symb special_symbs[] = {
+    {"quote", HLL_FORM_QUOTE, HLL_LOC_NONE, false, false},
+    {"if", HLL_FORM_IF, HLL_LOC_NONE, false, false},
+    {"set!", HLL_FORM_SET, HLL_LOC_NONE, false, false},
+    {"let", HLL_FORM_LET, HLL_LOC_NONE, false, false},
+    {"list", HLL_FORM_LIST, HLL_LOC_NONE, false, false},
+    {"cons", HLL_FORM_CONS, HLL_LOC_NONE, false, false},
+    {"setcar!", HLL_FORM_SETCAR, HLL_LOC_NONE, false, false},
+    {"setcdr!", HLL_FORM_SETCDR, HLL_LOC_NONE, false, false},
+    {"define", HLL_FORM_DEFINE, HLL_LOC_NONE, false, false},
+    {"progn", HLL_FORM_PROGN, HLL_LOC_NONE, false, false},
+    {"lambda", HLL_FORM_LAMBDA, HLL_LOC_NONE, false, false},
+    {"defmacro", HLL_FORM_DEFMACRO, HLL_LOC_NONE, false, false},
+    {"vector-ref", HLL_FORM_VREF, HLL_LOC_FORM_VREF, false, false},
+    {"vector-set!", HLL_FORM_VSET, HLL_LOC_NONE, false, false},
+    {"while", HLL_FORM_WHILE, HLL_LOC_NONE, false, false},
+    {"dotimes", HLL_FORM_DOTIMES, HLL_LOC_NONE, false, false},
+    {"dolist", HLL_FORM_DOLIST, HLL_LOC_NONE, false, false},
+    {"and", HLL_FORM_AND, HLL_LOC_NONE, false, false},
+    {"or", HLL_FORM_OR, HLL_LOC_NONE, false, false},
+    {"not", HLL_FORM_NOT, HLL_LOC_NONE, false, false},
+    {"when", HLL_FORM_WHEN, HLL_LOC_NONE, false, false},
+    {"unless", HLL_FORM_UNLESS, HLL_LOC_NONE, false, false},
+    {"cond", HLL_FORM_COND, HLL_LOC_NONE, false, false},
+    {"case", HLL_FORM_CASE, HLL_LOC_NONE, false, false},
+    {"nth", HLL_FORM_REGULAR, HLL_LOC_FORM_NTH, false, false},
+    {"nthcdr", HLL_FORM_REGULAR, HLL_LOC_FORM_NTHCDR, false, false},
+    {"map", HLL_FORM_REGULAR, HLL_LOC_NONE, true, true},
+    {"filter", HLL_FORM_REGULAR, HLL_LOC_NONE, true, true},
+    {"reduce", HLL_FORM_REGULAR, HLL_LOC_NONE, true, false},
+    {"count", HLL_FORM_REGULAR, HLL_LOC_NONE, true, false},
+    {"any", HLL_FORM_REGULAR, HLL_LOC_NONE, true, false},
+    {"all", HLL_FORM_REGULAR, HLL_LOC_NONE, true, false},
 #define HLL_CAR_CDR(_lower, _upper)                                            \
-  else if (strcmp(symb, "c" #_lower "r") == 0) {                               \
-    kind = HLL_FORM_C##_upper##R;                                              \
-  }
-  HLL_ENUMERATE_CAR_CDR
+  {"c" #_lower "r", HLL_FORM_C##_upper##R, HLL_LOC_FORM_C##_upper##R, false,   \
+   false},
+    HLL_ENUMERATE_CAR_CDR
 #undef HLL_CAR_CDR
+};
+
+void hll_init_special_symbs(struct hll_vm *vm) {
+  size_t count = sizeof(special_symbs) / sizeof(special_symbs[0]);
+  assert(count * 2 <= HLL_SPECIAL_SYMB_SLOTS);
+  size_t mask = HLL_SPECIAL_SYMB_SLOTS - 1;
+  memset(vm->special_symbs, 0, sizeof(vm->special_symbs));
+  for (size_t i = 0; i < count; ++i) {
+    const char *name = special_symbs[i].name;
+    size_t slot = hll_symbol_hash(name, strlen(name)) & mask;
+    while (vm->special_symbs[slot] != 0) {
+      slot = (slot + 1) & mask;
+    }
+    vm->special_symbs[slot] = i + 1;
+  }
+}
 
-  return kind;
+// Returns meaning of symbol for compiler or NULL if it is regular one. Symbol
+// is looked up by its hash, so this takes single string comparison in most
+// cases.
+static const hll_special_symb *find_special_symb(hll_compiler *compiler,
+                                                 hll_value symb) {
+  if (!hll_is_symb(symb)) {
+    return NULL;
+  }
+
+  const uint8_t *slots = compiler->tu->vm->special_symbs;
+  size_t mask = HLL_SPECIAL_SYMB_SLOTS - 1;
+  for (size_t slot = hll_unwrap_symb(symb)->hash & mask; slots[slot] != 0;
+       slot = (slot + 1) & mask) {
+    const hll_special_symb *special = special_symbs + slots[slot] - 1;
+    if (strcmp(hll_unwrap_zsymb(symb), special->name) == 0) {
+      return special;
+    }
+  }
+
+  return NULL;
 }
 
-static void write_u16_be(uint8_t *data, uint16_t value) {
+static hll_form_kind get_form_kind(hll_compiler *compiler, hll_value symb) {
+  const hll_special_symb *special = find_special_symb(compiler, symb);
+  return special != NULL ? special->form : HLL_FORM_REGULAR;
+}
+
+// Looks up macro with given name. Macro may be NULL if only presence is
+// checked.
+static bool find_macro(hll_compiler *compiler, hll_value symb,
+                       hll_value *macro) {
+  hll_value *found = hll_hash_get(compiler->tu->vm->macros, symb);
+  if (found == NULL) {
+    return false;
+  }
+
+  if (macro != NULL) {
+    *macro = *found;
+  }
+  return true;
+}
+
+static void write_u32_be(uint8_t *data, uint32_t value) {
+  *data++ = (value >> 24) & 0xFF;
+  *data++ = (value >> 16) & 0xFF;
   *data++ = (value >> 8) & 0xFF;
   *data = value & 0xFF;
 }
 
-static uint16_t add_num_const(hll_compiler *compiler, double value) {
-  for (size_t i = 0; i < hll_sb_len(compiler->bytecode->constant_pool); ++i) {
-    hll_value test = compiler->bytecode->constant_pool[i];
-    if (hll_is_num(test) && hll_unwrap_num(test) == value) {
-      uint16_t narrowed = i;
-      assert(i == narrowed);
-      return narrowed;
+// Jumps are emitted in wide form, so their offsets can't overflow. Optimizer
+// shrinks ones that fit in short form.
+static size_t compile_jump(hll_compiler *compiler, hll_bytecode_op op) {
+  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_WIDE);
+  hll_bytecode_emit_op(compiler->bytecode, op);
+  return hll_bytecode_emit_u32(compiler->bytecode, 0);
+}
+
+// Makes jump with operand at given position go to the current position.
+static void patch_jump(hll_compiler *compiler, size_t jump) {
+  size_t offset = hll_bytecode_op_idx(compiler->bytecode) - jump - 4;
+  assert(offset <= INT32_MAX);
+  write_u32_be(compiler->bytecode->ops + jump, offset);
+}
+
+// Makes jumps with operands at given positions go to the current position and
+// frees their list.
+static void patch_jumps(hll_compiler *compiler, size_t *jumps) {
+  for (size_t i = 0; i < hll_sb_len(jumps); ++i) {
+    patch_jump(compiler, jumps[i]);
+  }
+  hll_sb_free(jumps);
+}
+
+// Makes jump with operand at given position go backward to instruction at
+// target position.
+static void patch_jump_back(hll_compiler *compiler, size_t jump,
+                            size_t target) {
+  size_t offset = jump + 4 - target;
+  assert(offset <= (size_t)INT32_MAX + 1);
+  write_u32_be(compiler->bytecode->ops + jump, (uint32_t)-(int64_t)offset);
+}
+
+// Emits jump backward to instruction at given position.
+static void compile_jump_back(hll_compiler *compiler, hll_bytecode_op op,
+                              size_t target) {
+  patch_jump_back(compiler, compile_jump(compiler, op), target);
+}
+
+// Returns slot of constant table that holds given constant, or empty slot
+// where it should be inserted. Symbols are looked up by name, which is given
+// instead of value.
+static uint32_t *find_const_slot(hll_compiler *compiler, hll_value value,
+                                 const char *symb, size_t length) {
+  hll_constant_table *table = &compiler->constants;
+  const hll_value *pool = compiler->bytecode->constant_pool;
+  uint64_t hash =
+      symb != NULL ? hll_symbol_hash(symb, length) : hll_hash_value(value);
+  size_t mask = table->capacity - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    uint32_t *slot = table->slots + i;
+    if (*slot == 0) {
+      return slot;
+    }
+
+    hll_value test = pool[*slot - 1];
+    if (symb == NULL ? test == value
+                     : hll_is_symb(test) &&
+                           hll_unwrap_symb(test)->length == length &&
+                           memcmp(hll_unwrap_zsymb(test), symb, length) == 0) {
+      return slot;
+    }
+  }
+}
+
+// Makes sure constant table has space for one more constant.
+static void reserve_const_slot(hll_compiler *compiler) {
+  hll_constant_table *table = &compiler->constants;
+  if ((table->count + 1) * 2 <= table->capacity) {
+    return;
+  }
+
+  uint32_t *old_slots = table->slots;
+  size_t old_capacity = table->capacity;
+  table->capacity = old_capacity != 0 ? old_capacity * 2 : 16;
+  table->slots = hll_alloc(table->capacity * sizeof(uint32_t));
+  for (size_t i = 0; i < old_capacity; ++i) {
+    if (old_slots[i] != 0) {
+      hll_value value = compiler->bytecode->constant_pool[old_slots[i] - 1];
+      *find_const_slot(compiler, value, NULL, 0) = old_slots[i];
     }
   }
+  if (old_capacity != 0) {
+    hll_free(old_slots, old_capacity * sizeof(uint32_t));
+  }
+}
 
-  hll_sb_push(compiler->bytecode->constant_pool, hll_num(value));
+// Appends constant to pool and records it in empty slot of constant table.
+static uint32_t push_const(hll_compiler *compiler, uint32_t *slot,
+                           hll_value value) {
+  hll_sb_push(compiler->bytecode->constant_pool, value);
   size_t result = hll_sb_len(compiler->bytecode->constant_pool) - 1;
-  uint16_t narrowed = result;
-  assert(result == narrowed);
+  uint32_t narrowed = result;
+  assert(result == narrowed && narrowed != UINT32_MAX);
+  *slot = narrowed + 1;
+  ++compiler->constants.count;
   return narrowed;
 }
 
-static uint16_t add_symb_const(hll_compiler *compiler, const char *symb_,
+static uint32_t add_num_const(hll_compiler *compiler, double value) {
+  reserve_const_slot(compiler);
+  // Numbers have single representation, so they can be compared bitwise.
+  // This also keeps 0 and -0 apart.
+  uint32_t *slot = find_const_slot(compiler, hll_num(value), NULL, 0);
+  if (*slot != 0) {
+    return *slot - 1;
+  }
+
+  return push_const(compiler, slot, hll_num(value));
+}
+
+static uint32_t add_symb_const(hll_compiler *compiler, const char *symb_,
                                size_t length) {
-  for (size_t i = 0; i < hll_sb_len(compiler->bytecode->constant_pool); ++i) {
-    hll_value test = compiler->bytecode->constant_pool[i];
-    if (hll_is_symb(test) && strcmp(hll_unwrap_zsymb(test), symb_) == 0) {
-      uint16_t narrowed = i;
-      assert(i == narrowed);
-      return narrowed;
-    }
+  reserve_const_slot(compiler);
+  uint32_t *slot = find_const_slot(compiler, hll_nil(), symb_, length);
+  if (*slot != 0) {
+    return *slot - 1;
   }
 
   hll_value symb = hll_new_symbol(compiler->tu->vm, symb_, length);
-  hll_sb_push(compiler->bytecode->constant_pool, symb);
-  size_t result = hll_sb_len(compiler->bytecode->constant_pool) - 1;
-  uint16_t narrowed = result;
-  assert(result == narrowed);
-  return narrowed;
+  return push_const(compiler, slot, symb);
+}
+
+// Adds self-evaluating object to constant pool. Objects are compared by
+// identity, so only the same object is deduplicated.
+static uint32_t add_obj_const(hll_compiler *compiler, hll_value value) {
+  reserve_const_slot(compiler);
+  uint32_t *slot = find_const_slot(compiler, value, NULL, 0);
+  if (*slot != 0) {
+    return *slot - 1;
+  }
+
+  return push_const(compiler, slot, value);
 }
 
 static void compile_symbol(hll_compiler *compiler, hll_value ast) {
   assert(hll_get_value_kind(ast) == HLL_VALUE_SYMB);
   hll_bytecode_emit_op(compiler->bytecode, HLL_BC_CONST);
-  hll_bytecode_emit_u16(compiler->bytecode,
-                        add_symb_const(compiler, hll_unwrap_zsymb(ast),
-                                       hll_unwrap_symb(ast)->length));
+  hll_bytecode_emit_varint(compiler->bytecode,
+                           add_symb_const(compiler, hll_unwrap_zsymb(ast),
+                                          hll_unwrap_symb(ast)->length));
+}
+
+static hll_symbol_entry *get_symbol_entry(hll_symbol_table *table,
+                                          hll_value symb, bool should_add) {
+  uint32_t hash = hll_unwrap_symb(symb)->hash;
+  size_t *slot = table->hash_table + (hash & (HLL_SYMBOL_TABLE_SIZE - 1));
+  for (size_t idx = *slot; idx != 0; idx = table->entries[idx - 1].next) {
+    if (table->entries[idx - 1].hash == hash) {
+      return table->entries + idx - 1;
+    }
+  }
+
+  if (!should_add) {
+    return NULL;
+  }
+  hll_symbol_entry entry = {.next = *slot, .hash = hash};
+  hll_sb_push(table->entries, entry);
+  *slot = hll_sb_len(table->entries);
+  return &hll_sb_last(table->entries);
+}
+
+static void mark_symbol(hll_compiler *compiler, hll_value symb,
+                        hll_symbol_flags flags) {
+  if (hll_is_symb(symb)) {
+    get_symbol_entry(compiler->tu->symbols, symb, true)->flags |= flags;
+  }
+}
+
+// Marks all symbols in expression as bound. This is used for code which
+// effect is not known before compilation.
+static void mark_all_symbols(hll_compiler *compiler, hll_value ast) {
+  for (; hll_is_cons(ast); ast = hll_unwrap_cdr(ast)) {
+    mark_all_symbols(compiler, hll_unwrap_car(ast));
+  }
+  mark_symbol(compiler, ast, HLL_SYMBOL_BOUND);
+}
+
+static void mark_params(hll_compiler *compiler, hll_value params) {
+  for (; hll_is_cons(params); params = hll_unwrap_cdr(params)) {
+    mark_symbol(compiler, hll_unwrap_car(params), HLL_SYMBOL_BOUND);
+  }
+  mark_symbol(compiler, params, HLL_SYMBOL_BOUND);
+}
+
+static void scan_form(hll_compiler *compiler, hll_value ast, bool is_toplevel);
+
+static void scan_forms(hll_compiler *compiler, hll_value list) {
+  for (; hll_is_cons(list); list = hll_unwrap_cdr(list)) {
+    scan_form(compiler, hll_unwrap_car(list), false);
+  }
+}
+
+// Macros are expanded during scan, because they may bind or assign
+// variables. Expansion replaces the call form with (progn expansion), so that
+// compiler does not expand it again and keeps its location.
+static void scan_macro_call(hll_compiler *compiler, hll_value ast,
+                            hll_value macro, bool is_toplevel) {
+  hll_vm *vm = compiler->tu->vm;
+  hll_value args = hll_unwrap_cdr(ast);
+  hll_handle_scope scope = hll_gc_open_scope(vm->gc);
+  hll_handle expanded = hll_gc_handle(vm->gc, hll_nil());
+  hll_value result;
+  if (hll_expand_macro(vm, macro, args, &result) != HLL_EXPAND_MACRO_OK) {
+    // Error is reported when form is compiled.
+    hll_gc_close_scope(vm->gc, scope);
+    mark_all_symbols(compiler, args);
+    return;
+  }
+  hll_gc_set(vm->gc, expanded, result);
+
+  hll_value progn = hll_new_symbolz(vm, "progn");
+  hll_unwrap_cons(ast)->car = progn;
+  hll_gc_write_barrier(vm->gc, ast);
+  hll_value body = hll_new_cons(vm, hll_gc_get(vm->gc, expanded), hll_nil());
+  hll_unwrap_cons(ast)->cdr = body;
+  hll_gc_write_barrier(vm->gc, ast);
+  hll_gc_close_scope(vm->gc, scope);
+
+  scan_form(compiler, hll_unwrap_car(body), is_toplevel);
+}
+
+static void scan_form(hll_compiler *compiler, hll_value ast, bool is_toplevel) {
+  if (!hll_is_cons(ast)) {
+    return;
+  }
+  hll_value head = hll_unwrap_car(ast);
+  hll_value args = hll_unwrap_cdr(ast);
+  if (!hll_is_symb(head)) {
+    scan_forms(compiler, ast);
+    return;
+  }
+
+  switch (get_form_kind(compiler, head)) {
+  case HLL_FORM_QUOTE:
+    break;
+  case HLL_FORM_DEFINE: {
+    if (!hll_is_cons(args)) {
+      break;
+    }
+    hll_value name = hll_unwrap_car(args);
+    if (hll_is_cons(name)) {
+      mark_params(compiler, hll_unwrap_cdr(name));
+      name = hll_unwrap_car(name);
+    }
+    if (hll_is_symb(name)) {
+      hll_symbol_entry *entry =
+          get_symbol_entry(compiler->tu->symbols, name, true);
+      if (is_toplevel) {
+        ++entry->define_count;
+      } else {
+        entry->flags |= HLL_SYMBOL_BOUND;
+      }
+    }
+    scan_forms(compiler, hll_unwrap_cdr(args));
+  } break;
+  case HLL_FORM_SET:
+    if (hll_is_cons(args)) {
+      hll_value location = hll_unwrap_car(args);
+      if (hll_is_cons(location)) {
+        // Location is not evaluated as a whole, so macros in it are not
+        // expanded.
+        scan_forms(compiler, hll_unwrap_cdr(location));
+      } else {
+        mark_symbol(compiler, location, HLL_SYMBOL_ASSIGNED);
+      }
+      scan_forms(compiler, hll_unwrap_cdr(args));
+    }
+    break;
+  case HLL_FORM_LET:
+    if (hll_is_cons(args)) {
+      for (hll_value let = hll_unwrap_car(args); hll_is_cons(let);
+           let = hll_unwrap_cdr(let)) {
+        hll_value pair = hll_unwrap_car(let);
+        if (hll_is_cons(pair)) {
+          mark_symbol(compiler, hll_unwrap_car(pair), HLL_SYMBOL_BOUND);
+          scan_forms(compiler, hll_unwrap_cdr(pair));
+        }
+      }
+      scan_forms(compiler, hll_unwrap_cdr(args));
+    }
+    break;
+  case HLL_FORM_LAMBDA:
+    if (hll_is_cons(args)) {
+      mark_params(compiler, hll_unwrap_car(args));
+      scan_forms(compiler, hll_unwrap_cdr(args));
+    }
+    break;
+  case HLL_FORM_DOTIMES:
+  case HLL_FORM_DOLIST:
+    if (hll_is_cons(args)) {
+      hll_value spec = hll_unwrap_car(args);
+      if (hll_is_cons(spec)) {
+        mark_symbol(compiler, hll_unwrap_car(spec), HLL_SYMBOL_BOUND);
+        scan_forms(compiler, hll_unwrap_cdr(spec));
+      }
+      scan_forms(compiler, hll_unwrap_cdr(args));
+    }
+    break;
+  case HLL_FORM_COND:
+    for (; hll_is_cons(args); args = hll_unwrap_cdr(args)) {
+      scan_forms(compiler, hll_unwrap_car(args));
+    }
+    break;
+  case HLL_FORM_CASE:
+    if (hll_is_cons(args)) {
+      scan_form(compiler, hll_unwrap_car(args), false);
+      // Keys of clauses are not evaluated.
+      for (args = hll_unwrap_cdr(args); hll_is_cons(args);
+           args = hll_unwrap_cdr(args)) {
+        hll_value clause = hll_unwrap_car(args);
+        if (hll_is_cons(clause)) {
+          scan_forms(compiler, hll_unwrap_cdr(clause));
+        }
+      }
+    }
+    break;
+  case HLL_FORM_DEFMACRO:
+    // Macro is defined only when it is compiled, so its expansions can't be
+    // scanned.
+    mark_all_symbols(compiler, args);
+    if (hll_is_cons(args) && hll_is_cons(hll_unwrap_car(args))) {
+      mark_symbol(compiler, hll_unwrap_car(hll_unwrap_car(args)),
+                  HLL_SYMBOL_MACRO);
+    }
+    break;
+  case HLL_FORM_REGULAR: {
+    hll_symbol_entry *entry =
+        get_symbol_entry(compiler->tu->symbols, head, false);
+    hll_value macro;
+    if (entry != NULL && (entry->flags & HLL_SYMBOL_MACRO)) {
+      mark_all_symbols(compiler, args);
+    } else if (find_macro(compiler, head, &macro)) {
+      scan_macro_call(compiler, ast, macro, is_toplevel);
+    } else {
+      scan_forms(compiler, args);
+    }
+  } break;
+  default:
+    // Other forms evaluate all their arguments.
+    scan_forms(compiler, args);
+    break;
+  }
+}
+
+// Builtins are looked up in global environment when they are not bound in
+// translation unit.
+static bool find_builtin(hll_compiler *compiler, hll_value symb,
+                         hll_value *bind) {
+  hll_symbol_entry *entry =
+      get_symbol_entry(compiler->tu->symbols, symb, false);
+  if (entry != NULL && (entry->flags != 0 || entry->define_count != 0)) {
+    return false;
+  }
+
+  hll_vm *vm = compiler->tu->vm;
+  hll_value found;
+  if (find_macro(compiler, symb, NULL) ||
+      !hll_find_var(vm->global_env, symb, &found) ||
+      hll_get_value_kind(hll_unwrap_cdr(found)) != HLL_VALUE_BIND) {
+    return false;
+  }
+  *bind = hll_unwrap_cdr(found);
+  return true;
+}
+
+extern bool hll_is_pure_builtin_call(hll_value bind, const hll_value *args,
+                                     size_t arg_count);
+
+// Returns slot of fold cache that holds given expression, or empty slot where
+// it should be inserted.
+static hll_fold_entry *find_fold_entry(hll_fold_cache *cache, hll_value ast) {
+  size_t mask = cache->capacity - 1;
+  for (size_t i = hll_hash_value(ast) & mask;; i = (i + 1) & mask) {
+    hll_fold_entry *entry = cache->entries + i;
+    if (entry->ast == 0 || entry->ast == ast) {
+      return entry;
+    }
+  }
+}
+
+// Returns cached fold result of expression, or NULL if it was not folded yet.
+static hll_fold_entry *get_folded(hll_compiler *compiler, hll_value ast) {
+  hll_fold_cache *cache = &compiler->fold_cache;
+  size_t collection_count = compiler->tu->vm->gc->collection_count;
+  if (cache->collection_count != collection_count) {
+    if (cache->count != 0) {
+      memset(cache->entries, 0, cache->capacity * sizeof(hll_fold_entry));
+      cache->count = 0;
+    }
+    cache->collection_count = collection_count;
+    return NULL;
+  }
+
+  if (cache->count == 0) {
+    return NULL;
+  }
+  hll_fold_entry *entry = find_fold_entry(cache, ast);
+  return entry->ast != 0 && entry->call_count == compiler->call_count ? entry
+                                                                      : NULL;
+}
+
+static void add_folded(hll_compiler *compiler, hll_value ast, bool is_folded,
+                       hll_value value) {
+  hll_fold_cache *cache = &compiler->fold_cache;
+  // Folding may have triggered collection, in which case entries added before
+  // it are stale.
+  get_folded(compiler, ast);
+  if ((cache->count + 1) * 2 > cache->capacity) {
+    hll_fold_entry *old_entries = cache->entries;
+    size_t old_capacity = cache->capacity;
+    cache->capacity = old_capacity != 0 ? old_capacity * 2 : 64;
+    cache->entries = hll_alloc(cache->capacity * sizeof(hll_fold_entry));
+    memset(cache->entries, 0, cache->capacity * sizeof(hll_fold_entry));
+    for (size_t i = 0; i < old_capacity; ++i) {
+      if (old_entries[i].ast != 0) {
+        *find_fold_entry(cache, old_entries[i].ast) = old_entries[i];
+      }
+    }
+    if (old_capacity != 0) {
+      hll_free(old_entries, old_capacity * sizeof(hll_fold_entry));
+    }
+  }
+
+  hll_fold_entry *entry = find_fold_entry(cache, ast);
+  if (entry->ast == 0) {
+    entry->ast = ast;
+    ++cache->count;
+  }
+  entry->value = value;
+  entry->is_folded = is_folded;
+  entry->call_count = compiler->call_count;
+}
+
+static bool fold_form(hll_compiler *compiler, hll_value ast,
+                      hll_value *result);
+
+// Evaluates expression at compile time if its value does not depend on
+// program state. Only numbers, nil and t are produced.
+// Values of variables and builtins are only known for top level code of
+// translation unit, which is run right after it is compiled, and only until
+// first call, which can assign them. Bodies of functions can be called after
+// following translation units redefine them.
+static bool fold_constant(hll_compiler *compiler, hll_value ast,
+                          hll_value *result) {
+  switch (hll_get_value_kind(ast)) {
+  case HLL_VALUE_NIL:
+  case HLL_VALUE_TRUE:
+  case HLL_VALUE_NUM:
+    *result = ast;
+    return true;
+  case HLL_VALUE_SYMB: {
+    hll_symbol_entry *entry =
+        get_symbol_entry(compiler->tu->symbols, ast, false);
+    if (!compiler->is_toplevel || entry == NULL ||
+        !(entry->flags & HLL_SYMBOL_CONSTANT) ||
+        entry->call_count != compiler->call_count) {
+      return false;
+    }
+    *result = entry->value;
+    return true;
+  }
+  case HLL_VALUE_CONS:
+    break;
+  default:
+    return false;
+  }
+
+  hll_fold_entry *entry = get_folded(compiler, ast);
+  if (entry != NULL) {
+    *result = entry->value;
+    return entry->is_folded;
+  }
+
+  hll_value value = hll_nil();
+  bool is_folded = fold_form(compiler, ast, &value);
+  add_folded(compiler, ast, is_folded, value);
+  *result = value;
+  return is_folded;
+}
+
+// Folds list form. Subexpressions are folded with fold_constant, so each
+// expression is folded once.
+static bool fold_form(hll_compiler *compiler, hll_value ast,
+                      hll_value *result) {
+  hll_value head = hll_unwrap_car(ast);
+  hll_value args = hll_unwrap_cdr(ast);
+  if (!hll_is_symb(head)) {
+    return false;
+  }
+
+  hll_form_kind kind = get_form_kind(compiler, head);
+  if (kind == HLL_FORM_IF) {
+    size_t length = hll_list_length(args);
+    hll_value cond;
+    if (length < 2 || length > 3 ||
+        !fold_constant(compiler, hll_unwrap_car(args), &cond)) {
+      return false;
+    }
+    args = hll_unwrap_cdr(args);
+    if (hll_is_nil(cond)) {
+      args = hll_unwrap_cdr(args);
+      if (hll_is_nil(args)) {
+        *result = hll_nil();
+        return true;
+      }
+    }
+    return fold_constant(compiler, hll_unwrap_car(args), result);
+  }
+
+  if (kind == HLL_FORM_NOT) {
+    hll_value value;
+    if (hll_list_length(args) != 1 ||
+        !fold_constant(compiler, hll_unwrap_car(args), &value)) {
+      return false;
+    }
+    *result = hll_is_nil(value) ? hll_true() : hll_nil();
+    return true;
+  }
+
+  if (kind == HLL_FORM_AND || kind == HLL_FORM_OR) {
+    // Arguments after the one that decides result are not evaluated, so they
+    // don't have to be constant.
+    bool is_and = kind == HLL_FORM_AND;
+    hll_value value = is_and ? hll_true() : hll_nil();
+    for (; hll_is_cons(args); args = hll_unwrap_cdr(args)) {
+      if (!fold_constant(compiler, hll_unwrap_car(args), &value)) {
+        return false;
+      }
+      if (hll_is_nil(value) == is_and) {
+        break;
+      }
+    }
+    if (!hll_is_list(args)) {
+      return false;
+    }
+    *result = value;
+    return true;
+  }
+
+  hll_value bind;
+  if (kind != HLL_FORM_REGULAR || !compiler->is_toplevel ||
+      compiler->call_count != 0 || !find_builtin(compiler, head, &bind)) {
+    return false;
+  }
+
+  hll_value *values = NULL;
+  bool is_folded = true;
+  for (; hll_is_cons(args); args = hll_unwrap_cdr(args)) {
+    hll_value value;
+    if (!fold_constant(compiler, hll_unwrap_car(args), &value)) {
+      is_folded = false;
+      break;
+    }
+    hll_sb_push(values, value);
+  }
+  size_t count = hll_sb_len(values);
+  if (is_folded && hll_is_nil(args) &&
+      hll_is_pure_builtin_call(bind, values, count)) {
+    // Arguments are not heap objects, so only list itself has to be rooted.
+    hll_vm *vm = compiler->tu->vm;
+    hll_handle_scope scope = hll_gc_open_scope(vm->gc);
+    hll_handle list = hll_gc_handle(vm->gc, hll_nil());
+    for (size_t i = count; i-- > 0;) {
+      hll_gc_set(vm->gc, list,
+                 hll_new_cons(vm, values[i], hll_gc_get(vm->gc, list)));
+    }
+    *result = hll_unwrap_bind(bind)->bind(vm, hll_gc_get(vm->gc, list));
+    hll_gc_close_scope(vm->gc, scope);
+  } else {
+    is_folded = false;
+  }
+  hll_sb_free(values);
+  return is_folded;
+}
+
+static void compile_constant(hll_compiler *compiler, hll_value value) {
+  switch (hll_get_value_kind(value)) {
+  case HLL_VALUE_NIL:
+    hll_bytecode_emit_op(compiler->bytecode, HLL_BC_NIL);
+    break;
+  case HLL_VALUE_TRUE:
+    hll_bytecode_emit_op(compiler->bytecode, HLL_BC_TRUE);
+    break;
+  case HLL_VALUE_NUM:
+    hll_bytecode_emit_op(compiler->bytecode, HLL_BC_CONST);
+    hll_bytecode_emit_varint(compiler->bytecode,
+                             add_num_const(compiler, hll_unwrap_num(value)));
+    break;
+  default:
+    HLL_UNREACHABLE;
+    break;
+  }
 }
 
 static void compile_expression(hll_compiler *compiler, hll_value ast);
@@ -844,6 +1601,7 @@ static void compile_function_call_internal(hll_compiler *compiler,
   hll_bytecode_emit_op(compiler->bytecode, HLL_BC_POP);
 
   hll_bytecode_emit_op(compiler->bytecode, HLL_BC_CALL);
+  ++compiler->call_count;
 }
 
 static bool expand_macro(hll_compiler *compiler, hll_value list,
@@ -855,10 +1613,8 @@ static bool expand_macro(hll_compiler *compiler, hll_value list,
   }
 
   hll_value macro_body;
-  if (!hll_find_var(compiler->tu->vm->macro_env, macro, &macro_body)) {
+  if (!find_macro(compiler, macro, &macro_body)) {
     return false;
-  } else {
-    macro_body = hll_unwrap_cdr(macro_body);
   }
 
   hll_expand_macro_result res =
@@ -871,14 +1627,115 @@ static bool expand_macro(hll_compiler *compiler, hll_value list,
   return true;
 }
 
+// Tells whether form is call to sequence function that can be fused with
+// call nested in its last argument. Transforms are functions that produce new
+// sequence and can themselves be nested.
+static bool is_fusable_seq_call(hll_compiler *compiler, hll_value form,
+                                bool is_transform) {
+  if (!hll_is_cons(form)) {
+    return false;
+  }
+
+  hll_value name = hll_unwrap_car(form);
+  const hll_special_symb *special = find_special_symb(compiler, name);
+  bool is_fusable = special != NULL && special->is_seq_fn &&
+                    (special->is_transform || !is_transform) &&
+                    hll_list_length(form) == 3;
+
+  // Macros with the same name would be expanded instead.
+  return is_fusable && !find_macro(compiler, name, NULL);
+}
+
+// Compiles chain of nested sequence function calls like
+// (reduce + (map f (filter p xs))) as call of vm->fused_bind with arguments
+// (reduce + map f filter p xs).
+// Arguments are evaluated in the same order as in original form. Whether
+// functions are the builtin ones is checked at runtime.
+static bool compile_fused_seq_call(hll_compiler *compiler, hll_value list) {
+  if (!is_fusable_seq_call(compiler, list, false)) {
+    return false;
+  }
+  hll_value inner = hll_unwrap_car(hll_unwrap_cdr(hll_unwrap_cdr(list)));
+  if (!is_fusable_seq_call(compiler, inner, true)) {
+    return false;
+  }
+
+  hll_value fused = compiler->tu->vm->fused_bind;
+  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_CONST);
+  hll_bytecode_emit_varint(compiler->bytecode, add_obj_const(compiler, fused));
+  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_NIL);
+  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_NIL);
+  hll_value form = list;
+  for (bool is_transform = false;
+       is_fusable_seq_call(compiler, form, is_transform); is_transform = true) {
+    hll_value op = hll_unwrap_car(form);
+    hll_value fn = hll_unwrap_car(hll_unwrap_cdr(form));
+    compile_eval_expression(compiler, op);
+    hll_bytecode_emit_op(compiler->bytecode, HLL_BC_APPEND);
+    compile_eval_expression(compiler, fn);
+    hll_bytecode_emit_op(compiler->bytecode, HLL_BC_APPEND);
+    form = hll_unwrap_car(hll_unwrap_cdr(hll_unwrap_cdr(form)));
+  }
+  compile_eval_expression(compiler, form);
+  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_APPEND);
+  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_POP);
+  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_CALL);
+  ++compiler->call_count;
+  return true;
+}
+
+// Calls to builtins evaluate arguments onto stack and call builtin by its
+// index in native table, without looking up its variable and consing
+// argument list in bytecode.
+static bool compile_native_call(hll_compiler *compiler, hll_value fn,
+                                hll_value args) {
+  hll_value bind;
+  size_t arg_count = hll_list_length(args);
+  if (!hll_is_symb(fn) || arg_count > UINT8_MAX ||
+      !find_builtin(compiler, fn, &bind)) {
+    return false;
+  }
+
+  hll_vm *vm = compiler->tu->vm;
+  hll_value *native_idx = hll_hash_get(vm->native_names, fn);
+  if (native_idx == NULL) {
+    return false;
+  }
+  const hll_native *native = vm->natives + hll_unwrap_int(*native_idx);
+  if (native->is_shadowed || native->bind != bind) {
+    return false;
+  }
+
+  for (; hll_is_cons(args); args = hll_unwrap_cdr(args)) {
+    compile_eval_expression(compiler, hll_unwrap_car(args));
+  }
+  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_CALLNATIVE);
+  hll_bytecode_emit_varint(compiler->bytecode,
+                           (uint32_t)hll_unwrap_int(*native_idx));
+  hll_bytecode_emit_u8(compiler->bytecode, (uint8_t)arg_count);
+  // Builtins like apply call functions passed to them.
+  ++compiler->call_count;
+  return true;
+}
+
 static void compile_function_call(hll_compiler *compiler, hll_value list) {
   hll_value expanded;
   if (expand_macro(compiler, list, &expanded)) {
+    hll_gc *gc = compiler->tu->vm->gc;
+    hll_handle_scope scope = hll_gc_open_scope(gc);
+    hll_gc_handle(gc, expanded);
     compile_eval_expression(compiler, expanded);
+    hll_gc_close_scope(gc, scope);
+    return;
+  }
+  if (compile_fused_seq_call(compiler, list)) {
     return;
   }
   hll_value fn = hll_unwrap_car(list);
   hll_value args = hll_unwrap_cdr(list);
+  if (compile_native_call(compiler, fn, args)) {
+    return;
+  }
   compile_eval_expression(compiler, fn);
   compile_function_call_internal(compiler, args);
 }
@@ -914,6 +1771,264 @@ static void compile_progn(hll_compiler *compiler, hll_value prog) {
   compile_progn_internal(compiler, hll_unwrap_cdr(prog));
 }
 
+// Compiles condition so that it jumps if value of condition is not nil and
+// jump_if_true is set, or if it is nil and jump_if_true is not set. Otherwise
+// execution continues after the condition. Value is not left on stack.
+// Operand positions of jumps are appended to list, so caller can patch them.
+// and, or and not are compiled to jumps only, without producing their value.
+static void compile_branch(hll_compiler *compiler, hll_value cond,
+                           bool jump_if_true, size_t **jumps) {
+  hll_value value;
+  if (fold_constant(compiler, cond, &value)) {
+    if (hll_is_nil(value) != jump_if_true) {
+      hll_sb_push(*jumps, compile_jump(compiler, HLL_BC_JMP));
+    }
+    return;
+  }
+
+  hll_form_kind kind = HLL_FORM_REGULAR;
+  if (hll_is_cons(cond) && hll_is_list(hll_unwrap_cdr(cond))) {
+    kind = get_form_kind(compiler, hll_unwrap_car(cond));
+  }
+  hll_value args = kind != HLL_FORM_REGULAR ? hll_unwrap_cdr(cond) : hll_nil();
+  if (kind == HLL_FORM_NOT && hll_list_length(args) == 1) {
+    bool pop = compiler_push_location(compiler, cond);
+    compile_branch(compiler, hll_unwrap_car(args), !jump_if_true, jumps);
+    compiler_pop_location(compiler, pop);
+  } else if (kind == HLL_FORM_AND || kind == HLL_FORM_OR) {
+    // Arguments of and jump out when they are nil, and arguments of or when
+    // they are not. If form jumps in the other case, all arguments but the
+    // last one skip over it instead.
+    bool is_and = kind == HLL_FORM_AND;
+    bool pop = compiler_push_location(compiler, cond);
+    size_t *skips = NULL;
+    if (hll_is_nil(args) && jump_if_true == is_and) {
+      hll_sb_push(*jumps, compile_jump(compiler, HLL_BC_JMP));
+    }
+    for (; hll_is_cons(args); args = hll_unwrap_cdr(args)) {
+      hll_value arg = hll_unwrap_car(args);
+      if (jump_if_true != is_and || hll_is_nil(hll_unwrap_cdr(args))) {
+        compile_branch(compiler, arg, jump_if_true, jumps);
+      } else {
+        compile_branch(compiler, arg, !is_and, &skips);
+      }
+    }
+    patch_jumps(compiler, skips);
+    compiler_pop_location(compiler, pop);
+  } else {
+    compile_eval_expression(compiler, cond);
+    hll_sb_push(*jumps,
+                compile_jump(compiler, jump_if_true ? HLL_BC_JT : HLL_BC_JN));
+  }
+}
+
+static void compile_and(hll_compiler *compiler, hll_value args) {
+  args = hll_unwrap_cdr(args);
+  if (hll_is_nil(args)) {
+    hll_bytecode_emit_op(compiler->bytecode, HLL_BC_TRUE);
+    return;
+  }
+
+  // Value of and is either value of its last argument, or nil if any of
+  // arguments is nil.
+  size_t *jumps_false = NULL;
+  for (; hll_is_cons(hll_unwrap_cdr(args)); args = hll_unwrap_cdr(args)) {
+    compile_branch(compiler, hll_unwrap_car(args), false, &jumps_false);
+  }
+  compile_eval_expression(compiler, hll_unwrap_car(args));
+  if (jumps_false != NULL) {
+    size_t jump_out = compile_jump(compiler, HLL_BC_JMP);
+    patch_jumps(compiler, jumps_false);
+    hll_bytecode_emit_op(compiler->bytecode, HLL_BC_NIL);
+    patch_jump(compiler, jump_out);
+  }
+}
+
+static void compile_or(hll_compiler *compiler, hll_value args) {
+  args = hll_unwrap_cdr(args);
+  if (hll_is_nil(args)) {
+    hll_bytecode_emit_op(compiler->bytecode, HLL_BC_NIL);
+    return;
+  }
+
+  // First argument that is not nil is kept on stack as value of or.
+  size_t *jumps_out = NULL;
+  for (; hll_is_cons(hll_unwrap_cdr(args)); args = hll_unwrap_cdr(args)) {
+    compile_eval_expression(compiler, hll_unwrap_car(args));
+    hll_sb_push(jumps_out, compile_jump(compiler, HLL_BC_JTK));
+  }
+  compile_eval_expression(compiler, hll_unwrap_car(args));
+  patch_jumps(compiler, jumps_out);
+}
+
+static void compile_not(hll_compiler *compiler, hll_value args) {
+  if (hll_list_length(args) != 2) {
+    compiler_error(compiler, args, "'not' form expects single argument");
+    return;
+  }
+
+  size_t *jumps_true = NULL;
+  compile_branch(compiler, hll_unwrap_car(hll_unwrap_cdr(args)), true,
+                 &jumps_true);
+  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_TRUE);
+  size_t jump_out = compile_jump(compiler, HLL_BC_JMP);
+  patch_jumps(compiler, jumps_true);
+  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_NIL);
+  patch_jump(compiler, jump_out);
+}
+
+// Compiles when, or unless if is_unless is set. Body is evaluated like progn
+// and value of form is nil if it is not.
+static void compile_when(hll_compiler *compiler, hll_value args,
+                         bool is_unless) {
+  if (hll_list_length(args) < 2) {
+    compiler_error(compiler, args, "'%s' form expects at least 1 argument",
+                   is_unless ? "unless" : "when");
+    return;
+  }
+  args = hll_unwrap_cdr(args);
+
+  size_t *jumps_skip = NULL;
+  compile_branch(compiler, hll_unwrap_car(args), is_unless, &jumps_skip);
+  compile_progn_internal(compiler, hll_unwrap_cdr(args));
+  size_t jump_out = compile_jump(compiler, HLL_BC_JMP);
+  patch_jumps(compiler, jumps_skip);
+  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_NIL);
+  patch_jump(compiler, jump_out);
+}
+
+// Clause of cond is (test body...). Value of cond is value of body of first
+// clause which test is not nil, or value of test if body is empty.
+static void compile_cond(hll_compiler *compiler, hll_value args) {
+  size_t *jumps_out = NULL;
+  for (args = hll_unwrap_cdr(args); hll_is_cons(args);
+       args = hll_unwrap_cdr(args)) {
+    hll_value clause = hll_unwrap_car(args);
+    if (!hll_is_cons(clause)) {
+      compiler_error(compiler, args, "'cond' clause must be a list");
+      break;
+    }
+
+    hll_value test = hll_unwrap_car(clause);
+    hll_value body = hll_unwrap_cdr(clause);
+    if (hll_is_nil(body)) {
+      compile_eval_expression(compiler, test);
+      hll_sb_push(jumps_out, compile_jump(compiler, HLL_BC_JTK));
+      continue;
+    }
+
+    size_t *jumps_next = NULL;
+    compile_branch(compiler, test, false, &jumps_next);
+    compile_progn_internal(compiler, body);
+    hll_sb_push(jumps_out, compile_jump(compiler, HLL_BC_JMP));
+    patch_jumps(compiler, jumps_next);
+  }
+  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_NIL);
+  patch_jumps(compiler, jumps_out);
+}
+
+// Adds key of case clause to switch table. Key of earlier clause takes
+// precedence.
+static void add_case_key(hll_compiler *compiler, hll_value table,
+                         size_t **clauses, hll_value clause, hll_value key,
+                         size_t clause_idx) {
+  if (!hll_is_num(key) && !hll_is_symb(key)) {
+    compiler_error(compiler, clause, "'case' keys must be numbers or symbols");
+  } else if (hll_hash_get(table, key) == NULL) {
+    hll_hash_set(compiler->tu->vm, table, key, hll_num(hll_sb_len(*clauses)));
+    hll_sb_push(*clauses, clause_idx);
+  }
+}
+
+// Clause of case is (keys body...), where keys is either list of keys or
+// single key, and t makes default clause. Keys are numbers and symbols, and
+// are not evaluated. Case is compiled to SWITCH, which maps key to entry of
+// jump table that follows it. Each key gets its own entry, and the last entry
+// is the default one.
+static void compile_case(hll_compiler *compiler, hll_value args) {
+  if (hll_list_length(args) < 2) {
+    compiler_error(compiler, args, "'case' form expects at least 1 argument");
+    return;
+  }
+  args = hll_unwrap_cdr(args);
+
+  compile_eval_expression(compiler, hll_unwrap_car(args));
+  hll_vm *vm = compiler->tu->vm;
+  hll_handle_scope scope = hll_gc_open_scope(vm->gc);
+  hll_value table = hll_new_hash(vm);
+  hll_gc_handle(vm->gc, table);
+  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_SWITCH);
+  hll_bytecode_emit_varint(compiler->bytecode, add_obj_const(compiler, table));
+
+  // Index of clause for each entry of jump table except the default one.
+  size_t *clauses = NULL;
+  bool has_default = false;
+  size_t default_idx = 0;
+  size_t clause_idx = 0;
+  for (hll_value obj = hll_unwrap_cdr(args); hll_is_cons(obj);
+       obj = hll_unwrap_cdr(obj), ++clause_idx) {
+    hll_value clause = hll_unwrap_car(obj);
+    if (!hll_is_cons(clause)) {
+      compiler_error(compiler, obj, "'case' clause must be a list");
+      continue;
+    }
+
+    hll_value keys = hll_unwrap_car(clause);
+    if (hll_get_value_kind(keys) == HLL_VALUE_TRUE) {
+      if (!has_default) {
+        has_default = true;
+        default_idx = clause_idx;
+      }
+    } else if (!hll_is_list(keys)) {
+      add_case_key(compiler, table, &clauses, clause, keys, clause_idx);
+    } else {
+      for (; hll_is_cons(keys); keys = hll_unwrap_cdr(keys)) {
+        add_case_key(compiler, table, &clauses, clause, hll_unwrap_car(keys),
+                     clause_idx);
+      }
+    }
+  }
+
+  size_t entry_count = hll_sb_len(clauses);
+  size_t *entries = NULL;
+  for (size_t i = 0; i <= entry_count; ++i) {
+    hll_sb_push(entries, compile_jump(compiler, HLL_BC_JMP));
+  }
+
+  // Clauses that can't be selected are not compiled.
+  size_t *jumps_out = NULL;
+  clause_idx = 0;
+  for (hll_value obj = hll_unwrap_cdr(args); hll_is_cons(obj);
+       obj = hll_unwrap_cdr(obj), ++clause_idx) {
+    bool is_default = has_default && clause_idx == default_idx;
+    bool is_used = is_default;
+    for (size_t i = 0; i < entry_count; ++i) {
+      if (clauses[i] == clause_idx) {
+        patch_jump(compiler, entries[i]);
+        is_used = true;
+      }
+    }
+    if (!is_used) {
+      continue;
+    }
+
+    if (is_default) {
+      patch_jump(compiler, entries[entry_count]);
+    }
+    compile_progn_internal(compiler, hll_unwrap_cdr(hll_unwrap_car(obj)));
+    hll_sb_push(jumps_out, compile_jump(compiler, HLL_BC_JMP));
+  }
+  if (!has_default) {
+    patch_jump(compiler, entries[entry_count]);
+    hll_bytecode_emit_op(compiler->bytecode, HLL_BC_NIL);
+  }
+  patch_jumps(compiler, jumps_out);
+
+  hll_sb_free(entries);
+  hll_sb_free(clauses);
+  hll_gc_close_scope(vm->gc, scope);
+}
+
 static void compile_if(hll_compiler *compiler, hll_value args) {
   if (hll_list_length(args) < 3) {
     compiler_error(compiler, args, "'if' form expects at least 2 arguments");
@@ -922,23 +2037,29 @@ static void compile_if(hll_compiler *compiler, hll_value args) {
   args = hll_unwrap_cdr(args);
 
   hll_value cond = hll_unwrap_car(args);
-  compile_eval_expression(compiler, cond);
   hll_value pos_arm = hll_unwrap_cdr(args);
   assert(hll_is_cons(pos_arm));
   hll_value neg_arm = hll_unwrap_cdr(pos_arm);
   pos_arm = hll_unwrap_car(pos_arm);
 
-  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_JN);
-  size_t jump_false = hll_bytecode_emit_u16(compiler->bytecode, 0);
+  // Arm that is never taken is not compiled.
+  hll_value cond_value;
+  if (fold_constant(compiler, cond, &cond_value)) {
+    if (hll_is_nil(cond_value)) {
+      compile_progn_internal(compiler, neg_arm);
+    } else {
+      compile_eval_expression(compiler, pos_arm);
+    }
+    return;
+  }
+
+  size_t *jumps_false = NULL;
+  compile_branch(compiler, cond, false, &jumps_false);
   compile_eval_expression(compiler, pos_arm);
-  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_NIL);
-  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_JN);
-  size_t jump_out = hll_bytecode_emit_u16(compiler->bytecode, 0);
-  write_u16_be(compiler->bytecode->ops + jump_false,
-               hll_bytecode_op_idx(compiler->bytecode) - jump_false - 2);
+  size_t jump_out = compile_jump(compiler, HLL_BC_JMP);
+  patch_jumps(compiler, jumps_false);
   compile_progn_internal(compiler, neg_arm);
-  write_u16_be(compiler->bytecode->ops + jump_out,
-               hll_bytecode_op_idx(compiler->bytecode) - jump_out - 2);
+  patch_jump(compiler, jump_out);
 }
 
 static void compile_let(hll_compiler *compiler, hll_value args) {
@@ -976,6 +2097,97 @@ static void compile_let(hll_compiler *compiler, hll_value args) {
   hll_bytecode_emit_op(compiler->bytecode, HLL_BC_POPENV);
 }
 
+// Compiles loop body. Values of body expressions are discarded.
+static void compile_loop_body(hll_compiler *compiler, hll_value body) {
+  for (; hll_is_cons(body); body = hll_unwrap_cdr(body)) {
+    compile_eval_expression(compiler, hll_unwrap_car(body));
+    hll_bytecode_emit_op(compiler->bytecode, HLL_BC_POP);
+  }
+}
+
+// Loops are compiled to jumps inside current function, so iterations don't
+// create call frames. Loop variables are bound once and updated in place.
+static void compile_while(hll_compiler *compiler, hll_value args) {
+  if (hll_list_length(args) < 2) {
+    compiler_error(compiler, args, "'while' form expects at least 1 argument");
+    return;
+  }
+  args = hll_unwrap_cdr(args);
+
+  ++compiler->call_count;
+  // Condition is placed after the body, so that each iteration takes single
+  // jump.
+  size_t jump_cond = compile_jump(compiler, HLL_BC_JMP);
+  size_t loop_start = hll_bytecode_op_idx(compiler->bytecode);
+  compile_loop_body(compiler, hll_unwrap_cdr(args));
+  patch_jump(compiler, jump_cond);
+  size_t *jumps_loop = NULL;
+  compile_branch(compiler, hll_unwrap_car(args), true, &jumps_loop);
+  for (size_t i = 0; i < hll_sb_len(jumps_loop); ++i) {
+    patch_jump_back(compiler, jumps_loop[i], loop_start);
+  }
+  hll_sb_free(jumps_loop);
+  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_NIL);
+}
+
+// Compiles dotimes and dolist. Both have form (name (var init [result])
+// body...). Stepping instruction keeps its state and variable storage cons on
+// stack, and pops them when loop is finished.
+static void compile_iteration(hll_compiler *compiler, hll_value args,
+                              const char *name, hll_bytecode_op step_op) {
+  if (hll_list_length(args) < 2) {
+    compiler_error(compiler, args,
+                   "'%s' form expects variable specification", name);
+    return;
+  }
+  args = hll_unwrap_cdr(args);
+
+  hll_value spec = hll_unwrap_car(args);
+  size_t spec_length = hll_list_length(spec);
+  if (!hll_is_cons(spec) || (spec_length != 2 && spec_length != 3) ||
+      !hll_is_symb(hll_unwrap_car(spec))) {
+    compiler_error(compiler, args,
+                   "'%s' variable specification must be (var %s [result])",
+                   name, step_op == HLL_BC_DOTIMES ? "count" : "list");
+    return;
+  }
+  hll_value var = hll_unwrap_car(spec);
+  hll_value init = hll_unwrap_car(hll_unwrap_cdr(spec));
+  hll_value result = hll_unwrap_cdr(hll_unwrap_cdr(spec));
+
+  compile_eval_expression(compiler, init);
+  if (step_op == HLL_BC_DOLIST) {
+    // Index of range item.
+    hll_bytecode_emit_op(compiler->bytecode, HLL_BC_CONST);
+    hll_bytecode_emit_varint(compiler->bytecode, add_num_const(compiler, 0));
+  }
+  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_PUSHENV);
+  compile_symbol(compiler, var);
+  if (step_op == HLL_BC_DOTIMES) {
+    // Counter is incremented before each iteration, including first one.
+    hll_bytecode_emit_op(compiler->bytecode, HLL_BC_CONST);
+    hll_bytecode_emit_varint(compiler->bytecode, add_num_const(compiler, -1));
+  } else {
+    hll_bytecode_emit_op(compiler->bytecode, HLL_BC_NIL);
+  }
+  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_LET);
+  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_FIND);
+
+  ++compiler->call_count;
+  size_t loop_start = hll_bytecode_op_idx(compiler->bytecode);
+  size_t jump_out = compile_jump(compiler, step_op);
+  compile_loop_body(compiler, hll_unwrap_cdr(args));
+  compile_jump_back(compiler, HLL_BC_JMP, loop_start);
+  patch_jump(compiler, jump_out);
+
+  if (hll_is_cons(result)) {
+    compile_eval_expression(compiler, hll_unwrap_car(result));
+  } else {
+    hll_bytecode_emit_op(compiler->bytecode, HLL_BC_NIL);
+  }
+  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_POPENV);
+}
+
 #define HLL_CAR_CDR(_lower, _)                                                 \
   static void compile_c##_lower##r(hll_compiler *compiler, hll_value args) {   \
     if (hll_list_length(args) != 2) {                                          \
@@ -1004,25 +2216,16 @@ static void compile_let(hll_compiler *compiler, hll_value args) {
 HLL_ENUMERATE_CAR_CDR
 #undef HLL_CAR_CDR
 
-static hll_location_form get_location_form(hll_value location) {
+static hll_location_form get_location_form(hll_compiler *compiler,
+                                           hll_value location) {
   hll_location_form kind = HLL_LOC_NONE;
   if (hll_get_value_kind(location) == HLL_VALUE_SYMB) {
     kind = HLL_LOC_FORM_SYMB;
   } else if (hll_is_cons(location)) {
-    hll_value first = hll_unwrap_car(location);
-    if (hll_get_value_kind(first) == HLL_VALUE_SYMB) {
-      const char *symb = hll_unwrap_zsymb(first);
-      if (strcmp(symb, "nth") == 0) {
-        kind = HLL_LOC_FORM_NTH;
-      } else if (strcmp(symb, "nthcdr") == 0) {
-        kind = HLL_LOC_FORM_NTHCDR;
-      }
-#define HLL_CAR_CDR(_lower, _upper)                                            \
-  else if (strcmp(symb, "c" #_lower "r") == 0) {                               \
-    kind = HLL_LOC_FORM_C##_upper##R;                                          \
-  }
-      HLL_ENUMERATE_CAR_CDR
-#undef HLL_CAR_CDR
+    const hll_special_symb *special =
+        find_special_symb(compiler, hll_unwrap_car(location));
+    if (special != NULL) {
+      kind = special->location;
     }
   }
 
@@ -1031,7 +2234,7 @@ static hll_location_form get_location_form(hll_value location) {
 
 static void compile_set_location(hll_compiler *compiler, hll_value location,
                                  hll_value value, hll_value reporter) {
-  hll_location_form kind = get_location_form(location);
+  hll_location_form kind = get_location_form(compiler, location);
   switch (kind) {
   case HLL_LOC_NONE:
     compiler_error(compiler, reporter, "location is not valid");
@@ -1049,7 +2252,10 @@ static void compile_set_location(hll_compiler *compiler, hll_value location,
       break;
     }
     // get the nth function
-    compile_symbol(compiler, hll_new_symbolz(compiler->tu->vm, "nthcdr"));
+    hll_bytecode_emit_op(compiler->bytecode, HLL_BC_CONST);
+    hll_bytecode_emit_varint(
+        compiler->bytecode,
+        add_symb_const(compiler, "nthcdr", strlen("nthcdr")));
     hll_bytecode_emit_op(compiler->bytecode, HLL_BC_FIND);
     hll_bytecode_emit_op(compiler->bytecode, HLL_BC_CDR);
     // call nth
@@ -1063,7 +2269,10 @@ static void compile_set_location(hll_compiler *compiler, hll_value location,
       break;
     }
     // get the nth function
-    compile_symbol(compiler, hll_new_symbolz(compiler->tu->vm, "nthcdr"));
+    hll_bytecode_emit_op(compiler->bytecode, HLL_BC_CONST);
+    hll_bytecode_emit_varint(
+        compiler->bytecode,
+        add_symb_const(compiler, "nthcdr", strlen("nthcdr")));
     hll_bytecode_emit_op(compiler->bytecode, HLL_BC_FIND);
     hll_bytecode_emit_op(compiler->bytecode, HLL_BC_CDR);
     // call nth
@@ -1071,6 +2280,18 @@ static void compile_set_location(hll_compiler *compiler, hll_value location,
     compile_eval_expression(compiler, value);
     hll_bytecode_emit_op(compiler->bytecode, HLL_BC_SETCAR);
   } break;
+  case HLL_LOC_FORM_VREF:
+    if (hll_list_length(location) != 3) {
+      compiler_error(compiler, reporter,
+                     "'vector-ref' expects exactly 2 arguments");
+      break;
+    }
+    location = hll_unwrap_cdr(location);
+    compile_eval_expression(compiler, hll_unwrap_car(location));
+    compile_eval_expression(compiler, hll_unwrap_car(hll_unwrap_cdr(location)));
+    compile_eval_expression(compiler, value);
+    hll_bytecode_emit_op(compiler->bytecode, HLL_BC_VSET);
+    break;
 #define HLL_CAR_CDR(_lower, _upper)                                            \
   case HLL_LOC_FORM_C##_upper##R: {                                            \
     if (hll_list_length(location) != 2) {                                      \
@@ -1187,22 +2408,47 @@ static void compile_cons(hll_compiler *compiler, hll_value args) {
 
   hll_value car = hll_unwrap_car(args);
   hll_value cdr = hll_unwrap_car(hll_unwrap_cdr(args));
-  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_NIL);
-  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_NIL);
   compile_eval_expression(compiler, car);
-  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_APPEND);
   compile_eval_expression(compiler, cdr);
-  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_SETCDR);
-  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_POP);
+  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_CONS);
+}
+
+static void compile_vector_ref(hll_compiler *compiler, hll_value args) {
+  if (hll_list_length(args) != 3) {
+    compiler_error(compiler, args, "'vector-ref' expects exactly 2 arguments");
+    return;
+  }
+  args = hll_unwrap_cdr(args);
+
+  compile_eval_expression(compiler, hll_unwrap_car(args));
+  compile_eval_expression(compiler, hll_unwrap_car(hll_unwrap_cdr(args)));
+  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_VREF);
 }
 
+static void compile_vector_set(hll_compiler *compiler, hll_value args) {
+  if (hll_list_length(args) != 4) {
+    compiler_error(compiler, args,
+                   "'vector-set!' expects exactly 3 arguments");
+    return;
+  }
+  args = hll_unwrap_cdr(args);
+
+  compile_eval_expression(compiler, hll_unwrap_car(args));
+  args = hll_unwrap_cdr(args);
+  compile_eval_expression(compiler, hll_unwrap_car(args));
+  compile_eval_expression(compiler, hll_unwrap_car(hll_unwrap_cdr(args)));
+  hll_bytecode_emit_op(compiler->bytecode, HLL_BC_VSET);
+}
+
+// Appends symbol to param list. Param list is stored directly in function
+// object so it is reachable by garbage collector while being built.
 static void add_symbol_to_function_param_list(hll_compiler *compiler,
                                               hll_value car,
                                               hll_value *param_list,
                                               hll_value *param_list_tail) {
   hll_value symb = car;
   if (!hll_is_nil(car)) {
-    uint16_t symb_idx = add_symb_const(compiler, hll_unwrap_zsymb(car),
+    uint32_t symb_idx = add_symb_const(compiler, hll_unwrap_zsymb(car),
                                        hll_unwrap_symb(car)->length);
     symb = compiler->bytecode->constant_pool[symb_idx];
   }
@@ -1222,55 +2468,62 @@ static bool compile_function_internal(hll_compiler *compiler, hll_value params,
   hll_compiler new_compiler = {0};
   hll_compiler_init(&new_compiler, compiler->tu, name);
   hll_value compiled = hll_compile_ast(&new_compiler, body);
-  hll_sb_free(new_compiler.loc_stack);
   if (new_compiler.error_count != 0) {
     compiler->error_count += new_compiler.error_count;
+    hll_compiler_free(&new_compiler);
     return false;
   }
 
-  hll_value param_list = hll_nil();
+  hll_gc *gc = compiler->tu->vm->gc;
+  hll_handle_scope scope = hll_gc_open_scope(gc);
+  hll_gc_handle(gc, compiled);
+  bool result = true;
+  hll_value *param_list = &hll_unwrap_func(compiled)->param_names;
   hll_value param_list_tail = hll_nil();
   if (hll_is_symb(params)) {
-    add_symbol_to_function_param_list(&new_compiler, hll_nil(), &param_list,
+    add_symbol_to_function_param_list(&new_compiler, hll_nil(), param_list,
                                       &param_list_tail);
-    add_symbol_to_function_param_list(&new_compiler, params, &param_list,
+    add_symbol_to_function_param_list(&new_compiler, params, param_list,
                                       &param_list_tail);
+  } else if (!hll_is_list(params)) {
+    compiler_error(compiler, report, "param list must be a list");
+    result = false;
   } else {
-    if (!hll_is_list(params)) {
-      compiler_error(compiler, report, "param list must be a list");
-      return false;
-    }
-
     hll_value obj = params;
     for (; hll_is_cons(obj); obj = hll_unwrap_cdr(obj)) {
       hll_value car = hll_unwrap_car(obj);
       if (!hll_is_symb(car)) {
         compiler_error(compiler, report, "function param name is not a symbol");
-        return false;
+        result = false;
+        break;
       }
 
-      add_symbol_to_function_param_list(&new_compiler, car, &param_list,
+      add_symbol_to_function_param_list(&new_compiler, car, param_list,
                                         &param_list_tail);
     }
 
-    if (!hll_is_nil(obj)) {
+    if (result && !hll_is_nil(obj)) {
       if (!hll_is_symb(obj)) {
         compiler_error(compiler, report, "function param name is not a symbol");
-        return false;
+        result = false;
+      } else {
+        assert(hll_is_cons(param_list_tail));
+        hll_unwrap_cons(param_list_tail)->cdr = (hll_value)obj;
       }
-      assert(hll_is_cons(param_list_tail));
-      hll_unwrap_cons(param_list_tail)->cdr = (hll_value)obj;
     }
   }
 
-  hll_unwrap_func(compiled)->param_names = param_list;
+  // Param names are added to constant pool of function, so compiler is
+  // freed only after they are.
+  hll_compiler_free(&new_compiler);
+  hll_gc_close_scope(gc, scope);
   *compiled_ = compiled;
-  return true;
+  return result;
 }
 
 static bool compile_function(hll_compiler *compiler, hll_value params,
                              hll_value reporter, hll_value body, hll_value name,
-                             uint16_t *idx) {
+                             uint32_t *idx) {
   hll_value func;
   if (!compile_function_internal(compiler, params, reporter, body, name,
                                  &func)) {
@@ -1279,7 +2532,7 @@ static bool compile_function(hll_compiler *compiler, hll_value params,
 
   hll_sb_push(compiler->bytecode->constant_pool, func);
   size_t result = hll_sb_len(compiler->bytecode->constant_pool) - 1;
-  uint16_t narrowed = result;
+  uint32_t narrowed = result;
   assert(result == narrowed);
   *idx = narrowed;
 
@@ -1296,14 +2549,14 @@ static void compile_lambda(hll_compiler *compiler, hll_value args) {
   args = hll_unwrap_cdr(hll_unwrap_cdr(args));
   hll_value body = args;
 
-  uint16_t function_idx;
+  uint32_t function_idx;
   if (compile_function(compiler, params, args, body, hll_nil(),
                        &function_idx)) {
     return;
   }
 
   hll_bytecode_emit_op(compiler->bytecode, HLL_BC_MAKEFUN);
-  hll_bytecode_emit_u16(compiler->bytecode, function_idx);
+  hll_bytecode_emit_varint(compiler->bytecode, function_idx);
 }
 
 static void process_defmacro(hll_compiler *compiler, hll_value args) {
@@ -1333,13 +2586,13 @@ static void process_defmacro(hll_compiler *compiler, hll_value args) {
   hll_value macro_expansion;
   if (compile_function_internal(compiler, params, args, body, name,
                                 &macro_expansion)) {
-    if (hll_find_var(compiler->tu->vm->macro_env, name, NULL)) {
+    if (find_macro(compiler, name, NULL)) {
       compiler_error(compiler, args, "Macro with same name already exists (%s)",
                      hll_unwrap_zsymb(name));
       return;
     }
-    hll_add_variable(compiler->tu->vm, compiler->tu->vm->macro_env, name,
-                     macro_expansion);
+    hll_hash_set(compiler->tu->vm, compiler->tu->vm->macros, name,
+                 macro_expansion);
   }
 }
 
@@ -1364,13 +2617,13 @@ static void compile_define(hll_compiler *compiler, hll_value args) {
 
     compile_expression(compiler, name);
 
-    uint16_t function_idx;
+    uint32_t function_idx;
     if (compile_function(compiler, params, args, body, name, &function_idx)) {
       return;
     }
 
     hll_bytecode_emit_op(compiler->bytecode, HLL_BC_MAKEFUN);
-    hll_bytecode_emit_u16(compiler->bytecode, function_idx);
+    hll_bytecode_emit_varint(compiler->bytecode, function_idx);
     hll_bytecode_emit_op(compiler->bytecode, HLL_BC_LET);
   } else if (hll_get_value_kind(decide) == HLL_VALUE_SYMB) {
     if (hll_list_length(args) > 3) {
@@ -1387,6 +2640,20 @@ static void compile_define(hll_compiler *compiler, hll_value args) {
     compile_expression(compiler, decide);
     compile_eval_expression(compiler, value);
     hll_bytecode_emit_op(compiler->bytecode, HLL_BC_LET);
+
+    // Numeric top level variable that is defined once and never assigned
+    // keeps its value, so the following uses of it in top level code of
+    // translation unit are replaced with value.
+    hll_symbol_entry *entry =
+        get_symbol_entry(compiler->tu->symbols, decide, false);
+    hll_value constant;
+    if (compiler->toplevel_form == args && entry != NULL &&
+        entry->flags == 0 && entry->define_count == 1 &&
+        fold_constant(compiler, value, &constant) && hll_is_num(constant)) {
+      entry->flags |= HLL_SYMBOL_CONSTANT;
+      entry->value = constant;
+      entry->call_count = compiler->call_count;
+    }
   } else {
     compiler_error(compiler, args,
                    "'define' first argument must either be a function name and "
@@ -1443,6 +2710,42 @@ static void compile_form(hll_compiler *compiler, hll_value args,
   case HLL_FORM_DEFMACRO:
     process_defmacro(compiler, args);
     break;
+  case HLL_FORM_VREF:
+    compile_vector_ref(compiler, args);
+    break;
+  case HLL_FORM_VSET:
+    compile_vector_set(compiler, args);
+    break;
+  case HLL_FORM_WHILE:
+    compile_while(compiler, args);
+    break;
+  case HLL_FORM_DOTIMES:
+    compile_iteration(compiler, args, "dotimes", HLL_BC_DOTIMES);
+    break;
+  case HLL_FORM_DOLIST:
+    compile_iteration(compiler, args, "dolist", HLL_BC_DOLIST);
+    break;
+  case HLL_FORM_AND:
+    compile_and(compiler, args);
+    break;
+  case HLL_FORM_OR:
+    compile_or(compiler, args);
+    break;
+  case HLL_FORM_NOT:
+    compile_not(compiler, args);
+    break;
+  case HLL_FORM_WHEN:
+    compile_when(compiler, args, false);
+    break;
+  case HLL_FORM_UNLESS:
+    compile_when(compiler, args, true);
+    break;
+  case HLL_FORM_COND:
+    compile_cond(compiler, args);
+    break;
+  case HLL_FORM_CASE:
+    compile_case(compiler, args);
+    break;
   default:
     HLL_UNREACHABLE;
     break;
@@ -1459,27 +2762,38 @@ static void compile_eval_expression(hll_compiler *compiler, hll_value ast) {
     break;
   case HLL_VALUE_NUM:
     hll_bytecode_emit_op(compiler->bytecode, HLL_BC_CONST);
-    hll_bytecode_emit_u16(compiler->bytecode,
-                          add_num_const(compiler, hll_unwrap_num(ast)));
+    hll_bytecode_emit_varint(compiler->bytecode,
+                             add_num_const(compiler, hll_unwrap_num(ast)));
     break;
   case HLL_VALUE_CONS: {
+    hll_value value;
+    if (fold_constant(compiler, ast, &value)) {
+      compile_constant(compiler, value);
+      break;
+    }
+
     bool pop = compiler_push_location(compiler, ast);
     hll_value fn = hll_unwrap_car(ast);
-    hll_form_kind kind = HLL_FORM_REGULAR;
-    if (hll_is_symb(fn)) {
-      kind = get_form_kind(hll_unwrap_zsymb(fn));
-    }
+    hll_form_kind kind = get_form_kind(compiler, fn);
 
     compile_form(compiler, ast, kind);
     compiler_pop_location(compiler, pop);
   } break;
-  case HLL_VALUE_SYMB:
+  case HLL_VALUE_SYMB: {
+    hll_value value;
+    if (fold_constant(compiler, ast, &value)) {
+      compile_constant(compiler, value);
+      break;
+    }
+
     compile_symbol(compiler, ast);
     hll_bytecode_emit_op(compiler->bytecode, HLL_BC_FIND);
     hll_bytecode_emit_op(compiler->bytecode, HLL_BC_CDR);
-    break;
+  } break;
   default:
-    HLL_UNREACHABLE;
+    // Other objects, like strings, evaluate to themselves.
+    hll_bytecode_emit_op(compiler->bytecode, HLL_BC_CONST);
+    hll_bytecode_emit_varint(compiler->bytecode, add_obj_const(compiler, ast));
     break;
   }
 }
@@ -1497,8 +2811,8 @@ static void compile_expression(hll_compiler *compiler, hll_value ast) {
     break;
   case HLL_VALUE_NUM:
     hll_bytecode_emit_op(compiler->bytecode, HLL_BC_CONST);
-    hll_bytecode_emit_u16(compiler->bytecode,
-                          add_num_const(compiler, hll_unwrap_num(ast)));
+    hll_bytecode_emit_varint(compiler->bytecode,
+                             add_num_const(compiler, hll_unwrap_num(ast)));
     break;
   case HLL_VALUE_CONS: {
     hll_bytecode_emit_op(compiler->bytecode, HLL_BC_NIL);
@@ -1527,21 +2841,36 @@ static void compile_expression(hll_compiler *compiler, hll_value ast) {
     compile_symbol(compiler, ast);
     break;
   default:
-    HLL_UNREACHABLE;
+    hll_bytecode_emit_op(compiler->bytecode, HLL_BC_CONST);
+    hll_bytecode_emit_varint(compiler->bytecode, add_obj_const(compiler, ast));
     break;
   }
 }
 
 hll_value hll_compile_ast(hll_compiler *compiler, hll_value ast) {
+  hll_gc *gc = compiler->tu->vm->gc;
+  hll_handle_scope scope = hll_gc_open_scope(gc);
+  hll_gc_handle(gc, ast);
+  // Constants of bytecode being built are reachable only through this
+  // function object.
   hll_value result =
       hll_new_func(compiler->tu->vm, hll_nil(), compiler->bytecode);
+  hll_gc_handle(gc, result);
   if (hll_is_nil(ast)) {
     hll_bytecode_emit_op(compiler->bytecode, HLL_BC_NIL);
   } else {
     bool pop_ = compiler_push_location(compiler, ast);
     assert(pop_);
+    if (compiler->is_toplevel) {
+      for (hll_value obj = ast; hll_is_cons(obj); obj = hll_unwrap_cdr(obj)) {
+        scan_form(compiler, hll_unwrap_car(obj), true);
+      }
+    }
     for (; hll_is_cons(ast); ast = hll_unwrap_cdr(ast)) {
       hll_value expr = hll_unwrap_car(ast);
+      if (compiler->is_toplevel) {
+        compiler->toplevel_form = expr;
+      }
       bool pop = compiler_push_location(compiler, expr);
       compile_eval_expression(compiler, expr);
       if (!hll_is_nil(hll_unwrap_cdr(ast))) {
@@ -1554,5 +2883,6 @@ hll_value hll_compile_ast(hll_compiler *compiler, hll_value ast) {
   hll_bytecode_emit_op(compiler->bytecode, HLL_BC_END);
   hll_optimize_bytecode(compiler->bytecode);
   assert(hll_sb_len(compiler->loc_stack) == 0);
+  hll_gc_close_scope(gc, scope);
   return result;
 }
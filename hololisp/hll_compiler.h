@@ -60,6 +60,45 @@ typedef struct {
   hll_location_entry *entries;
 } hll_location_table;
 
+#define HLL_SYMBOL_TABLE_SIZE 1024
+
+typedef uint32_t hll_symbol_flags;
+enum {
+  // Symbol is bound by let, loop, function parameter or nested define.
+  HLL_SYMBOL_BOUND = 0x1,
+  // Symbol is target of set!.
+  HLL_SYMBOL_ASSIGNED = 0x2,
+  // Symbol names macro defined in translation unit.
+  HLL_SYMBOL_MACRO = 0x4,
+  // Symbol is top level variable which value is known at compile time.
+  HLL_SYMBOL_CONSTANT = 0x8,
+};
+
+// Describes how symbol is used in translation unit.
+typedef struct {
+  // Index of next entry with the same hash slot plus one, 0 if there is none.
+  size_t next;
+  uint32_t hash;
+  hll_symbol_flags flags;
+  // Number of top level defines of this symbol.
+  uint32_t define_count;
+  // Value of constant variable. Constants are numbers, so value does not have
+  // to be rooted.
+  hll_value value;
+  // Number of calls compiled before constant was defined. Value is valid
+  // until next call.
+  size_t call_count;
+} hll_symbol_entry;
+
+// Table of symbols used in translation unit. It is filled by scanning whole
+// ast before compilation, and tells compiler which variables keep their
+// values, so that their uses and calls to builtins can be evaluated at
+// compile time. Symbols are identified by hash, like in variable lookup.
+typedef struct {
+  size_t hash_table[HLL_SYMBOL_TABLE_SIZE];
+  hll_symbol_entry *entries;
+} hll_symbol_table;
+
 // Flags of translation unit.
 typedef uint32_t hll_tu_flags;
 enum { HLL_TU_FLAG_DEBUG = 0x1 };
@@ -71,6 +110,7 @@ typedef struct {
   // Pointer to location table. Location table is populated during parsing,
   // and information stored in it is later used when building bytecode.
   hll_location_table *locs;
+  hll_symbol_table *symbols;
   const char *name;
   const char *source;
   struct hll_vm *vm;
@@ -90,6 +130,7 @@ typedef enum {
   HLL_TOK_LPAREN,
   HLL_TOK_RPAREN,
   HLL_TOK_QUOTE,
+  HLL_TOK_STRING,
   HLL_TOK_COMMENT,
   HLL_TOK_UNEXPECTED
 } hll_token_kind;
@@ -162,6 +203,42 @@ typedef struct {
   uint32_t length;
 } hll_compiler_loc_stack_entry;
 
+// Maps constants of bytecode being generated to their indices in constant
+// pool, so that each constant is added once. Symbols are compared by name, and
+// other constants bitwise.
+typedef struct {
+  // Open addressing hash table of constant indices plus one, 0 marks empty
+  // slot. Capacity is power of two.
+  uint32_t *slots;
+  size_t capacity;
+  size_t count;
+} hll_constant_table;
+
+typedef struct {
+  // Cons cell of expression, 0 marks empty slot.
+  hll_value ast;
+  hll_value value;
+  bool is_folded;
+  // Number of calls compiled before expression was folded. Result depends on
+  // it, so it is valid only while no more calls are compiled.
+  size_t call_count;
+} hll_fold_entry;
+
+// Results of constant folding of expressions. Folding of expression folds all
+// its subexpressions, and compiler tries to fold each subexpression again when
+// it is compiled, so without cache compile time would be quadratic in depth of
+// expression.
+typedef struct {
+  // Open addressing hash table keyed by expression. Capacity is power of two.
+  hll_fold_entry *entries;
+  size_t capacity;
+  size_t count;
+  // Collection count of gc when table was filled. Freed expressions can be
+  // replaced by other ones at same address, so table is cleared after
+  // collection.
+  size_t collection_count;
+} hll_fold_cache;
+
 // Structure that holds state of compiler.
 typedef struct {
   uint32_t error_count;
@@ -178,13 +255,31 @@ typedef struct {
   // Counter of first insruction in current RLE group (instructions that refer
   // to same location). It is updated when the loc_stack is changed.
   size_t loc_op_idx;
+  // Set for compiler of translation unit top level code.
+  bool is_toplevel;
+  // Top level form currently being compiled.
+  hll_value toplevel_form;
+  // Number of calls compiled in top level code so far. Loops are counted as
+  // calls, because their bodies run again after calls in them. Called
+  // function may be defined in earlier translation unit and assign any
+  // global variable, so values known at compile time are valid only until
+  // next call.
+  size_t call_count;
+  hll_constant_table constants;
+  hll_fold_cache fold_cache;
 } hll_compiler;
 
 void hll_compiler_init(hll_compiler *compiler, hll_translation_unit *tu,
                        hll_value name) __attribute__((nonnull));
+// Frees memory used by compiler. Generated bytecode is not freed.
+void hll_compiler_free(hll_compiler *compiler) __attribute__((nonnull));
+
+// Fills table used by compiler to recognize special forms without comparing
+// symbol against each of their names.
+void hll_init_special_symbs(struct hll_vm *vm) __attribute__((nonnull));
 
-// Compiles ast into a function object. Garbage collection is forbidden to
-// happen during execution of this function.
+// Compiles ast into a function object. Garbage collection may happen during
+// execution of this function, ast is kept alive until it returns.
 hll_value hll_compile_ast(hll_compiler *compiler, hll_value ast)
     __attribute__((nonnull));
 
@@ -141,7 +141,6 @@ void hll_delete_debug(hll_debug_storage *ds) {
   for (size_t i = 0; i < hll_sb_len(ds->dtus); ++i) {
     hll_dtu *dtu = ds->dtus + i;
     hll_sb_free(dtu->locs);
-    hll_sb_free(dtu->loc_rle);
   }
   hll_sb_free(ds->dtus);
   hll_free(ds, sizeof(*ds));
@@ -171,18 +170,17 @@ void hll_report_runtime_errorv(hll_debug_storage *debug, const char *fmt,
   size_t op_idx = f->ip - f->bytecode->ops;
   assert(op_idx);
   --op_idx;
-  uint32_t offset =
-      hll_bytecode_get_loc(debug, f->bytecode->translation_unit, op_idx);
+  uint32_t offset = hll_bytecode_get_loc(debug, f->bytecode, op_idx);
   uint32_t translation_unit = f->bytecode->translation_unit;
   hll_report_errorv(
       debug, (hll_loc){.offset = offset, .translation_unit = translation_unit},
       fmt, args);
 }
 
-void hll_bytecode_add_loc(hll_debug_storage *debug, uint32_t translation_unit,
+void hll_bytecode_add_loc(hll_debug_storage *debug, hll_bytecode *bytecode,
                           size_t op_length, uint32_t compilation_unit,
                           uint32_t offset) {
-  hll_dtu *dtu = debug->dtus + translation_unit - 1;
+  hll_dtu *dtu = debug->dtus + bytecode->translation_unit - 1;
   assert(dtu <= &hll_sb_last(debug->dtus));
   hll_loc bc_loc = {
       .translation_unit = compilation_unit,
@@ -193,27 +191,31 @@ void hll_bytecode_add_loc(hll_debug_storage *debug, uint32_t translation_unit,
   assert(op_length);
   hll_bytecode_rle rle = {.length = op_length,
                           .loc_idx = hll_sb_len(dtu->locs) - 1};
-  hll_sb_push(dtu->loc_rle, rle);
+  hll_sb_push(bytecode->loc_rle, rle);
 }
 
 uint32_t hll_bytecode_get_loc(hll_debug_storage *debug,
-                              uint32_t translation_unit, size_t op_idx) {
-  hll_dtu *dtu = debug->dtus + translation_unit - 1;
+                              const hll_bytecode *bytecode, size_t op_idx) {
+  hll_dtu *dtu = debug->dtus + bytecode->translation_unit - 1;
   assert(dtu <= &hll_sb_last(debug->dtus));
   size_t cursor = 0;
-  hll_bytecode_rle *rle = dtu->loc_rle;
-  if (rle == NULL) {
-    return 0;
-  }
-  for (;;) {
+  for (size_t i = 0; i < hll_sb_len(bytecode->loc_rle); ++i) {
+    const hll_bytecode_rle *rle = bytecode->loc_rle + i;
     if (cursor <= op_idx && op_idx < cursor + rle->length) {
-      break;
+      return dtu->locs[rle->loc_idx].offset;
     }
     cursor += rle->length;
-    ++rle;
-
-    assert(rle <= &hll_sb_last(dtu->loc_rle));
   }
 
-  return dtu->locs[rle->loc_idx].offset;
+  return 0;
+}
+
+void hll_debug_get_line_col(hll_debug_storage *debug, hll_loc loc,
+                            uint32_t *line, uint32_t *column) {
+  assert(loc.translation_unit != 0 &&
+         loc.translation_unit <= hll_sb_len(debug->dtus));
+  hll_dtu *dtu = debug->dtus + loc.translation_unit - 1;
+  hll_src_loc_info info = get_src_loc_info(dtu->source, loc.offset);
+  *line = info.line;
+  *column = info.column;
 }
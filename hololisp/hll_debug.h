@@ -27,8 +27,9 @@ typedef struct hll_loc {
 // Bytecode contains source location in order to provide meaningful error
 // messages. This information is encoded in run-length encoding based format.
 // This structure describes unit of rle encoding, specifying locations for
-// next 'length' operands.
-typedef struct {
+// next 'length' operands. Each bytecode has its own array of these, indices
+// refer to locations of translation unit that produced bytecode.
+typedef struct hll_bytecode_rle {
   uint32_t length;
   uint32_t loc_idx;
 } hll_bytecode_rle;
@@ -38,9 +39,9 @@ typedef struct {
   const char *source;
   const char *name;
   // We encode information about source of the bytecode via RLE-encoded
-  // array. Each RLE 64-bit entry consists of two 32-bit integers.
-  // First integer is producer location, second is count of produced
-  // instructions.
+  // array stored in each bytecode. Each RLE 64-bit entry consists of two
+  // 32-bit integers. First integer is producer location, second is count of
+  // produced instructions.
   // When executing some instruction fails, we do linear O(n) search in
   // RLE to find producer location. Location itself contains index of
   // translation unit, which VM can use to find file or string that was the
@@ -51,7 +52,6 @@ typedef struct {
   // stack, memory usage etc.) can be used to display user-friendly thorough
   // error message.
   struct hll_loc *locs;
-  hll_bytecode_rle *loc_rle;
 } hll_dtu;
 
 typedef uint32_t hll_debug_flags;
@@ -90,10 +90,17 @@ void hll_report_runtime_errorv(hll_debug_storage *debug, const char *fmt,
 
 void hll_debug_print_summary(hll_debug_storage *debug);
 
-void hll_bytecode_add_loc(hll_debug_storage *debug, uint32_t tu,
-                          size_t op_length, uint32_t compilation_unit,
-                          uint32_t offset);
-uint32_t hll_bytecode_get_loc(hll_debug_storage *debug, uint32_t tu,
+void hll_bytecode_add_loc(hll_debug_storage *debug,
+                          struct hll_bytecode *bytecode, size_t op_length,
+                          uint32_t compilation_unit, uint32_t offset);
+// Returns source offset of instruction. If instruction has no location
+// information, 0 is returned.
+uint32_t hll_bytecode_get_loc(hll_debug_storage *debug,
+                              const struct hll_bytecode *bytecode,
                               size_t op_idx);
 
+// Finds 1-based line and column numbers of location.
+void hll_debug_get_line_col(hll_debug_storage *debug, hll_loc loc,
+                            uint32_t *line, uint32_t *column);
+
 #endif
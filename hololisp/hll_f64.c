@@ -0,0 +1,410 @@
+#include "hll_f64.h"
+
+#include <stdbool.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                              \
+    (defined(__GNUC__) || defined(__clang__))
+#define HLL_F64_X86 1
+#include <immintrin.h>
+#endif
+
+//
+// Scalar kernels. These are used when no vector instruction set is available
+// and to process tails of arrays in vector kernels.
+//
+
+static void scalar_add(double *dst, const double *a, const double *b,
+                       size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    dst[i] = a[i] + b[i];
+  }
+}
+
+static void scalar_sub(double *dst, const double *a, const double *b,
+                       size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    dst[i] = a[i] - b[i];
+  }
+}
+
+static void scalar_mul(double *dst, const double *a, const double *b,
+                       size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    dst[i] = a[i] * b[i];
+  }
+}
+
+static void scalar_scale(double *dst, const double *a, double k, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    dst[i] = a[i] * k;
+  }
+}
+
+static void scalar_fma(double *dst, const double *a, const double *b,
+                       const double *c, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    dst[i] = a[i] * b[i] + c[i];
+  }
+}
+
+static void scalar_lt(double *dst, const double *a, const double *b,
+                      size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    dst[i] = a[i] < b[i] ? 1.0 : 0.0;
+  }
+}
+
+static void scalar_le(double *dst, const double *a, const double *b,
+                      size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    dst[i] = a[i] <= b[i] ? 1.0 : 0.0;
+  }
+}
+
+static void scalar_eq(double *dst, const double *a, const double *b,
+                      size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    dst[i] = a[i] == b[i] ? 1.0 : 0.0;
+  }
+}
+
+static double scalar_sum(const double *a, size_t n) {
+  double result = 0;
+  for (size_t i = 0; i < n; ++i) {
+    result += a[i];
+  }
+  return result;
+}
+
+static double scalar_min(const double *a, size_t n) {
+  double result = a[0];
+  for (size_t i = 1; i < n; ++i) {
+    result = a[i] < result ? a[i] : result;
+  }
+  return result;
+}
+
+static double scalar_max(const double *a, size_t n) {
+  double result = a[0];
+  for (size_t i = 1; i < n; ++i) {
+    result = a[i] > result ? a[i] : result;
+  }
+  return result;
+}
+
+static double scalar_dot(const double *a, const double *b, size_t n) {
+  double result = 0;
+  for (size_t i = 0; i < n; ++i) {
+    result += a[i] * b[i];
+  }
+  return result;
+}
+
+static const hll_f64_kernels scalar_kernels = {
+    .isa = "scalar",
+    .add = scalar_add,
+    .sub = scalar_sub,
+    .mul = scalar_mul,
+    .scale = scalar_scale,
+    .fma = scalar_fma,
+    .lt = scalar_lt,
+    .le = scalar_le,
+    .eq = scalar_eq,
+    .sum = scalar_sum,
+    .min = scalar_min,
+    .max = scalar_max,
+    .dot = scalar_dot,
+};
+
+#ifdef HLL_F64_X86
+
+//
+// SSE2 kernels. Process 2 doubles at a time. Arrays are not guaranteed to be
+// aligned, so unaligned loads and stores are used everywhere.
+//
+
+#define HLL_SSE2 __attribute__((target("sse2")))
+
+#define SSE2_BINARY_KERNEL(_name, _op)                                         \
+  HLL_SSE2 static void sse2_##_name(double *dst, const double *a,             \
+                                     const double *b, size_t n) {              \
+    size_t i = 0;                                                              \
+    for (; i + 2 <= n; i += 2) {                                               \
+      _mm_storeu_pd(dst + i, _op(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));   \
+    }                                                                          \
+    scalar_##_name(dst + i, a + i, b + i, n - i);                              \
+  }
+
+#define SSE2_MASK_KERNEL(_name, _cmp)                                          \
+  HLL_SSE2 static void sse2_##_name(double *dst, const double *a,             \
+                                     const double *b, size_t n) {              \
+    __m128d ones = _mm_set1_pd(1.0);                                           \
+    size_t i = 0;                                                              \
+    for (; i + 2 <= n; i += 2) {                                               \
+      __m128d mask = _cmp(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));           \
+      _mm_storeu_pd(dst + i, _mm_and_pd(mask, ones));                          \
+    }                                                                          \
+    scalar_##_name(dst + i, a + i, b + i, n - i);                              \
+  }
+
+SSE2_BINARY_KERNEL(add, _mm_add_pd)
+SSE2_BINARY_KERNEL(sub, _mm_sub_pd)
+SSE2_BINARY_KERNEL(mul, _mm_mul_pd)
+SSE2_MASK_KERNEL(lt, _mm_cmplt_pd)
+SSE2_MASK_KERNEL(le, _mm_cmple_pd)
+SSE2_MASK_KERNEL(eq, _mm_cmpeq_pd)
+
+HLL_SSE2 static void sse2_scale(double *dst, const double *a, double k,
+                                size_t n) {
+  __m128d vk = _mm_set1_pd(k);
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    _mm_storeu_pd(dst + i, _mm_mul_pd(_mm_loadu_pd(a + i), vk));
+  }
+  scalar_scale(dst + i, a + i, k, n - i);
+}
+
+HLL_SSE2 static void sse2_fma(double *dst, const double *a, const double *b,
+                              const double *c, size_t n) {
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d product = _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i));
+    _mm_storeu_pd(dst + i, _mm_add_pd(product, _mm_loadu_pd(c + i)));
+  }
+  scalar_fma(dst + i, a + i, b + i, c + i, n - i);
+}
+
+HLL_SSE2 static double sse2_hsum(__m128d v) {
+  return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+HLL_SSE2 static double sse2_sum(const double *a, size_t n) {
+  __m128d acc = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    acc = _mm_add_pd(acc, _mm_loadu_pd(a + i));
+  }
+  return sse2_hsum(acc) + scalar_sum(a + i, n - i);
+}
+
+HLL_SSE2 static double sse2_dot(const double *a, const double *b, size_t n) {
+  __m128d acc = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    acc = _mm_add_pd(acc, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+  }
+  return sse2_hsum(acc) + scalar_dot(a + i, b + i, n - i);
+}
+
+HLL_SSE2 static double sse2_min(const double *a, size_t n) {
+  __m128d acc = _mm_set1_pd(a[0]);
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    acc = _mm_min_pd(acc, _mm_loadu_pd(a + i));
+  }
+  acc = _mm_min_sd(acc, _mm_unpackhi_pd(acc, acc));
+  double result = _mm_cvtsd_f64(acc);
+  for (; i < n; ++i) {
+    result = a[i] < result ? a[i] : result;
+  }
+  return result;
+}
+
+HLL_SSE2 static double sse2_max(const double *a, size_t n) {
+  __m128d acc = _mm_set1_pd(a[0]);
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    acc = _mm_max_pd(acc, _mm_loadu_pd(a + i));
+  }
+  acc = _mm_max_sd(acc, _mm_unpackhi_pd(acc, acc));
+  double result = _mm_cvtsd_f64(acc);
+  for (; i < n; ++i) {
+    result = a[i] > result ? a[i] : result;
+  }
+  return result;
+}
+
+static const hll_f64_kernels sse2_kernels = {
+    .isa = "sse2",
+    .add = sse2_add,
+    .sub = sse2_sub,
+    .mul = sse2_mul,
+    .scale = sse2_scale,
+    .fma = sse2_fma,
+    .lt = sse2_lt,
+    .le = sse2_le,
+    .eq = sse2_eq,
+    .sum = sse2_sum,
+    .min = sse2_min,
+    .max = sse2_max,
+    .dot = sse2_dot,
+};
+
+//
+// AVX2 kernels. Process 4 doubles at a time. CPUs supporting AVX2 are
+// expected to support FMA too, but both are checked at runtime.
+//
+
+#define HLL_AVX2 __attribute__((target("avx2,fma")))
+
+#define AVX2_BINARY_KERNEL(_name, _op)                                         \
+  HLL_AVX2 static void avx2_##_name(double *dst, const double *a,             \
+                                     const double *b, size_t n) {              \
+    size_t i = 0;                                                              \
+    for (; i + 4 <= n; i += 4) {                                               \
+      _mm256_storeu_pd(dst + i,                                                \
+                       _op(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));  \
+    }                                                                          \
+    scalar_##_name(dst + i, a + i, b + i, n - i);                              \
+  }
+
+#define AVX2_MASK_KERNEL(_name, _pred)                                         \
+  HLL_AVX2 static void avx2_##_name(double *dst, const double *a,             \
+                                     const double *b, size_t n) {              \
+    __m256d ones = _mm256_set1_pd(1.0);                                        \
+    size_t i = 0;                                                              \
+    for (; i + 4 <= n; i += 4) {                                               \
+      __m256d va = _mm256_loadu_pd(a + i);                                     \
+      __m256d mask = _mm256_cmp_pd(va, _mm256_loadu_pd(b + i), _pred);         \
+      _mm256_storeu_pd(dst + i, _mm256_and_pd(mask, ones));                    \
+    }                                                                          \
+    scalar_##_name(dst + i, a + i, b + i, n - i);                              \
+  }
+
+AVX2_BINARY_KERNEL(add, _mm256_add_pd)
+AVX2_BINARY_KERNEL(sub, _mm256_sub_pd)
+AVX2_BINARY_KERNEL(mul, _mm256_mul_pd)
+AVX2_MASK_KERNEL(lt, _CMP_LT_OQ)
+AVX2_MASK_KERNEL(le, _CMP_LE_OQ)
+AVX2_MASK_KERNEL(eq, _CMP_EQ_OQ)
+
+HLL_AVX2 static void avx2_scale(double *dst, const double *a, double k,
+                                size_t n) {
+  __m256d vk = _mm256_set1_pd(k);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm256_storeu_pd(dst + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), vk));
+  }
+  scalar_scale(dst + i, a + i, k, n - i);
+}
+
+HLL_AVX2 static void avx2_fma(double *dst, const double *a, const double *b,
+                              const double *c, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm256_storeu_pd(dst + i, _mm256_fmadd_pd(_mm256_loadu_pd(a + i),
+                                              _mm256_loadu_pd(b + i),
+                                              _mm256_loadu_pd(c + i)));
+  }
+  scalar_fma(dst + i, a + i, b + i, c + i, n - i);
+}
+
+HLL_AVX2 static double avx2_hsum(__m256d v) {
+  __m128d half = _mm_add_pd(_mm256_castpd256_pd128(v),
+                            _mm256_extractf128_pd(v, 1));
+  return _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+}
+
+HLL_AVX2 static double avx2_sum(const double *a, size_t n) {
+  // Two accumulators hide latency of addition.
+  __m256d acc0 = _mm256_setzero_pd();
+  __m256d acc1 = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(a + i));
+    acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(a + i + 4));
+  }
+  for (; i + 4 <= n; i += 4) {
+    acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(a + i));
+  }
+  return avx2_hsum(_mm256_add_pd(acc0, acc1)) + scalar_sum(a + i, n - i);
+}
+
+HLL_AVX2 static double avx2_dot(const double *a, const double *b, size_t n) {
+  __m256d acc0 = _mm256_setzero_pd();
+  __m256d acc1 = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i),
+                           acc0);
+    acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 4),
+                           _mm256_loadu_pd(b + i + 4), acc1);
+  }
+  for (; i + 4 <= n; i += 4) {
+    acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i),
+                           acc0);
+  }
+  return avx2_hsum(_mm256_add_pd(acc0, acc1)) +
+         scalar_dot(a + i, b + i, n - i);
+}
+
+HLL_AVX2 static double avx2_min(const double *a, size_t n) {
+  __m256d acc = _mm256_set1_pd(a[0]);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    acc = _mm256_min_pd(acc, _mm256_loadu_pd(a + i));
+  }
+  __m128d half =
+      _mm_min_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+  double result = _mm_cvtsd_f64(_mm_min_sd(half, _mm_unpackhi_pd(half, half)));
+  for (; i < n; ++i) {
+    result = a[i] < result ? a[i] : result;
+  }
+  return result;
+}
+
+HLL_AVX2 static double avx2_max(const double *a, size_t n) {
+  __m256d acc = _mm256_set1_pd(a[0]);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    acc = _mm256_max_pd(acc, _mm256_loadu_pd(a + i));
+  }
+  __m128d half =
+      _mm_max_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+  double result = _mm_cvtsd_f64(_mm_max_sd(half, _mm_unpackhi_pd(half, half)));
+  for (; i < n; ++i) {
+    result = a[i] > result ? a[i] : result;
+  }
+  return result;
+}
+
+static const hll_f64_kernels avx2_kernels = {
+    .isa = "avx2",
+    .add = avx2_add,
+    .sub = avx2_sub,
+    .mul = avx2_mul,
+    .scale = avx2_scale,
+    .fma = avx2_fma,
+    .lt = avx2_lt,
+    .le = avx2_le,
+    .eq = avx2_eq,
+    .sum = avx2_sum,
+    .min = avx2_min,
+    .max = avx2_max,
+    .dot = avx2_dot,
+};
+
+#endif // HLL_F64_X86
+
+static const hll_f64_kernels *select_kernels(void) {
+#ifdef HLL_F64_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return &avx2_kernels;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return &sse2_kernels;
+  }
+#endif
+  return &scalar_kernels;
+}
+
+const hll_f64_kernels *hll_f64_get_kernels(void) {
+  // Selection result does not change during program lifetime, so it is
+  // computed once.
+  static const hll_f64_kernels *kernels;
+  if (kernels == NULL) {
+    kernels = select_kernels();
+  }
+  return kernels;
+}
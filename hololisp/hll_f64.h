@@ -0,0 +1,51 @@
+//
+// hll_f64.h
+//
+// This file contains bulk kernels operating on dense arrays of doubles. They
+// back f64array builtins.
+//
+// Each kernel has scalar implementation and, on x86, SSE2 and AVX2
+// implementations. Implementation is selected once at runtime based on
+// features supported by CPU, so binary built for generic x86 still uses wide
+// instructions when they are available.
+//
+// Reductions and fused multiply-add may round differently depending on
+// selected implementation, because order of operations differs. Results for
+// arrays containing NaN are unspecified for min and max.
+//
+#ifndef HLL_F64_H
+#define HLL_F64_H
+
+#include <stddef.h>
+
+typedef struct hll_f64_kernels {
+  // Name of instruction set used by kernels, e.g. "avx2".
+  const char *isa;
+
+  // dst[i] = a[i] op b[i]. dst may alias a or b.
+  void (*add)(double *dst, const double *a, const double *b, size_t n);
+  void (*sub)(double *dst, const double *a, const double *b, size_t n);
+  void (*mul)(double *dst, const double *a, const double *b, size_t n);
+  // dst[i] = a[i] * k
+  void (*scale)(double *dst, const double *a, double k, size_t n);
+  // dst[i] = a[i] * b[i] + c[i]
+  void (*fma)(double *dst, const double *a, const double *b, const double *c,
+              size_t n);
+
+  // dst[i] = a[i] cmp b[i] ? 1 : 0
+  void (*lt)(double *dst, const double *a, const double *b, size_t n);
+  void (*le)(double *dst, const double *a, const double *b, size_t n);
+  void (*eq)(double *dst, const double *a, const double *b, size_t n);
+
+  double (*sum)(const double *a, size_t n);
+  // min and max expect n to be non-zero.
+  double (*min)(const double *a, size_t n);
+  double (*max)(const double *a, size_t n);
+  double (*dot)(const double *a, const double *b, size_t n);
+} hll_f64_kernels;
+
+// Returns kernels best suited for current CPU.
+const hll_f64_kernels *hll_f64_get_kernels(void)
+    __attribute__((returns_nonnull));
+
+#endif
@@ -1,20 +1,50 @@
 #include "hll_gc.h"
 
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "hll_bytecode.h"
+#include "hll_debug.h"
 #include "hll_mem.h"
 #include "hll_util.h"
 #include "hll_value.h"
 #include "hll_vm.h"
 
+// Size of cons object, including header.
+#define HLL_CONS_CELL_SIZE (sizeof(hll_obj) + sizeof(hll_obj_cons))
+#define HLL_CONS_BLOCK_CELLS 1024
+
+// Block of cons cells filled by compacting collection. Cells are never freed
+// individually, dead cells are turned into holes by regular collection and
+// whole blocks are freed by next compacting collection.
+typedef struct hll_cons_block {
+  struct hll_cons_block *next;
+  size_t count;
+  char cells[];
+} hll_cons_block;
+
+static hll_obj *get_cons_cell(hll_cons_block *block, size_t idx) {
+  return (hll_obj *)(block->cells + idx * HLL_CONS_CELL_SIZE);
+}
+
+static void free_cons_blocks(hll_cons_block *block) {
+  while (block != NULL) {
+    hll_cons_block *next = block->next;
+    hll_free(block,
+             sizeof(hll_cons_block) + HLL_CONS_BLOCK_CELLS * HLL_CONS_CELL_SIZE);
+    block = next;
+  }
+}
+
 static void hll_gray_value(hll_gc *gc, hll_value value) {
   if (!hll_is_obj(value)) {
     return;
   }
 
   hll_obj *obj = hll_unwrap_obj(value);
-  if (obj->is_dark) {
+  if (obj->is_dark || obj->is_perm) {
     return;
   }
 
@@ -22,38 +52,49 @@ static void hll_gray_value(hll_gc *gc, hll_value value) {
   hll_sb_push(gc->gray_objs, value);
 }
 
-static void hll_blacken_value(hll_gc *gc, hll_value value) {
-  if (!hll_is_obj(value)) {
-    return;
-  }
-
+static void hll_gray_children(hll_gc *gc, hll_value value) {
   hll_obj *obj = hll_unwrap_obj(value);
-  gc->bytes_allocated += sizeof(hll_obj);
-
   switch (obj->kind) {
   case HLL_VALUE_CONS:
     hll_gray_value(gc, hll_unwrap_car(value));
     hll_gray_value(gc, hll_unwrap_cdr(value));
     break;
   case HLL_VALUE_SYMB:
-    gc->bytes_allocated +=
-        hll_unwrap_symb(value)->length + 1 + sizeof(hll_obj_symb);
-    break;
   case HLL_VALUE_BIND:
-    gc->bytes_allocated += sizeof(hll_obj_bind);
+  case HLL_VALUE_F64ARRAY:
+  case HLL_VALUE_BUILDER:
+  case HLL_VALUE_RANGE:
+    break;
+  case HLL_VALUE_STR:
+    hll_gray_value(gc, hll_unwrap_str(value)->parent);
     break;
   case HLL_VALUE_ENV:
-    gc->bytes_allocated += sizeof(hll_obj_env);
     hll_gray_value(gc, hll_unwrap_env(value)->vars);
     hll_gray_value(gc, hll_unwrap_env(value)->up);
     break;
   case HLL_VALUE_FUNC: {
-    gc->bytes_allocated += sizeof(hll_obj_func);
     hll_gray_value(gc, hll_unwrap_func(value)->param_names);
     hll_gray_value(gc, hll_unwrap_func(value)->env);
     hll_bytecode *bytecode = hll_unwrap_func(value)->bytecode;
-    for (size_t i = 0; i < hll_sb_len(bytecode->constant_pool); ++i) {
-      hll_gray_value(gc, bytecode->constant_pool[i]);
+    if (!bytecode->is_perm) {
+      hll_gray_value(gc, bytecode->name);
+      for (size_t i = 0; i < hll_sb_len(bytecode->constant_pool); ++i) {
+        hll_gray_value(gc, bytecode->constant_pool[i]);
+      }
+    }
+  } break;
+  case HLL_VALUE_VEC: {
+    hll_obj_vec *vec = hll_unwrap_vec(value);
+    for (size_t i = 0; i < vec->length; ++i) {
+      hll_gray_value(gc, vec->items[i]);
+    }
+  } break;
+  case HLL_VALUE_HASH: {
+    hll_obj_hash *hash = hll_unwrap_hash(value);
+    // Keys of empty entries are not objects and are skipped.
+    for (size_t i = 0; i < hash->capacity; ++i) {
+      hll_gray_value(gc, hash->entries[i].key);
+      hll_gray_value(gc, hash->entries[i].value);
     }
   } break;
   default:
@@ -62,14 +103,39 @@ static void hll_blacken_value(hll_gc *gc, hll_value value) {
   }
 }
 
+static void hll_blacken_value(hll_gc *gc, hll_value value) {
+  if (!hll_is_obj(value)) {
+    return;
+  }
+
+  gc->bytes_allocated += hll_obj_size(hll_unwrap_obj(value));
+  hll_gray_children(gc, value);
+}
+
+static void set_next_gc(hll_gc *gc) {
+  struct hll_vm *vm = gc->vm;
+  gc->next_gc = gc->bytes_allocated +
+                ((gc->bytes_allocated * vm->config.heap_grow_percent) / 100);
+  if (gc->next_gc < vm->config.min_heap_size) {
+    gc->next_gc = vm->config.min_heap_size;
+  }
+}
+
 static void hll_collect_garbage(hll_gc *gc) {
   struct hll_vm *vm = gc->vm;
+  ++gc->collection_count;
 
   // Reset allocated bytes count
   gc->bytes_allocated = 0;
   hll_sb_purge(gc->gray_objs);
   hll_gray_value(gc, vm->global_env);
-  hll_gray_value(gc, vm->macro_env);
+  hll_gray_value(gc, vm->macros);
+  hll_gray_value(gc, vm->native_names);
+  hll_gray_value(gc, vm->fused_bind);
+  for (size_t i = 0; i < hll_sb_len(vm->natives); ++i) {
+    hll_gray_value(gc, vm->natives[i].var);
+    hll_gray_value(gc, vm->natives[i].bind);
+  }
   for (size_t i = 0; i < hll_sb_len(gc->temp_roots); ++i) {
     hll_gray_value(gc, gc->temp_roots[i]);
   }
@@ -82,11 +148,19 @@ static void hll_collect_garbage(hll_gc *gc) {
     hll_gray_value(gc, f->func);
   }
   hll_gray_value(gc, vm->env);
+  // Permanent objects are not traced, so references from them to regular
+  // objects are only known through remembered set.
+  for (size_t i = 0; i < hll_sb_len(gc->remembered); ++i) {
+    hll_gray_children(gc, gc->remembered[i]);
+  }
 
   for (size_t i = 0; i < hll_sb_len(gc->gray_objs); ++i) {
     hll_blacken_value(gc, gc->gray_objs[i]);
   }
 
+  // Freeing objects decreases allocated bytes count, which by now only
+  // contains live objects.
+  size_t live_bytes = gc->bytes_allocated;
   // Free all objects not marked
   hll_obj **obj_ptr = &gc->all_objs;
   while (*obj_ptr != NULL) {
@@ -99,14 +173,283 @@ static void hll_collect_garbage(hll_gc *gc) {
       obj_ptr = &(*obj_ptr)->next_gc;
     }
   }
+  gc->bytes_allocated = live_bytes;
 
-  gc->next_gc = gc->bytes_allocated +
-                ((gc->bytes_allocated * vm->config.heap_grow_percent) / 100);
-  if (gc->next_gc < vm->config.min_heap_size) {
-    gc->next_gc = vm->config.min_heap_size;
+  // Turn dead conses in compacted blocks into holes. Their fields may
+  // reference freed objects, so they are cleared too.
+  for (hll_cons_block *block = gc->cons_blocks; block != NULL;
+       block = block->next) {
+    for (size_t i = 0; i < block->count; ++i) {
+      hll_obj *obj = get_cons_cell(block, i);
+      if (obj->is_dark) {
+        obj->is_dark = false;
+      } else if (obj->kind == HLL_VALUE_CONS) {
+        obj->kind = HLL_VALUE_NIL;
+        obj->profile_site = 0;
+        ((hll_obj_cons *)obj->as)->car = hll_nil();
+        ((hll_obj_cons *)obj->as)->cdr = hll_nil();
+      }
+    }
+  }
+
+  set_next_gc(gc);
+}
+
+// State of compacting collection. Conses are copied to new blocks Cheney
+// style: copied cells form a queue that is scanned to copy conses they
+// reference. Objects of other kinds are not moved, they are marked as usual
+// and references stored in them are updated when they are blackened.
+typedef struct {
+  hll_gc *gc;
+  hll_cons_block *head;
+  hll_cons_block *tail;
+} hll_compactor;
+
+static hll_obj *copy_cons(hll_compactor *compactor, hll_obj *obj) {
+  hll_cons_block *block = compactor->tail;
+  if (block == NULL || block->count == HLL_CONS_BLOCK_CELLS) {
+    block = hll_alloc(sizeof(hll_cons_block) +
+                      HLL_CONS_BLOCK_CELLS * HLL_CONS_CELL_SIZE);
+    if (compactor->tail == NULL) {
+      compactor->head = block;
+    } else {
+      compactor->tail->next = block;
+    }
+    compactor->tail = block;
+  }
+
+  hll_obj *copy = get_cons_cell(block, block->count++);
+  memcpy(copy, obj, HLL_CONS_CELL_SIZE);
+  copy->is_dark = true;
+  copy->next_gc = NULL;
+  compactor->gc->bytes_allocated += HLL_CONS_CELL_SIZE;
+
+  obj->is_forwarded = true;
+  ((hll_obj_cons *)obj->as)->car = hll_wrap_obj(copy);
+  return copy;
+}
+
+static bool should_copy(hll_obj *obj) {
+  return obj->kind == HLL_VALUE_CONS && !obj->is_perm && !obj->is_dark &&
+         !obj->is_forwarded;
+}
+
+// Returns new location of value, copying it if needed.
+static hll_value forward_value(hll_compactor *compactor, hll_value value) {
+  if (!hll_is_obj(value)) {
+    return value;
+  }
+
+  hll_obj *obj = hll_unwrap_obj(value);
+  if (obj->kind != HLL_VALUE_CONS) {
+    hll_gray_value(compactor->gc, value);
+    return value;
+  }
+
+  if (obj->is_forwarded) {
+    return ((hll_obj_cons *)obj->as)->car;
+  }
+
+  if (!should_copy(obj)) {
+    return value;
+  }
+
+  // Copy whole chain of cdrs at once, so that lists end up in adjacent cells.
+  hll_obj *copy = copy_cons(compactor, obj);
+  hll_obj *last = copy;
+  for (;;) {
+    hll_value *cdr = &((hll_obj_cons *)last->as)->cdr;
+    if (!hll_is_obj(*cdr) || !should_copy(hll_unwrap_obj(*cdr))) {
+      break;
+    }
+
+    last = copy_cons(compactor, hll_unwrap_obj(*cdr));
+    *cdr = hll_wrap_obj(last);
+  }
+
+  return hll_wrap_obj(copy);
+}
+
+static void forward_slot(hll_compactor *compactor, hll_value *slot) {
+  *slot = forward_value(compactor, *slot);
+}
+
+static void forward_children(hll_compactor *compactor, hll_value value) {
+  hll_obj *obj = hll_unwrap_obj(value);
+  switch (obj->kind) {
+  case HLL_VALUE_CONS:
+    forward_slot(compactor, &hll_unwrap_cons(value)->car);
+    forward_slot(compactor, &hll_unwrap_cons(value)->cdr);
+    break;
+  case HLL_VALUE_SYMB:
+  case HLL_VALUE_BIND:
+  case HLL_VALUE_F64ARRAY:
+  case HLL_VALUE_BUILDER:
+  case HLL_VALUE_RANGE:
+    break;
+  case HLL_VALUE_STR:
+    forward_slot(compactor, &hll_unwrap_str(value)->parent);
+    break;
+  case HLL_VALUE_ENV:
+    forward_slot(compactor, &hll_unwrap_env(value)->vars);
+    forward_slot(compactor, &hll_unwrap_env(value)->up);
+    break;
+  case HLL_VALUE_FUNC: {
+    forward_slot(compactor, &hll_unwrap_func(value)->param_names);
+    forward_slot(compactor, &hll_unwrap_func(value)->env);
+    hll_bytecode *bytecode = hll_unwrap_func(value)->bytecode;
+    if (!bytecode->is_perm) {
+      forward_slot(compactor, &bytecode->name);
+      for (size_t i = 0; i < hll_sb_len(bytecode->constant_pool); ++i) {
+        forward_slot(compactor, bytecode->constant_pool + i);
+      }
+    }
+  } break;
+  case HLL_VALUE_VEC: {
+    hll_obj_vec *vec = hll_unwrap_vec(value);
+    for (size_t i = 0; i < vec->length; ++i) {
+      forward_slot(compactor, vec->items + i);
+    }
+  } break;
+  case HLL_VALUE_HASH: {
+    hll_obj_hash *hash = hll_unwrap_hash(value);
+    bool keys_moved = false;
+    for (size_t i = 0; i < hash->capacity; ++i) {
+      hll_value key = hash->entries[i].key;
+      forward_slot(compactor, &hash->entries[i].key);
+      forward_slot(compactor, &hash->entries[i].value);
+      keys_moved |= key != hash->entries[i].key;
+    }
+    // Conses are hashed by address, so their entries are misplaced now.
+    if (keys_moved) {
+      hll_hash_rehash(hash);
+    }
+  } break;
+  default:
+    HLL_UNREACHABLE;
+    break;
+  }
+}
+
+static void compact_conses(hll_gc *gc) {
+  struct hll_vm *vm = gc->vm;
+  hll_compactor compactor = {.gc = gc};
+  ++gc->collection_count;
+
+  gc->bytes_allocated = 0;
+  hll_sb_purge(gc->gray_objs);
+  forward_slot(&compactor, &vm->global_env);
+  forward_slot(&compactor, &vm->macros);
+  forward_slot(&compactor, &vm->native_names);
+  hll_gray_value(gc, vm->fused_bind);
+  for (size_t i = 0; i < hll_sb_len(vm->natives); ++i) {
+    forward_slot(&compactor, &vm->natives[i].var);
+    hll_gray_value(gc, vm->natives[i].bind);
+  }
+  for (size_t i = 0; i < hll_sb_len(gc->temp_roots); ++i) {
+    forward_slot(&compactor, gc->temp_roots + i);
+  }
+  for (size_t i = 0; i < hll_sb_len(vm->stack); ++i) {
+    forward_slot(&compactor, vm->stack + i);
+  }
+  for (size_t i = 0; i < hll_sb_len(vm->call_stack); ++i) {
+    hll_call_frame *f = vm->call_stack + i;
+    forward_slot(&compactor, &f->env);
+    forward_slot(&compactor, &f->func);
+  }
+  forward_slot(&compactor, &vm->env);
+  for (size_t i = 0; i < hll_sb_len(gc->remembered); ++i) {
+    forward_children(&compactor, gc->remembered[i]);
+  }
+
+  // Alternate between scanning copied conses and blackening other objects
+  // until no new objects are found.
+  size_t gray_idx = 0;
+  hll_cons_block *scan_block = NULL;
+  size_t scan_idx = 0;
+  for (;;) {
+    if (scan_block == NULL) {
+      scan_block = compactor.head;
+    } else if (scan_idx == scan_block->count && scan_block->next != NULL) {
+      scan_block = scan_block->next;
+      scan_idx = 0;
+    }
+
+    if (scan_block != NULL && scan_idx < scan_block->count) {
+      hll_obj *obj = get_cons_cell(scan_block, scan_idx++);
+      forward_children(&compactor, hll_wrap_obj(obj));
+    } else if (gray_idx < hll_sb_len(gc->gray_objs)) {
+      hll_value value = gc->gray_objs[gray_idx++];
+      gc->bytes_allocated += hll_obj_size(hll_unwrap_obj(value));
+      forward_children(&compactor, value);
+    } else {
+      break;
+    }
+  }
+
+  // All reachable conses have been copied, so every cons in the object list
+  // is either garbage or forwarded.
+  size_t live_bytes = gc->bytes_allocated;
+  hll_obj **obj_ptr = &gc->all_objs;
+  while (*obj_ptr != NULL) {
+    if (!(*obj_ptr)->is_dark) {
+      hll_obj *to_free = *obj_ptr;
+      *obj_ptr = to_free->next_gc;
+      hll_free_obj(vm, to_free);
+    } else {
+      (*obj_ptr)->is_dark = false;
+      obj_ptr = &(*obj_ptr)->next_gc;
+    }
+  }
+  gc->bytes_allocated = live_bytes;
+
+  for (hll_cons_block *block = compactor.head; block != NULL;
+       block = block->next) {
+    for (size_t i = 0; i < block->count; ++i) {
+      get_cons_cell(block, i)->is_dark = false;
+    }
+  }
+  free_cons_blocks(gc->cons_blocks);
+  gc->cons_blocks = compactor.head;
+
+  set_next_gc(gc);
+}
+
+void hll_gc_collect(hll_gc *gc) {
+  if (!gc->forbid) {
+    hll_collect_garbage(gc);
   }
 }
 
+void hll_gc_pin(hll_gc *gc) { ++gc->pin; }
+void hll_gc_unpin(hll_gc *gc) {
+  assert(gc->pin);
+  --gc->pin;
+}
+
+void hll_gc_safepoint(hll_gc *gc) {
+  if (gc->compact_requested && !gc->pin && !gc->forbid) {
+    gc->compact_requested = false;
+    compact_conses(gc);
+  }
+}
+
+// When compaction is enabled, collection is postponed until interpreter
+// reaches safepoint. If heap grows too much before that, for example
+// because of long-running native code, regular collection is done.
+static void collect_or_defer(hll_gc *gc) {
+  if (gc->vm->config.compact_conses) {
+    gc->compact_requested = true;
+#if !HLL_STRESS_GC
+    if (!gc->pin && gc->bytes_allocated <= gc->next_gc + gc->next_gc / 2) {
+      return;
+    }
+#endif
+  }
+
+  hll_collect_garbage(gc);
+}
+
 void *hll_gc_realloc(hll_gc *gc, void *ptr, size_t old_size, size_t new_size) {
   gc->bytes_allocated -= old_size;
   gc->bytes_allocated += new_size;
@@ -116,12 +459,17 @@ void *hll_gc_realloc(hll_gc *gc, void *ptr, size_t old_size, size_t new_size) {
       && gc->bytes_allocated > gc->next_gc
 #endif
   ) {
-    hll_collect_garbage(gc);
+    collect_or_defer(gc);
   }
 
   return hll_realloc(ptr, old_size, new_size);
 }
 
+void hll_gc_track(hll_gc *gc, size_t old_size, size_t new_size) {
+  gc->bytes_allocated -= old_size;
+  gc->bytes_allocated += new_size;
+}
+
 hll_gc *hll_make_gc(struct hll_vm *vm) {
   hll_gc *gc = hll_alloc(sizeof(*gc));
   gc->vm = vm;
@@ -130,16 +478,45 @@ hll_gc *hll_make_gc(struct hll_vm *vm) {
   return gc;
 }
 
-void hll_delete_gc(hll_gc *gc) {
-  hll_obj *obj = gc->all_objs;
+static void free_obj_list(hll_gc *gc, hll_obj *obj) {
   while (obj != NULL) {
     hll_obj *next = obj->next_gc;
     assert(next != obj);
     hll_free_obj(gc->vm, obj);
     obj = next;
   }
+}
+
+static char *copy_string(const char *str) {
+  size_t size = strlen(str) + 1;
+  char *copy = hll_alloc(size);
+  memcpy(copy, str, size);
+  return copy;
+}
+
+static void free_string(char *str) {
+  if (str != NULL) {
+    hll_free(str, strlen(str) + 1);
+  }
+}
+
+void hll_delete_gc(hll_gc *gc) {
+  free_obj_list(gc, gc->all_objs);
+  free_obj_list(gc, gc->perm_objs);
+  free_cons_blocks(gc->cons_blocks);
+  free_cons_blocks(gc->perm_cons_blocks);
+  for (size_t i = 0; i < hll_sb_len(gc->profile_sites); ++i) {
+    free_string(gc->profile_sites[i].tu_name);
+    free_string(gc->profile_sites[i].func_name);
+  }
+  hll_sb_free(gc->profile_sites);
+  if (gc->profile_site_table != NULL) {
+    hll_free(gc->profile_site_table,
+             gc->profile_site_table_size * sizeof(uint32_t));
+  }
   hll_sb_free(gc->gray_objs);
   hll_sb_free(gc->temp_roots);
+  hll_sb_free(gc->remembered);
   hll_free(gc, sizeof(*gc));
 }
 
@@ -149,11 +526,317 @@ void hll_pop_forbid_gc(hll_gc *gc) {
   --gc->forbid;
 }
 
-void hll_gc_push_temp_root(hll_gc *gc, hll_value value) {
+hll_handle_scope hll_gc_open_scope(hll_gc *gc) {
+  return hll_sb_len(gc->temp_roots);
+}
+
+void hll_gc_close_scope(hll_gc *gc, hll_handle_scope scope) {
+  assert(scope <= hll_sb_len(gc->temp_roots));
+  if (gc->temp_roots != NULL) {
+    hll_sb_size(gc->temp_roots) = scope;
+  }
+}
+
+hll_handle hll_gc_handle(hll_gc *gc, hll_value value) {
   hll_sb_push(gc->temp_roots, value);
+  return hll_sb_len(gc->temp_roots) - 1;
+}
+
+hll_value hll_gc_get(const hll_gc *gc, hll_handle handle) {
+  assert(handle < hll_sb_len(gc->temp_roots));
+  return gc->temp_roots[handle];
+}
+
+void hll_gc_set(hll_gc *gc, hll_handle handle, hll_value value) {
+  assert(handle < hll_sb_len(gc->temp_roots));
+  gc->temp_roots[handle] = value;
+}
+
+void hll_gc_freeze(hll_gc *gc) {
+  // Permanent objects are never freed, so only reachable ones are promoted.
+  // They can't be told apart while collection is forbidden.
+  if (gc->forbid) {
+    return;
+  }
+  if (gc->vm->config.compact_conses && !gc->pin) {
+    // Compaction also leaves no holes of dead conses in blocks.
+    gc->compact_requested = false;
+    compact_conses(gc);
+  } else {
+    hll_collect_garbage(gc);
+  }
+
+  gc->bytes_allocated = 0;
+  if (gc->cons_blocks != NULL) {
+    hll_cons_block *block = gc->cons_blocks;
+    for (;;) {
+      for (size_t i = 0; i < block->count; ++i) {
+        get_cons_cell(block, i)->is_perm = true;
+      }
+
+      if (block->next == NULL) {
+        break;
+      }
+      block = block->next;
+    }
+
+    block->next = gc->perm_cons_blocks;
+    gc->perm_cons_blocks = gc->cons_blocks;
+    gc->cons_blocks = NULL;
+  }
+
+  hll_obj *obj = gc->all_objs;
+  if (obj == NULL) {
+    return;
+  }
+
+  for (;;) {
+    obj->is_perm = true;
+    if (obj->kind == HLL_VALUE_FUNC) {
+      // All live objects are promoted at once, so constants referenced by
+      // any live bytecode become permanent too.
+      ((hll_obj_func *)obj->as)->bytecode->is_perm = true;
+    }
+
+    if (obj->next_gc == NULL) {
+      break;
+    }
+    obj = obj->next_gc;
+  }
+
+  obj->next_gc = gc->perm_objs;
+  gc->perm_objs = gc->all_objs;
+  gc->all_objs = NULL;
+}
+
+void hll_gc_write_barrier(hll_gc *gc, hll_value value) {
+  hll_obj *obj = hll_unwrap_obj(value);
+  if (HLL_UNLIKELY(obj->is_perm && !obj->is_remembered)) {
+    obj->is_remembered = true;
+    hll_sb_push(gc->remembered, value);
+  }
 }
 
-void hll_gc_pop_temp_root(hll_gc *gc) {
-  assert(hll_sb_len(gc->temp_roots));
-  (void)hll_sb_pop(gc->temp_roots);
+static size_t hash_site(uint32_t translation_unit, uint32_t offset) {
+  uint64_t key = ((uint64_t)translation_unit << 32) | offset;
+  return (key * 0x9e3779b97f4a7c15ull) >> 32;
+}
+
+static void grow_site_table(hll_gc *gc) {
+  size_t new_size = gc->profile_site_table_size * 2;
+  if (new_size == 0) {
+    new_size = 64;
+  }
+
+  uint32_t *table = hll_alloc(new_size * sizeof(uint32_t));
+  size_t mask = new_size - 1;
+  for (size_t i = 0; i < hll_sb_len(gc->profile_sites); ++i) {
+    hll_heap_site *site = gc->profile_sites + i;
+    size_t slot = hash_site(site->translation_unit, site->offset) & mask;
+    while (table[slot] != 0) {
+      slot = (slot + 1) & mask;
+    }
+    table[slot] = i + 1;
+  }
+
+  if (gc->profile_site_table != NULL) {
+    hll_free(gc->profile_site_table,
+             gc->profile_site_table_size * sizeof(uint32_t));
+  }
+  gc->profile_site_table = table;
+  gc->profile_site_table_size = new_size;
+}
+
+// Finds site of current allocation, adding new one if needed. Allocation
+// site is instruction currently executed by topmost call frame.
+static uint32_t get_current_site(hll_gc *gc) {
+  hll_vm *vm = gc->vm;
+  const hll_call_frame *frame = NULL;
+  uint32_t translation_unit = 0;
+  uint32_t offset = 0;
+  if (hll_sb_len(vm->call_stack) != 0) {
+    frame = &hll_sb_last(vm->call_stack);
+    translation_unit = frame->bytecode->translation_unit;
+    // Instruction pointer is already advanced past executed instruction.
+    size_t op_idx = frame->ip - frame->bytecode->ops;
+    if (translation_unit != 0 && op_idx != 0) {
+      offset = hll_bytecode_get_loc(vm->debug, frame->bytecode, op_idx - 1);
+    }
+  }
+
+  if (2 * (hll_sb_len(gc->profile_sites) + 1) > gc->profile_site_table_size) {
+    grow_site_table(gc);
+  }
+
+  size_t mask = gc->profile_site_table_size - 1;
+  size_t slot = hash_site(translation_unit, offset) & mask;
+  for (;;) {
+    uint32_t idx = gc->profile_site_table[slot];
+    if (idx == 0) {
+      break;
+    }
+
+    hll_heap_site *site = gc->profile_sites + idx - 1;
+    if (site->translation_unit == translation_unit && site->offset == offset) {
+      return idx;
+    }
+    slot = (slot + 1) & mask;
+  }
+
+  hll_heap_site site = {.translation_unit = translation_unit,
+                        .offset = offset};
+  if (translation_unit != 0) {
+    hll_debug_get_line_col(vm->debug,
+                           (hll_loc){.translation_unit = translation_unit,
+                                     .offset = offset},
+                           &site.line, &site.column);
+    site.tu_name = copy_string(vm->debug->dtus[translation_unit - 1].name);
+    hll_value name = frame->bytecode->name;
+    if (hll_is_symb(name)) {
+      site.func_name = copy_string(hll_unwrap_zsymb(name));
+    }
+  }
+  hll_sb_push(gc->profile_sites, site);
+
+  uint32_t idx = hll_sb_len(gc->profile_sites);
+  gc->profile_site_table[slot] = idx;
+  return idx;
+}
+
+void hll_gc_profile_obj(hll_gc *gc, hll_obj *obj) {
+  uint32_t rate = gc->vm->config.heap_profile_rate;
+  if (HLL_LIKELY(rate == 0)) {
+    return;
+  }
+
+  if (++gc->profile_counter < rate) {
+    return;
+  }
+  gc->profile_counter = 0;
+  obj->profile_site = get_current_site(gc);
+}
+
+static int compare_strings(const char *a, const char *b) {
+  if (a == NULL || b == NULL) {
+    return (a != NULL) - (b != NULL);
+  }
+  return strcmp(a, b);
+}
+
+static int compare_sites(const void *a_, const void *b_) {
+  const hll_heap_site *a = *(const hll_heap_site *const *)a_;
+  const hll_heap_site *b = *(const hll_heap_site *const *)b_;
+  int result = compare_strings(a->tu_name, b->tu_name);
+  if (result == 0) {
+    result = (a->line > b->line) - (a->line < b->line);
+  }
+  if (result == 0) {
+    result = (a->column > b->column) - (a->column < b->column);
+  }
+  if (result == 0) {
+    result = compare_strings(a->func_name, b->func_name);
+  }
+  if (result == 0) {
+    result = (a->offset > b->offset) - (a->offset < b->offset);
+  }
+  return result;
+}
+
+typedef struct {
+  size_t count;
+  size_t bytes;
+} hll_heap_profile_entry;
+
+static void count_profiled_obj(hll_obj *obj, hll_heap_profile_entry *entries,
+                               hll_heap_profile_entry *total) {
+  if (obj->profile_site == 0) {
+    return;
+  }
+
+  size_t size = hll_obj_size(obj);
+  hll_heap_profile_entry *entry =
+      entries + (obj->profile_site - 1) * HLL_VALUE_KIND_COUNT + obj->kind;
+  ++entry->count;
+  entry->bytes += size;
+  ++total->count;
+  total->bytes += size;
+}
+
+static void count_profiled_objs(hll_obj *obj, hll_heap_profile_entry *entries,
+                                hll_heap_profile_entry *total) {
+  for (; obj != NULL; obj = obj->next_gc) {
+    count_profiled_obj(obj, entries, total);
+  }
+}
+
+static void count_profiled_cons_blocks(hll_cons_block *block,
+                                       hll_heap_profile_entry *entries,
+                                       hll_heap_profile_entry *total) {
+  // Holes never have profile site set.
+  for (; block != NULL; block = block->next) {
+    for (size_t i = 0; i < block->count; ++i) {
+      count_profiled_obj(get_cons_cell(block, i), entries, total);
+    }
+  }
+}
+
+void hll_gc_dump_profile(hll_gc *gc) {
+  hll_vm *vm = gc->vm;
+  size_t site_count = hll_sb_len(gc->profile_sites);
+  size_t entries_size =
+      site_count * HLL_VALUE_KIND_COUNT * sizeof(hll_heap_profile_entry);
+  hll_heap_profile_entry *entries = NULL;
+  const hll_heap_site **sorted = NULL;
+  if (site_count != 0) {
+    entries = hll_alloc(entries_size);
+    sorted = hll_alloc(site_count * sizeof(*sorted));
+  }
+
+  hll_heap_profile_entry total = {0};
+  count_profiled_objs(gc->all_objs, entries, &total);
+  count_profiled_objs(gc->perm_objs, entries, &total);
+  count_profiled_cons_blocks(gc->cons_blocks, entries, &total);
+  count_profiled_cons_blocks(gc->perm_cons_blocks, entries, &total);
+
+  char buffer[1024];
+  snprintf(buffer, sizeof(buffer),
+           "# heap profile: sample rate %u, %zu objects, %zu bytes\n",
+           (unsigned)vm->config.heap_profile_rate, total.count, total.bytes);
+  hll_print(vm, buffer);
+
+  for (size_t i = 0; i < site_count; ++i) {
+    sorted[i] = gc->profile_sites + i;
+  }
+  if (site_count != 0) {
+    qsort(sorted, site_count, sizeof(*sorted), compare_sites);
+  }
+
+  for (size_t i = 0; i < site_count; ++i) {
+    const hll_heap_site *site = sorted[i];
+    size_t site_idx = site - gc->profile_sites;
+    for (size_t kind = 0; kind < HLL_VALUE_KIND_COUNT; ++kind) {
+      hll_heap_profile_entry *entry =
+          entries + site_idx * HLL_VALUE_KIND_COUNT + kind;
+      if (entry->count == 0) {
+        continue;
+      }
+
+      const char *kind_str = hll_get_value_kind_str(kind);
+      if (site->translation_unit == 0) {
+        snprintf(buffer, sizeof(buffer), "%s %zu %zu <native> -\n", kind_str,
+                 entry->count, entry->bytes);
+      } else {
+        snprintf(buffer, sizeof(buffer), "%s %zu %zu %s %s:%u:%u\n",
+                 kind_str, entry->count, entry->bytes,
+                 site->func_name != NULL ? site->func_name : "<anonymous>",
+                 site->tu_name, (unsigned)site->line, (unsigned)site->column);
+      }
+      hll_print(vm, buffer);
+    }
+  }
+
+  if (site_count != 0) {
+    hll_free(entries, entries_size);
+    hll_free(sorted, site_count * sizeof(*sorted));
+  }
 }
@@ -3,6 +3,23 @@
 
 #include "hll_hololisp.h"
 
+// Allocation site recorded by heap profiler. Site is resolved when first
+// sampled object is allocated from it, so it does not depend on bytecode
+// and sources staying alive.
+typedef struct hll_heap_site {
+  // Translation unit and offset of allocating instruction. Used as a key.
+  // Zero translation unit means allocation did not come from bytecode, e.g.
+  // it was done by compiler.
+  uint32_t translation_unit;
+  uint32_t offset;
+  uint32_t line;
+  uint32_t column;
+  // Owned copies of translation unit and function names. Function name is
+  // NULL for toplevel code and lambdas.
+  char *tu_name;
+  char *func_name;
+} hll_heap_site;
+
 typedef struct hll_gc {
   // backpointer to vm. Although it creates circular reference,
   // it is unavoidable in cotext of vm. GC is deeply integrated into VM runtime,
@@ -19,21 +36,98 @@ typedef struct hll_gc {
   hll_value *gray_objs;
   hll_value *temp_roots;
   uint32_t forbid;
+  // Number of collections done. Addresses of objects freed by collection can
+  // be reused, so it is used to invalidate caches keyed by them.
+  size_t collection_count;
+
+  // Linked list of objects promoted to permanent space.
+  struct hll_obj *perm_objs;
+  // Permanent objects that may reference non-permanent ones. Because
+  // permanent objects are not traced, references stored into them after
+  // promotion are recorded here by write barrier and scanned on each
+  // collection. Each object appears in this list at most once.
+  hll_value *remembered;
+
+  // Blocks of cons cells copied by compacting collection.
+  struct hll_cons_block *cons_blocks;
+  // Blocks of cons cells promoted to permanent space.
+  struct hll_cons_block *perm_cons_blocks;
+  // Compacting collection should be done at next safepoint.
+  bool compact_requested;
+  // Compacting collection moves conses, so it is not allowed while native code
+  // that holds references to objects runs code that has safepoints.
+  uint32_t pin;
+
+  // Heap profiler state. Profiler is enabled if heap_profile_rate from config
+  // is not zero.
+  // Counts allocations since last sampled one.
+  uint32_t profile_counter;
+  hll_heap_site *profile_sites;
+  // Open-addressing hash table of indices into profile_sites plus one.
+  // Size is always power of two.
+  uint32_t *profile_site_table;
+  size_t profile_site_table_size;
 } hll_gc;
 
 hll_gc *hll_make_gc(struct hll_vm *vm);
 void hll_delete_gc(hll_gc *gc);
 
+// Runs full garbage collection, unless it is forbidden.
+void hll_gc_collect(hll_gc *gc);
+
 void hll_push_forbid_gc(hll_gc *gc);
 void hll_pop_forbid_gc(hll_gc *gc);
 
-void hll_gc_push_temp_root(hll_gc *gc, hll_value value);
-void hll_gc_pop_temp_root(hll_gc *gc);
+// Forbids moving objects until matching unpin. Regular collections can still
+// happen.
+void hll_gc_pin(hll_gc *gc);
+void hll_gc_unpin(hll_gc *gc);
+// Called by interpreter at points where all references to objects are
+// stored in its roots. Performs requested compacting collection, unless
+// objects are pinned.
+void hll_gc_safepoint(hll_gc *gc);
+
+// Handle scopes are used by native code to keep intermediate values alive
+// while it allocates. Scope marks current top of temp roots stack, and
+// closing it releases all handles created after it was opened. Handles are
+// indices into temp roots stack, so they stay valid when the stack grows.
+//
+// Scopes must be closed in reverse order of opening. Code that bails out
+// with hll_runtime_error does not need to close its scopes, interpreter
+// restores temp roots to the state it was entered with.
+typedef size_t hll_handle_scope;
+typedef size_t hll_handle;
+
+hll_handle_scope hll_gc_open_scope(hll_gc *gc);
+void hll_gc_close_scope(hll_gc *gc, hll_handle_scope scope);
+// Roots value until enclosing scope is closed.
+hll_handle hll_gc_handle(hll_gc *gc, hll_value value);
+hll_value hll_gc_get(const hll_gc *gc, hll_handle handle);
+void hll_gc_set(hll_gc *gc, hll_handle handle, hll_value value);
+
+// Collects garbage and moves all remaining objects to permanent space. Does
+// nothing if collection is forbidden.
+void hll_gc_freeze(hll_gc *gc);
+// Must be called after storing a value into heap object that may be
+// permanent.
+void hll_gc_write_barrier(hll_gc *gc, hll_value value);
+
+// Called for each new object. If object is sampled by heap profiler,
+// records its allocation site.
+void hll_gc_profile_obj(hll_gc *gc, struct hll_obj *obj);
+// Writes live sampled objects grouped by kind and allocation site using
+// write function of vm. Lines are sorted by site, so outputs taken at
+// different times can be compared with diff.
+void hll_gc_dump_profile(hll_gc *gc);
 
 // Garbage collector tracked allocation
 #define hll_gc_free(_vm, _ptr, _size) hll_gc_realloc(_vm, _ptr, _size, 0)
 #define hll_gc_alloc(_vm, _size) hll_gc_realloc(_vm, NULL, 0, _size)
 void *hll_gc_realloc(hll_gc *gc, void *ptr, size_t old_size, size_t new_size)
     __attribute__((alloc_size(4)));
+// Counts resize of memory owned by object that is allocated outside of
+// garbage collector, like entries of hash table. Unlike hll_gc_realloc, does
+// not trigger garbage collection, it happens on following allocation.
+void hll_gc_track(hll_gc *gc, size_t old_size, size_t new_size);
 
 #endif
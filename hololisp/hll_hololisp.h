@@ -62,6 +62,19 @@ typedef struct hll_config {
   // Default value is 50
   size_t heap_grow_percent;
 
+  // Heap profiling records allocation site of every Nth allocated object.
+  // Sampled objects can be summarized with hll_dump_heap_profile.
+  // Value of 0 disables profiling.
+  // Default value is 0
+  uint32_t heap_profile_rate;
+
+  // When garbage collection is due, live cons cells are copied into
+  // contiguous blocks in list order, so that traversing lists touches
+  // adjacent memory. Copying happens only between function calls, when no
+  // native code holds references to objects.
+  // Default value is true
+  bool compact_conses;
+
   // Any data user wants to be accessed through callback functions.
   void *user_data;
 } hll_config;
@@ -92,6 +105,20 @@ HLL_PUB struct hll_vm *hll_make_vm(const struct hll_config *config);
 // Deletes VM and frees all its data.
 HLL_PUB void hll_delete_vm(struct hll_vm *vm) __attribute__((nonnull));
 
+// Promotes all objects currently reachable in VM to permanent space.
+// Unreachable ones are collected first.
+// Permanent objects are never traced or freed by garbage collector, which
+// removes cost of marking long-lived data on each collection. VM calls this
+// after loading builtins. Embedders may call it after loading their own
+// long-lived code.
+HLL_PUB void hll_freeze_heap(struct hll_vm *vm) __attribute__((nonnull));
+
+// Runs garbage collection and prints live sampled objects grouped by kind and
+// allocation site using write_fn. Each line has the form
+// '<kind> <count> <bytes> <function> <file>:<line>:<column>', sorted by
+// site, so that two dumps can be compared with diff.
+HLL_PUB void hll_dump_heap_profile(struct hll_vm *vm) __attribute__((nonnull));
+
 // Runs given source as hololisp code.
 HLL_PUB hll_interpret_result hll_interpret(struct hll_vm *vm,
                                            const char *source, const char *name,
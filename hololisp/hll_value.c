@@ -1,6 +1,10 @@
 #include "hll_value.h"
 
 #include <assert.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "hll_bytecode.h"
@@ -11,8 +15,19 @@
 
 #define HLL_SIGN_BIT ((uint64_t)1 << 63)
 #define HLL_QNAN ((uint64_t)0x7ffc000000000000)
+// Integers are quiet NaNs with this bit set. The 49 bits below it hold
+// integer in two's complement. Pointers occupy only 48 bits and singletons
+// are small, so neither of them can have it set.
+#define HLL_INT_TAG ((uint64_t)1 << 49)
+#define HLL_INT_PAYLOAD (HLL_INT_TAG - 1)
 
-bool hll_is_num(hll_value value) { return (value & HLL_QNAN) != HLL_QNAN; }
+bool hll_is_int(hll_value value) {
+  return (value & (HLL_SIGN_BIT | HLL_QNAN | HLL_INT_TAG)) ==
+         (HLL_QNAN | HLL_INT_TAG);
+}
+bool hll_is_num(hll_value value) {
+  return (value & HLL_QNAN) != HLL_QNAN || hll_is_int(value);
+}
 bool hll_is_obj(hll_value value) {
   return (((value) & (HLL_QNAN | HLL_SIGN_BIT)) == (HLL_QNAN | HLL_SIGN_BIT));
 }
@@ -44,53 +59,137 @@ static uint32_t djb2(const char *src, const char *dst) {
 }
 
 const char *hll_get_value_kind_str(hll_value_kind kind) {
-  static const char *strs[] = {"num",  "nil",  "true", "cons",
-                               "symb", "bind", "env",  "func"};
+  static const char *strs[] = {"num", "nil",  "true", "cons", "symb",
+                               "bind", "env", "func", "vec",  "f64array",
+                               "hash", "str", "builder", "range"};
 
   assert(kind < sizeof(strs) / sizeof(strs[0]));
   return strs[kind];
 }
 
-void hll_free_obj(hll_vm *vm, hll_obj *obj) {
+// Returns size of buffer of string builder, which is counted in its size.
+static size_t get_builder_capacity(const hll_obj_builder *builder) {
+  return builder->bytes != NULL ? hll_sb_capacity(builder->bytes) : 0;
+}
+
+size_t hll_obj_size(const hll_obj *obj) {
+  size_t size = sizeof(hll_obj);
   switch (obj->kind) {
   case HLL_VALUE_CONS:
-    hll_gc_free(vm->gc, obj, sizeof(hll_obj) + sizeof(hll_obj_cons));
+    size += sizeof(hll_obj_cons);
     break;
   case HLL_VALUE_SYMB:
-    hll_gc_free(vm->gc, obj,
-                sizeof(hll_obj) + sizeof(hll_obj_symb) +
-                    ((hll_obj_symb *)obj->as)->length + 1);
+    size += sizeof(hll_obj_symb) + ((hll_obj_symb *)obj->as)->length + 1;
     break;
   case HLL_VALUE_BIND:
-    hll_gc_free(vm->gc, obj, sizeof(hll_obj) + sizeof(hll_obj_bind));
+    size += sizeof(hll_obj_bind);
     break;
   case HLL_VALUE_ENV:
-    hll_gc_free(vm->gc, obj, sizeof(hll_obj) + sizeof(hll_obj_env));
+    size += sizeof(hll_obj_env);
     break;
   case HLL_VALUE_FUNC:
-    hll_bytecode_dec_refcount(((hll_obj_func *)obj->as)->bytecode);
-    hll_gc_free(vm->gc, obj, sizeof(hll_obj) + sizeof(hll_obj_func));
+    size += sizeof(hll_obj_func);
+    break;
+  case HLL_VALUE_VEC:
+    size += sizeof(hll_obj_vec) +
+            ((hll_obj_vec *)obj->as)->length * sizeof(hll_value);
+    break;
+  case HLL_VALUE_F64ARRAY:
+    size += sizeof(hll_obj_f64array) +
+            ((hll_obj_f64array *)obj->as)->length * sizeof(double);
+    break;
+  case HLL_VALUE_HASH:
+    size += sizeof(hll_obj_hash) +
+            ((hll_obj_hash *)obj->as)->capacity * sizeof(hll_hash_entry);
+    break;
+  case HLL_VALUE_STR: {
+    const hll_obj_str *str = (const hll_obj_str *)obj->as;
+    size += sizeof(hll_obj_str);
+    if (str->parent == hll_nil()) {
+      size += str->length + 1;
+    }
+  } break;
+  case HLL_VALUE_BUILDER:
+    size += sizeof(hll_obj_builder) +
+            get_builder_capacity((const hll_obj_builder *)obj->as);
+    break;
+  case HLL_VALUE_RANGE:
+    size += sizeof(hll_obj_range);
     break;
   default:
     HLL_UNREACHABLE;
     break;
   }
+
+  return size;
+}
+
+void hll_free_obj(hll_vm *vm, hll_obj *obj) {
+  size_t size = hll_obj_size(obj);
+  if (obj->kind == HLL_VALUE_FUNC) {
+    hll_bytecode_dec_refcount(((hll_obj_func *)obj->as)->bytecode);
+  } else if (obj->kind == HLL_VALUE_HASH) {
+    hll_obj_hash *hash = (hll_obj_hash *)obj->as;
+    size_t entries_size = hash->capacity * sizeof(hll_hash_entry);
+    if (hash->entries != NULL) {
+      hll_free(hash->entries, entries_size);
+    }
+    // Entries are counted in size of object, but are allocated separately.
+    hll_gc_track(vm->gc, entries_size, 0);
+    size -= entries_size;
+  } else if (obj->kind == HLL_VALUE_BUILDER) {
+    hll_obj_builder *builder = (hll_obj_builder *)obj->as;
+    size_t bytes_size = get_builder_capacity(builder);
+    hll_sb_free(builder->bytes);
+    hll_gc_track(vm->gc, bytes_size, 0);
+    size -= bytes_size;
+  }
+  hll_gc_free(vm->gc, obj, size);
 }
 
 static void register_gc_obj(hll_vm *vm, hll_obj *obj) {
   obj->next_gc = vm->gc->all_objs;
   vm->gc->all_objs = obj;
+  hll_gc_profile_obj(vm->gc, obj);
 }
 
 hll_value hll_nil(void) { return nan_box_singleton(HLL_VALUE_NIL); }
 hll_value hll_true(void) { return nan_box_singleton(HLL_VALUE_TRUE); }
 
 hll_value hll_num(double num) {
+  // Negative zero is kept as double so that it is not lost.
+  if (num >= (double)HLL_INT_MIN && num <= (double)HLL_INT_MAX) {
+    int64_t integer = (int64_t)num;
+    if ((double)integer == num && !(integer == 0 && signbit(num))) {
+      return hll_int(integer);
+    }
+  }
+
+  // Payload of NaN can have any bits, including tags of other values.
+  if (num != num) {
+    num = NAN;
+  }
   hll_value value;
   memcpy(&value, &num, sizeof(hll_value));
   return value;
 }
 
+hll_value hll_int(int64_t num) {
+  if (HLL_UNLIKELY(num < HLL_INT_MIN || num > HLL_INT_MAX)) {
+    double promoted = (double)num;
+    hll_value value;
+    memcpy(&value, &promoted, sizeof(hll_value));
+    return value;
+  }
+
+  return HLL_QNAN | HLL_INT_TAG | ((uint64_t)num & HLL_INT_PAYLOAD);
+}
+
+uint32_t hll_symbol_hash(const char *symbol, size_t length) {
+  assert(length != 0);
+  return djb2(symbol, symbol + length);
+}
+
 hll_value hll_new_symbol(hll_vm *vm, const char *symbol, size_t length) {
   assert(symbol != NULL);
   assert(length != 0);
@@ -102,7 +201,7 @@ hll_value hll_new_symbol(hll_vm *vm, const char *symbol, size_t length) {
 
   hll_obj_symb *symb = (void *)(obj + 1);
   symb->length = length;
-  symb->hash = djb2(symbol, symbol + length);
+  symb->hash = hll_symbol_hash(symbol, length);
   memcpy(symb->symb, symbol, length);
   register_gc_obj(vm, obj);
 
@@ -163,6 +262,115 @@ hll_value hll_new_func(hll_vm *vm, hll_value params, hll_bytecode *bytecode) {
   return nan_box_ptr(obj);
 }
 
+hll_value hll_new_vec(hll_vm *vm, size_t length) {
+  void *memory = hll_gc_alloc(vm->gc, sizeof(hll_obj) + sizeof(hll_obj_vec) +
+                                          length * sizeof(hll_value));
+  hll_obj *obj = memory;
+  obj->kind = HLL_VALUE_VEC;
+  hll_obj_vec *vec = (void *)(obj + 1);
+  vec->length = length;
+  for (size_t i = 0; i < length; ++i) {
+    vec->items[i] = hll_nil();
+  }
+  register_gc_obj(vm, obj);
+
+  return nan_box_ptr(obj);
+}
+
+hll_value hll_new_f64array(hll_vm *vm, size_t length) {
+  void *memory = hll_gc_alloc(vm->gc, sizeof(hll_obj) +
+                                          sizeof(hll_obj_f64array) +
+                                          length * sizeof(double));
+  hll_obj *obj = memory;
+  obj->kind = HLL_VALUE_F64ARRAY;
+  hll_obj_f64array *array = (void *)(obj + 1);
+  array->length = length;
+  for (size_t i = 0; i < length; ++i) {
+    array->items[i] = 0;
+  }
+  register_gc_obj(vm, obj);
+
+  return nan_box_ptr(obj);
+}
+
+hll_value hll_new_hash(hll_vm *vm) {
+  void *memory = hll_gc_alloc(vm->gc, sizeof(hll_obj) + sizeof(hll_obj_hash));
+  hll_obj *obj = memory;
+  obj->kind = HLL_VALUE_HASH;
+  hll_obj_hash *hash = (void *)(obj + 1);
+  hash->count = 0;
+  hash->used = 0;
+  hash->capacity = 0;
+  hash->entries = NULL;
+  register_gc_obj(vm, obj);
+
+  return nan_box_ptr(obj);
+}
+
+hll_value hll_new_str(hll_vm *vm, const char *bytes, size_t length) {
+  void *memory =
+      hll_gc_alloc(vm->gc, sizeof(hll_obj) + sizeof(hll_obj_str) + length + 1);
+  hll_obj *obj = memory;
+  obj->kind = HLL_VALUE_STR;
+  hll_obj_str *str = (void *)(obj + 1);
+  str->length = length;
+  str->parent = hll_nil();
+  str->bytes = str->data;
+  if (bytes == NULL) {
+    memset(str->data, 0, length);
+  } else if (length != 0) {
+    memcpy(str->data, bytes, length);
+  }
+  str->data[length] = '\0';
+  register_gc_obj(vm, obj);
+
+  return nan_box_ptr(obj);
+}
+
+hll_value hll_new_str_view(hll_vm *vm, hll_value str, size_t offset,
+                           size_t length) {
+  assert(offset + length <= hll_unwrap_str(str)->length);
+  // Strings other than conses are not moved by garbage collector, so source
+  // string stays where it is if allocation triggers collection. It has to be
+  // reachable by caller though.
+  void *memory = hll_gc_alloc(vm->gc, sizeof(hll_obj) + sizeof(hll_obj_str));
+  hll_obj *obj = memory;
+  obj->kind = HLL_VALUE_STR;
+  hll_obj_str *view = (void *)(obj + 1);
+  hll_obj_str *source = hll_unwrap_str(str);
+  view->length = length;
+  view->parent = hll_is_nil(source->parent) ? str : source->parent;
+  view->bytes = source->bytes + offset;
+  register_gc_obj(vm, obj);
+
+  return nan_box_ptr(obj);
+}
+
+hll_value hll_new_builder(hll_vm *vm) {
+  void *memory =
+      hll_gc_alloc(vm->gc, sizeof(hll_obj) + sizeof(hll_obj_builder));
+  hll_obj *obj = memory;
+  obj->kind = HLL_VALUE_BUILDER;
+  ((hll_obj_builder *)(obj + 1))->bytes = NULL;
+  register_gc_obj(vm, obj);
+
+  return nan_box_ptr(obj);
+}
+
+hll_value hll_new_range(hll_vm *vm, int64_t start, int64_t step,
+                        size_t length) {
+  void *memory = hll_gc_alloc(vm->gc, sizeof(hll_obj) + sizeof(hll_obj_range));
+  hll_obj *obj = memory;
+  obj->kind = HLL_VALUE_RANGE;
+  hll_obj_range *range = (void *)(obj + 1);
+  range->start = start;
+  range->step = step;
+  range->length = length;
+  register_gc_obj(vm, obj);
+
+  return nan_box_ptr(obj);
+}
+
 hll_obj_cons *hll_unwrap_cons(hll_value value) {
   assert(hll_is_obj(value));
   hll_obj *obj = nan_unbox_ptr(value);
@@ -219,18 +427,72 @@ hll_obj_func *hll_unwrap_func(hll_value value) {
   return (hll_obj_func *)obj->as;
 }
 
+hll_obj_vec *hll_unwrap_vec(hll_value value) {
+  assert(hll_is_obj(value));
+  hll_obj *obj = nan_unbox_ptr(value);
+  assert(obj->kind == HLL_VALUE_VEC);
+  return (hll_obj_vec *)obj->as;
+}
+
+hll_obj_f64array *hll_unwrap_f64array(hll_value value) {
+  assert(hll_is_obj(value));
+  hll_obj *obj = nan_unbox_ptr(value);
+  assert(obj->kind == HLL_VALUE_F64ARRAY);
+  return (hll_obj_f64array *)obj->as;
+}
+
 double hll_unwrap_num(hll_value value) {
   assert(hll_is_num(value));
+  if (hll_is_int(value)) {
+    return (double)hll_unwrap_int(value);
+  }
+
   double result;
   memcpy(&result, &value, sizeof(hll_value));
   return result;
 }
 
+int64_t hll_unwrap_int(hll_value value) {
+  assert(hll_is_int(value));
+  // Sign-extend payload by moving its sign bit to the top.
+  return (int64_t)((value & HLL_INT_PAYLOAD) << 15) >> 15;
+}
+
 hll_obj *hll_unwrap_obj(hll_value value) {
   assert(hll_is_obj(value));
   return nan_unbox_ptr(value);
 }
 
+hll_value hll_wrap_obj(hll_obj *obj) { return nan_box_ptr(obj); }
+
+hll_obj_hash *hll_unwrap_hash(hll_value value) {
+  assert(hll_is_obj(value));
+  hll_obj *obj = nan_unbox_ptr(value);
+  assert(obj->kind == HLL_VALUE_HASH);
+  return (hll_obj_hash *)obj->as;
+}
+
+hll_obj_str *hll_unwrap_str(hll_value value) {
+  assert(hll_is_obj(value));
+  hll_obj *obj = nan_unbox_ptr(value);
+  assert(obj->kind == HLL_VALUE_STR);
+  return (hll_obj_str *)obj->as;
+}
+
+hll_obj_builder *hll_unwrap_builder(hll_value value) {
+  assert(hll_is_obj(value));
+  hll_obj *obj = nan_unbox_ptr(value);
+  assert(obj->kind == HLL_VALUE_BUILDER);
+  return (hll_obj_builder *)obj->as;
+}
+
+hll_obj_range *hll_unwrap_range(hll_value value) {
+  assert(hll_is_obj(value));
+  hll_obj *obj = nan_unbox_ptr(value);
+  assert(obj->kind == HLL_VALUE_RANGE);
+  return (hll_obj_range *)obj->as;
+}
+
 void hll_setcar(hll_value cons, hll_value car) {
   hll_unwrap_cons(cons)->car = car;
 }
@@ -250,6 +512,10 @@ size_t hll_list_length(hll_value value) {
 }
 
 hll_value_kind hll_get_value_kind(hll_value value) {
+  if (hll_is_num(value)) {
+    return HLL_VALUE_NUM;
+  }
+
   return hll_is_obj(value) ? nan_unbox_ptr(value)->kind
                            : nan_unbox_singleton(value);
 }
@@ -267,3 +533,209 @@ bool hll_is_symb(hll_value value) {
 bool hll_is_list(hll_value value) {
   return hll_is_cons(value) || hll_is_nil(value);
 }
+
+// Keys of empty and removed entries. These are quiet NaNs with payload that
+// neither arithmetic nor value constructors produce. They are not objects, so
+// garbage collector skips them.
+#define HLL_HASH_EMPTY (HLL_QNAN | 0xfe)
+#define HLL_HASH_TOMBSTONE (HLL_QNAN | 0xff)
+
+static bool is_str(hll_value value) {
+  return hll_get_value_kind(value) == HLL_VALUE_STR;
+}
+
+uint64_t hll_hash_value(hll_value key) {
+  if (hll_is_symb(key)) {
+    return hll_unwrap_symb(key)->hash;
+  }
+
+  // Strings are compared by contents, like symbols.
+  if (is_str(key)) {
+    hll_obj_str *str = hll_unwrap_str(key);
+    // djb2 expects at least one character.
+    return str->length != 0 ? djb2(str->bytes, str->bytes + str->length) : 0;
+  }
+
+  // Finalizer of splitmix64. Mixes high bits into low ones, which is
+  // important because pointers and small integers differ mostly in them.
+  uint64_t x = key;
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+static bool keys_equal(hll_value a, hll_value b) {
+  if (a == b) {
+    return true;
+  }
+
+  if (is_str(a) && is_str(b)) {
+    hll_obj_str *sa = hll_unwrap_str(a);
+    hll_obj_str *sb = hll_unwrap_str(b);
+    return sa->length == sb->length &&
+           memcmp(sa->bytes, sb->bytes, sa->length) == 0;
+  }
+
+  if (!hll_is_symb(a) || !hll_is_symb(b)) {
+    return false;
+  }
+
+  hll_obj_symb *sa = hll_unwrap_symb(a);
+  hll_obj_symb *sb = hll_unwrap_symb(b);
+  return sa->hash == sb->hash && sa->length == sb->length &&
+         memcmp(sa->symb, sb->symb, sa->length) == 0;
+}
+
+// Returns entry holding key, or entry where key should be inserted if there
+// is none. Table must have at least one empty entry.
+static hll_hash_entry *find_entry(hll_hash_entry *entries, size_t capacity,
+                                  hll_value key) {
+  size_t mask = capacity - 1;
+  size_t idx = hll_hash_value(key) & mask;
+  hll_hash_entry *tombstone = NULL;
+  for (;;) {
+    hll_hash_entry *entry = entries + idx;
+    if (entry->key == HLL_HASH_EMPTY) {
+      return tombstone != NULL ? tombstone : entry;
+    } else if (entry->key == HLL_HASH_TOMBSTONE) {
+      if (tombstone == NULL) {
+        tombstone = entry;
+      }
+    } else if (keys_equal(entry->key, key)) {
+      return entry;
+    }
+    idx = (idx + 1) & mask;
+  }
+}
+
+static void resize_hash(hll_obj_hash *hash, size_t capacity) {
+  hll_hash_entry *entries = hll_alloc(capacity * sizeof(hll_hash_entry));
+  for (size_t i = 0; i < capacity; ++i) {
+    entries[i].key = HLL_HASH_EMPTY;
+    entries[i].value = hll_nil();
+  }
+
+  for (size_t i = 0; i < hash->capacity; ++i) {
+    hll_hash_entry *entry = hash->entries + i;
+    if (hll_hash_entry_is_live(entry)) {
+      *find_entry(entries, capacity, entry->key) = *entry;
+    }
+  }
+
+  if (hash->entries != NULL) {
+    hll_free(hash->entries, hash->capacity * sizeof(hll_hash_entry));
+  }
+  hash->entries = entries;
+  hash->capacity = capacity;
+  hash->used = hash->count;
+}
+
+bool hll_hash_entry_is_live(const hll_hash_entry *entry) {
+  return entry->key != HLL_HASH_EMPTY && entry->key != HLL_HASH_TOMBSTONE;
+}
+
+hll_value *hll_hash_get(hll_value hash, hll_value key) {
+  hll_obj_hash *obj = hll_unwrap_hash(hash);
+  if (obj->count == 0) {
+    return NULL;
+  }
+
+  hll_hash_entry *entry = find_entry(obj->entries, obj->capacity, key);
+  return hll_hash_entry_is_live(entry) ? &entry->value : NULL;
+}
+
+void hll_hash_set(hll_vm *vm, hll_value hash, hll_value key,
+                  hll_value value) {
+  hll_obj_hash *obj = hll_unwrap_hash(hash);
+  // Keep load factor including tombstones under 3/4. If most of used entries
+  // are tombstones, table is rebuilt with the same capacity.
+  if (4 * (obj->used + 1) > 3 * obj->capacity) {
+    size_t capacity = obj->capacity == 0 ? 8 : obj->capacity;
+    if (4 * (obj->count + 1) > 3 * capacity / 2) {
+      capacity *= 2;
+    }
+    // Entries are counted as part of heap, so that large tables trigger
+    // garbage collection.
+    hll_gc_track(vm->gc, obj->capacity * sizeof(hll_hash_entry),
+                 capacity * sizeof(hll_hash_entry));
+    resize_hash(obj, capacity);
+  }
+
+  hll_hash_entry *entry = find_entry(obj->entries, obj->capacity, key);
+  if (!hll_hash_entry_is_live(entry)) {
+    if (entry->key == HLL_HASH_EMPTY) {
+      ++obj->used;
+    }
+    ++obj->count;
+    entry->key = key;
+  }
+  entry->value = value;
+  hll_gc_write_barrier(vm->gc, hash);
+}
+
+bool hll_hash_remove(hll_value hash, hll_value key) {
+  hll_obj_hash *obj = hll_unwrap_hash(hash);
+  if (obj->count == 0) {
+    return false;
+  }
+
+  hll_hash_entry *entry = find_entry(obj->entries, obj->capacity, key);
+  if (!hll_hash_entry_is_live(entry)) {
+    return false;
+  }
+
+  entry->key = HLL_HASH_TOMBSTONE;
+  entry->value = hll_nil();
+  --obj->count;
+  return true;
+}
+
+void hll_hash_rehash(hll_obj_hash *hash) {
+  if (hash->capacity != 0) {
+    resize_hash(hash, hash->capacity);
+  }
+}
+
+void hll_builder_append(hll_vm *vm, hll_value builder, const char *bytes,
+                        size_t length) {
+  hll_obj_builder *obj = hll_unwrap_builder(builder);
+  if (length == 0) {
+    return;
+  }
+
+  size_t old_capacity = get_builder_capacity(obj);
+  hll_sb_maybegrow(obj->bytes, length);
+  hll_gc_track(vm->gc, old_capacity, get_builder_capacity(obj));
+  memcpy(obj->bytes + hll_sb_size(obj->bytes), bytes, length);
+  hll_sb_size(obj->bytes) += length;
+}
+
+hll_value hll_range_item(const hll_obj_range *range, size_t idx) {
+  assert(idx < range->length);
+  return hll_int(range->start + (int64_t)idx * range->step);
+}
+
+size_t hll_format_num(char *buffer, size_t size, hll_value num) {
+  if (hll_is_int(num)) {
+    return snprintf(buffer, size, "%" PRId64, hll_unwrap_int(num));
+  }
+
+  // Integral doubles beyond integer range are printed in full. Otherwise use
+  // shortest representation that reads back as the same double.
+  double value = hll_unwrap_num(num);
+  if (value > -1e18 && value < 1e18 && value == (double)(long long)value) {
+    return snprintf(buffer, size, "%lld", (long long)value);
+  }
+
+  char text[32];
+  for (int precision = 15; precision <= 17; ++precision) {
+    snprintf(text, sizeof(text), "%.*g", precision, value);
+    if (strtod(text, NULL) == value) {
+      break;
+    }
+  }
+  return snprintf(buffer, size, "%s", text);
+}
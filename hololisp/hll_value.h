@@ -23,13 +23,33 @@ enum {
   HLL_VALUE_BIND = 0x5,
   HLL_VALUE_ENV = 0x6,
   HLL_VALUE_FUNC = 0x7,
+  HLL_VALUE_VEC = 0x8,
+  HLL_VALUE_F64ARRAY = 0x9,
+  HLL_VALUE_HASH = 0xA,
+  HLL_VALUE_STR = 0xB,
+  HLL_VALUE_BUILDER = 0xC,
+  HLL_VALUE_RANGE = 0xD,
+  // Number of value kinds. Must be last.
+  HLL_VALUE_KIND_COUNT
 };
 
 HLL_PUB const char *hll_get_value_kind_str(hll_value_kind kind);
 
 typedef struct hll_obj {
   hll_value_kind kind;
-  bool is_dark;
+  bool is_dark : 1;
+  // Object has been promoted to permanent space. Permanent objects are neither
+  // traced nor swept by garbage collector.
+  bool is_perm : 1;
+  // Permanent object has been written to after promotion and is stored in
+  // remembered set of garbage collector.
+  bool is_remembered : 1;
+  // Cons has been copied by compacting collection. Its car holds the new
+  // location.
+  bool is_forwarded : 1;
+  // Index of allocation site in heap profiler plus one. Zero if object was
+  // not sampled. Occupies header padding, so it costs no memory.
+  uint32_t profile_site;
   struct hll_obj *next_gc;
   char as[];
 } hll_obj;
@@ -55,6 +75,66 @@ typedef struct hll_obj_bind {
   hll_value (*bind)(struct hll_vm *vm, hll_value args);
 } hll_obj_bind;
 
+typedef struct hll_obj_vec {
+  size_t length;
+  hll_value items[];
+} hll_obj_vec;
+
+// Dense array of doubles. Items are not values, so garbage collector does not
+// look into them.
+typedef struct hll_obj_f64array {
+  size_t length;
+  double items[];
+} hll_obj_f64array;
+
+typedef struct hll_hash_entry {
+  hll_value key;
+  hll_value value;
+} hll_hash_entry;
+
+// Hash table with open addressing and linear probing. Numbers are hashed by
+// their bit pattern, symbols by their name (symbols are not interned) and
+// other objects by identity.
+// Entries are stored in separate allocation, so that table can grow without
+// object being moved.
+typedef struct hll_obj_hash {
+  // Number of live entries.
+  size_t count;
+  // Number of live entries and tombstones left by removal. Table grows when
+  // it becomes too high.
+  size_t used;
+  // Number of entries. Either zero or a power of two.
+  size_t capacity;
+  hll_hash_entry *entries;
+} hll_obj_hash;
+
+// Immutable byte string. Text is stored as is, so UTF-8 input stays UTF-8
+// and length is measured in bytes.
+// Strings either own their bytes, which are then stored inline after the
+// structure and are zero-terminated, or are views into bytes of other string.
+// View keeps string it points into alive. Views never point to other views.
+typedef struct hll_obj_str {
+  size_t length;
+  // String that owns bytes of view. Nil for owning strings.
+  hll_value parent;
+  const char *bytes;
+  char data[];
+} hll_obj_str;
+
+// Mutable buffer used to build strings by appending pieces to it.
+typedef struct hll_obj_builder {
+  // Stretchy buffer of bytes appended so far. Not zero-terminated.
+  char *bytes;
+} hll_obj_builder;
+
+// Lazy sequence of integers start, start + step, ... of given length. Items
+// are computed when sequence is iterated, so it takes constant memory.
+typedef struct hll_obj_range {
+  int64_t start;
+  int64_t step;
+  size_t length;
+} hll_obj_range;
+
 typedef struct hll_obj_symb {
   size_t length;
   uint32_t hash;
@@ -67,10 +147,21 @@ typedef struct hll_obj_symb {
 
 HLL_PUB hll_value hll_nil(void);
 HLL_PUB hll_value hll_true(void);
+// Range of integers that are stored as immediate values. Integral doubles
+// in this range are stored as integers too, so each number has exactly one
+// representation and numbers can be compared bitwise.
+#define HLL_INT_MIN (-((int64_t)1 << 48))
+#define HLL_INT_MAX (((int64_t)1 << 48) - 1)
+
 HLL_PUB hll_value hll_num(double value);
+// Creates number from integer. Integers outside of [HLL_INT_MIN, HLL_INT_MAX]
+// are promoted to doubles and may lose precision.
+HLL_PUB hll_value hll_int(int64_t value);
 HLL_PUB hll_value hll_new_symbol(struct hll_vm *vm, const char *symbol,
                                  size_t length);
 HLL_PUB hll_value hll_new_symbolz(struct hll_vm *vm, const char *symbol);
+// Returns hash of symbol with given name without creating it.
+uint32_t hll_symbol_hash(const char *symbol, size_t length);
 HLL_PUB hll_value hll_new_cons(struct hll_vm *vm, hll_value car, hll_value cdr);
 HLL_PUB hll_value hll_new_env(struct hll_vm *vm, hll_value up, hll_value vars);
 HLL_PUB hll_value hll_new_bind(struct hll_vm *vm,
@@ -78,6 +169,21 @@ HLL_PUB hll_value hll_new_bind(struct hll_vm *vm,
                                                  hll_value args));
 HLL_PUB hll_value hll_new_func(struct hll_vm *vm, hll_value params,
                                struct hll_bytecode *bytecode);
+// Creates vector of given length with all items set to nil.
+HLL_PUB hll_value hll_new_vec(struct hll_vm *vm, size_t length);
+// Creates f64array of given length with all items set to zero.
+HLL_PUB hll_value hll_new_f64array(struct hll_vm *vm, size_t length);
+HLL_PUB hll_value hll_new_hash(struct hll_vm *vm);
+// Creates string owning a copy of given bytes. If bytes is NULL, string is
+// filled with zeroes, so caller can write contents to its data.
+HLL_PUB hll_value hll_new_str(struct hll_vm *vm, const char *bytes,
+                              size_t length);
+// Creates string sharing bytes with given string. Range must be within it.
+HLL_PUB hll_value hll_new_str_view(struct hll_vm *vm, hll_value str,
+                                   size_t offset, size_t length);
+HLL_PUB hll_value hll_new_builder(struct hll_vm *vm);
+HLL_PUB hll_value hll_new_range(struct hll_vm *vm, int64_t start,
+                                int64_t step, size_t length);
 
 //
 // Unwrapper functions.
@@ -85,7 +191,9 @@ HLL_PUB hll_value hll_new_func(struct hll_vm *vm, hll_value params,
 // If value type is not equal to expected, panic.
 //
 
+// Returns value of any number as double.
 HLL_PUB double hll_unwrap_num(hll_value value);
+HLL_PUB int64_t hll_unwrap_int(hll_value value);
 HLL_PUB hll_value hll_unwrap_cdr(hll_value value);
 HLL_PUB hll_value hll_unwrap_car(hll_value value);
 HLL_PUB void hll_setcar(hll_value cons, hll_value car);
@@ -102,8 +210,24 @@ HLL_PUB hll_obj_bind *hll_unwrap_bind(hll_value value)
     __attribute__((returns_nonnull));
 HLL_PUB hll_obj_func *hll_unwrap_func(hll_value value)
     __attribute__((returns_nonnull));
+HLL_PUB hll_obj_vec *hll_unwrap_vec(hll_value value)
+    __attribute__((returns_nonnull));
+HLL_PUB hll_obj_f64array *hll_unwrap_f64array(hll_value value)
+    __attribute__((returns_nonnull));
+HLL_PUB hll_obj_hash *hll_unwrap_hash(hll_value value)
+    __attribute__((returns_nonnull));
+HLL_PUB hll_obj_str *hll_unwrap_str(hll_value value)
+    __attribute__((returns_nonnull));
+HLL_PUB hll_obj_builder *hll_unwrap_builder(hll_value value)
+    __attribute__((returns_nonnull));
+HLL_PUB hll_obj_range *hll_unwrap_range(hll_value value)
+    __attribute__((returns_nonnull));
 
 hll_obj *hll_unwrap_obj(hll_value value);
+hll_value hll_wrap_obj(hll_obj *obj);
+// Returns number of bytes occupied by object, including header and buffers
+// owned by it.
+size_t hll_obj_size(const hll_obj *obj);
 void hll_free_obj(struct hll_vm *vm, hll_obj *obj);
 
 //
@@ -115,6 +239,8 @@ void hll_free_obj(struct hll_vm *vm, hll_obj *obj);
 HLL_PUB hll_value_kind hll_get_value_kind(hll_value value);
 HLL_PUB bool hll_is_nil(hll_value value);
 HLL_PUB bool hll_is_num(hll_value value);
+// Tells whether number is stored as an integer immediate.
+HLL_PUB bool hll_is_int(hll_value value);
 HLL_PUB bool hll_is_cons(hll_value value);
 HLL_PUB bool hll_is_symb(hll_value value);
 HLL_PUB bool hll_is_list(hll_value value);
@@ -123,4 +249,35 @@ bool hll_is_obj(hll_value value);
 
 HLL_PUB size_t hll_list_length(hll_value value);
 
+//
+// Hash table functions.
+//
+
+// Returns hash of key. Symbols and strings are hashed by contents, other
+// values bitwise.
+uint64_t hll_hash_value(hll_value key);
+// Returns pointer to value stored under key or NULL if there is none. Pointer
+// is invalidated by following insertions.
+HLL_PUB hll_value *hll_hash_get(hll_value hash, hll_value key);
+// Inserts or replaces value under key. Does not trigger garbage collection.
+HLL_PUB void hll_hash_set(struct hll_vm *vm, hll_value hash, hll_value key,
+                          hll_value value);
+// Returns true if key was present.
+HLL_PUB bool hll_hash_remove(hll_value hash, hll_value key);
+// Tells whether entry holds a key, as opposed to being empty or removed.
+HLL_PUB bool hll_hash_entry_is_live(const hll_hash_entry *entry);
+// Rebuilds table in place. Needed after objects used as keys have been moved.
+void hll_hash_rehash(hll_obj_hash *hash);
+
+// Appends bytes to string builder. Does not trigger garbage collection.
+HLL_PUB void hll_builder_append(struct hll_vm *vm, hll_value builder,
+                                const char *bytes, size_t length);
+
+// Returns item of range at given index. Index must be less than length.
+HLL_PUB hll_value hll_range_item(const hll_obj_range *range, size_t idx);
+
+// Writes text representation of number to buffer. Text is truncated to fit
+// buffer. Returns length of full representation, like snprintf.
+HLL_PUB size_t hll_format_num(char *buffer, size_t size, hll_value num);
+
 #endif
@@ -35,6 +35,8 @@ void hll_initialize_default_config(hll_config *config) {
   config->heap_size = 10 << 20;
   config->min_heap_size = 1 << 20;
   config->heap_grow_percent = 50;
+  config->heap_profile_rate = 0;
+  config->compact_conses = true;
 
   config->user_data = NULL;
 }
@@ -42,10 +44,20 @@ void hll_initialize_default_config(hll_config *config) {
 void hll_add_variable(hll_vm *vm, hll_value env, hll_value name,
                       hll_value value) {
   assert(hll_is_symb(name));
-  hll_value slot = hll_new_cons(vm, name, value);
-  hll_gc_push_temp_root(vm->gc, slot);
-  hll_unwrap_env(env)->vars = hll_new_cons(vm, slot, hll_unwrap_env(env)->vars);
-  hll_gc_pop_temp_root(vm->gc); // slot
+  // Link variable cell into env first, so it is reachable when slot is
+  // allocated. Garbage collector does not care that its car is nil for a
+  // moment.
+  hll_value cell = hll_new_cons(vm, hll_nil(), hll_unwrap_env(env)->vars);
+  hll_unwrap_env(env)->vars = cell;
+  hll_gc_write_barrier(vm->gc, env);
+  hll_unwrap_cons(cell)->car = hll_new_cons(vm, name, value);
+
+  if (env == vm->global_env) {
+    hll_value *native_idx = hll_hash_get(vm->native_names, name);
+    if (native_idx != NULL) {
+      vm->natives[hll_unwrap_int(*native_idx)].is_shadowed = true;
+    }
+  }
 }
 
 hll_vm *hll_make_vm(const hll_config *config) {
@@ -61,18 +73,32 @@ hll_vm *hll_make_vm(const hll_config *config) {
   vm->gc = hll_make_gc(vm);
   vm->debug = hll_make_debug(vm, HLL_DEBUG_DIAGNOSTICS_COLORED);
   vm->rng_state = rand();
+  hll_init_special_symbs(vm);
 
   vm->global_env = hll_new_env(vm, hll_nil(), hll_nil());
-  vm->macro_env = hll_new_env(vm, hll_nil(), hll_nil());
+  vm->macros = hll_new_hash(vm);
+  vm->native_names = hll_new_hash(vm);
+  vm->fused_bind = hll_nil();
   vm->env = vm->global_env;
 
   add_builtins(vm);
+  // Builtins and prelude live as long as vm does. Move them out of the way of
+  // garbage collector.
+  hll_freeze_heap(vm);
   return vm;
 }
 
+void hll_freeze_heap(hll_vm *vm) { hll_gc_freeze(vm->gc); }
+
+void hll_dump_heap_profile(hll_vm *vm) {
+  hll_gc_collect(vm->gc);
+  hll_gc_dump_profile(vm->gc);
+}
+
 void hll_delete_vm(hll_vm *vm) {
   hll_delete_debug(vm->debug);
   hll_delete_gc(vm->gc);
+  hll_sb_free(vm->natives);
   hll_free(vm, sizeof(hll_vm));
 }
 
@@ -105,15 +131,19 @@ hll_interpret_result hll_interpret(hll_vm *vm, const char *source,
 
 void hll_add_binding(hll_vm *vm, const char *symb_str,
                      hll_value (*bind_func)(hll_vm *vm, hll_value args)) {
-  hll_value bind = hll_new_bind(vm, bind_func);
-  hll_gc_push_temp_root(vm->gc, bind);
-  hll_value symb = hll_new_symbolz(vm, symb_str);
-  hll_gc_push_temp_root(vm->gc, symb);
-
-  hll_add_variable(vm, vm->global_env, symb, bind);
-
-  hll_gc_pop_temp_root(vm->gc); // bind
-  hll_gc_pop_temp_root(vm->gc); // symb
+  hll_handle_scope scope = hll_gc_open_scope(vm->gc);
+  hll_handle bind = hll_gc_handle(vm->gc, hll_new_bind(vm, bind_func));
+  hll_handle symb = hll_gc_handle(vm->gc, hll_new_symbolz(vm, symb_str));
+  hll_add_variable(vm, vm->global_env, hll_gc_get(vm->gc, symb),
+                   hll_gc_get(vm->gc, bind));
+
+  hll_native native = {
+      .var = hll_unwrap_car(hll_unwrap_env(vm->global_env)->vars),
+      .bind = hll_gc_get(vm->gc, bind)};
+  hll_sb_push(vm->natives, native);
+  hll_hash_set(vm, vm->native_names, hll_gc_get(vm->gc, symb),
+               hll_int(hll_sb_len(vm->natives) - 1));
+  hll_gc_close_scope(vm->gc, scope);
 }
 
 bool hll_find_var(hll_value env, hll_value car, hll_value *found) {
@@ -168,7 +198,7 @@ void hll_print_value(hll_vm *vm, hll_value value) {
     break;
   case HLL_VALUE_NUM: {
     char buffer[128];
-    snprintf(buffer, sizeof(buffer), "%lld", (long long)hll_unwrap_num(value));
+    hll_format_num(buffer, sizeof(buffer), value);
     hll_print(vm, buffer);
   } break;
   case HLL_VALUE_TRUE:
@@ -183,6 +213,78 @@ void hll_print_value(hll_vm *vm, hll_value value) {
   case HLL_VALUE_FUNC:
     hll_print(vm, "func");
     break;
+  case HLL_VALUE_VEC: {
+    hll_obj_vec *vec = hll_unwrap_vec(value);
+    hll_print(vm, "#(");
+    for (size_t i = 0; i < vec->length; ++i) {
+      if (i != 0) {
+        hll_print(vm, " ");
+      }
+      hll_print_value(vm, vec->items[i]);
+    }
+    hll_print(vm, ")");
+  } break;
+  case HLL_VALUE_F64ARRAY: {
+    hll_obj_f64array *array = hll_unwrap_f64array(value);
+    hll_print(vm, "#f64(");
+    for (size_t i = 0; i < array->length; ++i) {
+      if (i != 0) {
+        hll_print(vm, " ");
+      }
+      hll_print_value(vm, hll_num(array->items[i]));
+    }
+    hll_print(vm, ")");
+  } break;
+  case HLL_VALUE_HASH: {
+    hll_obj_hash *hash = hll_unwrap_hash(value);
+    hll_print(vm, "#hash(");
+    bool is_first = true;
+    for (size_t i = 0; i < hash->capacity; ++i) {
+      hll_hash_entry *entry = hash->entries + i;
+      if (!hll_hash_entry_is_live(entry)) {
+        continue;
+      }
+      if (!is_first) {
+        hll_print(vm, " ");
+      }
+      is_first = false;
+      hll_print(vm, "(");
+      hll_print_value(vm, entry->key);
+      hll_print(vm, " . ");
+      hll_print_value(vm, entry->value);
+      hll_print(vm, ")");
+    }
+    hll_print(vm, ")");
+  } break;
+  case HLL_VALUE_STR: {
+    // Views are not zero-terminated, so text is printed in chunks.
+    hll_obj_str *str = hll_unwrap_str(value);
+    char buffer[256];
+    for (size_t offset = 0; offset < str->length;) {
+      size_t chunk = str->length - offset;
+      if (chunk > sizeof(buffer) - 1) {
+        chunk = sizeof(buffer) - 1;
+      }
+      memcpy(buffer, str->bytes + offset, chunk);
+      buffer[chunk] = '\0';
+      hll_print(vm, buffer);
+      offset += chunk;
+    }
+  } break;
+  case HLL_VALUE_BUILDER:
+    hll_print(vm, "builder");
+    break;
+  case HLL_VALUE_RANGE: {
+    hll_obj_range *range = hll_unwrap_range(value);
+    hll_print(vm, "#range(");
+    hll_print_value(vm, hll_int(range->start));
+    hll_print(vm, " ");
+    hll_print_value(
+        vm, hll_int(range->start + (int64_t)range->length * range->step));
+    hll_print(vm, " ");
+    hll_print_value(vm, hll_int(range->step));
+    hll_print(vm, ")");
+  } break;
   default:
     HLL_UNREACHABLE;
     break;
@@ -199,13 +301,23 @@ hll_runtime_error(hll_vm *vm, const char *fmt, ...) {
   longjmp(vm->err_jmp, 1);
 }
 
-static void call_func(hll_vm *vm, hll_value callable, hll_value args,
-                      hll_call_frame **current_call_frame, bool mbtr) {
+// Calls callable with arguments list located on top of the stack.
+// Both stay on the stack until call is set up, so they are reachable by
+// garbage collector while new environment is being populated.
+static void call_func(hll_vm *vm, hll_call_frame **current_call_frame,
+                      bool mbtr) {
+  if (HLL_UNLIKELY(vm->gc->compact_requested)) {
+    hll_gc_safepoint(vm->gc);
+  }
+
+  assert(hll_sb_len(vm->stack) >= 2);
+  hll_value callable = (&hll_sb_last(vm->stack))[-1];
+  hll_value args = hll_sb_last(vm->stack);
   switch (hll_get_value_kind(callable)) {
   case HLL_VALUE_FUNC: {
     hll_obj_func *func = hll_unwrap_func(callable);
     hll_value new_env = hll_new_env(vm, func->env, hll_nil());
-    hll_gc_push_temp_root(vm->gc, new_env);
+    hll_sb_push(vm->stack, new_env);
     hll_value param_name = func->param_names;
     hll_value param_value = args;
     if (hll_is_cons(param_name) && hll_is_symb(hll_unwrap_car(param_name))) {
@@ -241,14 +353,16 @@ static void call_func(hll_vm *vm, hll_value callable, hll_value args,
       hll_sb_push(vm->call_stack, new_frame);
     }
     *current_call_frame = &hll_sb_last(vm->call_stack);
-    hll_gc_pop_temp_root(vm->gc); // new_env
     vm->env = new_env;
+    hll_sb_size(vm->stack) -= 3;
   } break;
   case HLL_VALUE_BIND: {
-    hll_push_forbid_gc(vm->gc);
     hll_value result = hll_unwrap_bind(callable)->bind(vm, args);
-    hll_pop_forbid_gc(vm->gc);
+    hll_sb_size(vm->stack) -= 2;
     hll_sb_push(vm->stack, result);
+    // Builtin may have called back to interpreter, which could reallocate
+    // call stack.
+    *current_call_frame = &hll_sb_last(vm->call_stack);
   } break;
   default:
     hll_runtime_error(vm, "object is not callable (got %s)",
@@ -257,30 +371,110 @@ static void call_func(hll_vm *vm, hll_value callable, hll_value args,
   }
 }
 
-hll_value hll_interpret_bytecode_internal(hll_vm *vm, hll_value env_,
-                                          hll_value compiled) {
-  // Setup setjump for error handling
-  if (setjmp(vm->err_jmp) == 1) {
-    goto bail;
+// Calls native with arguments on top of stack. If variable of native was
+// redefined, falls back to calling its current value.
+static void call_native(hll_vm *vm, hll_call_frame **current_call_frame,
+                        uint32_t idx, size_t arg_count) {
+  if (HLL_UNLIKELY(vm->gc->compact_requested)) {
+    hll_gc_safepoint(vm->gc);
   }
 
-  hll_gc_push_temp_root(vm->gc, compiled);
-  hll_bytecode *initial_bytecode = hll_unwrap_func(compiled)->bytecode;
-  vm->call_stack = NULL;
-  vm->stack = NULL;
-  vm->env = env_;
+  // Arguments are gathered into list in place of the first one, so that
+  // they stay on stack while conses are allocated.
+  size_t base = hll_sb_len(vm->stack) - arg_count;
+  if (arg_count == 0) {
+    hll_sb_push(vm->stack, hll_nil());
+  } else {
+    hll_value cons = hll_new_cons(vm, hll_sb_last(vm->stack), hll_nil());
+    hll_sb_last(vm->stack) = cons;
+    for (size_t i = hll_sb_len(vm->stack) - 1; i-- > base;) {
+      cons = hll_new_cons(vm, vm->stack[i], vm->stack[i + 1]);
+      vm->stack[i] = cons;
+    }
+    hll_sb_size(vm->stack) = base + 1;
+  }
 
-  {
-    hll_call_frame original_frame = {0};
-    original_frame.ip = initial_bytecode->ops;
-    original_frame.bytecode = initial_bytecode;
-    original_frame.env = env_;
-    original_frame.func = compiled;
-    hll_sb_push(vm->call_stack, original_frame);
+  hll_native *native = vm->natives + idx;
+  if (HLL_LIKELY(!native->is_shadowed &&
+                 hll_unwrap_cdr(native->var) == native->bind)) {
+    hll_value result =
+        hll_unwrap_bind(native->bind)->bind(vm, hll_sb_last(vm->stack));
+    hll_sb_last(vm->stack) = result;
+    // Builtin may have called back to interpreter, which could reallocate
+    // call stack.
+    *current_call_frame = &hll_sb_last(vm->call_stack);
+    return;
+  }
+
+  hll_value found;
+  bool is_found = hll_find_var(vm->env, hll_unwrap_car(native->var), &found);
+  assert(is_found);
+  (void)is_found;
+  hll_value args = hll_sb_last(vm->stack);
+  hll_sb_last(vm->stack) = hll_unwrap_cdr(found);
+  hll_sb_push(vm->stack, args);
+  call_func(vm, current_call_frame, false);
+}
+
+// Returns pointer to vector item referenced by operands of VREF and VSET.
+static hll_value *get_vec_item(hll_vm *vm, hll_value vec, hll_value idx) {
+  if (HLL_UNLIKELY(hll_get_value_kind(vec) != HLL_VALUE_VEC)) {
+    hll_runtime_error(vm, "operand of vector access is not a vector (got %s)",
+                      hll_get_value_kind_str(hll_get_value_kind(vec)));
+  }
+  if (HLL_UNLIKELY(!hll_is_num(idx))) {
+    hll_runtime_error(vm, "vector index is not a number (got %s)",
+                      hll_get_value_kind_str(hll_get_value_kind(idx)));
   }
-  hll_call_frame *current_call_frame = vm->call_stack;
 
-  while (hll_sb_len(vm->call_stack)) {
+  // Integral numbers are always stored as integers, so numbers of other
+  // representation cannot be valid indices.
+  hll_obj_vec *obj = hll_unwrap_vec(vec);
+  if (HLL_UNLIKELY(!hll_is_int(idx) || hll_unwrap_int(idx) < 0 ||
+                   (uint64_t)hll_unwrap_int(idx) >= obj->length)) {
+    hll_runtime_error(vm, "vector index %g is out of bounds (length %zu)",
+                      hll_unwrap_num(idx), obj->length);
+  }
+
+  return obj->items + hll_unwrap_int(idx);
+}
+
+// Reads varint constant index and advances instruction pointer past it.
+static uint32_t read_const_idx(hll_call_frame *frame) {
+  uint32_t idx = 0;
+  uint8_t byte;
+  do {
+    byte = *frame->ip++;
+    idx = idx << 7 | (byte & 0x7F);
+  } while (HLL_UNLIKELY(byte & 0x80));
+  return idx;
+}
+
+// Reads operand of jump instruction and advances instruction pointer past it.
+// Wide operands take 4 bytes.
+static uint32_t read_jump_operand(hll_call_frame *frame, bool is_wide) {
+  const uint8_t *ip = frame->ip;
+  if (is_wide) {
+    frame->ip += 4;
+    return ((uint32_t)ip[0] << 24) | ((uint32_t)ip[1] << 16) |
+           ((uint32_t)ip[2] << 8) | ip[3];
+  }
+  frame->ip += 2;
+  return (ip[0] << 8) | ip[1];
+}
+
+// Reads two's complement jump offset.
+static int32_t read_jump_offset(hll_call_frame *frame, bool is_wide) {
+  uint32_t operand = read_jump_operand(frame, is_wide);
+  return is_wide ? (int32_t)operand : (int16_t)operand;
+}
+
+// Runs bytecode until call stack shrinks to given depth.
+static void execute(hll_vm *vm, size_t base_depth) {
+  hll_call_frame *current_call_frame = &hll_sb_last(vm->call_stack);
+  // Set by wide prefix for the next instruction.
+  bool is_wide = false;
+  while (hll_sb_len(vm->call_stack) > base_depth) {
     uint8_t op = *current_call_frame->ip++;
     switch (op) {
     case HLL_BC_END:
@@ -301,22 +495,18 @@ hll_value hll_interpret_bytecode_internal(hll_vm *vm, hll_value env_,
       hll_sb_push(vm->stack, hll_true());
       break;
     case HLL_BC_CONST: {
-      uint16_t idx =
-          (current_call_frame->ip[0] << 8) | current_call_frame->ip[1];
-      current_call_frame->ip += 2;
+      uint32_t idx = read_const_idx(current_call_frame);
       assert(idx < hll_sb_len(current_call_frame->bytecode->constant_pool));
       hll_value value = current_call_frame->bytecode->constant_pool[idx];
       hll_sb_push(vm->stack, value);
     } break;
     case HLL_BC_APPEND: {
       assert(hll_sb_len(vm->stack) >= 3);
-      hll_value *headp = &hll_sb_last(vm->stack) + -2;
-      hll_value *tailp = &hll_sb_last(vm->stack) + -1;
-      assert(hll_sb_len(vm->stack) != 0);
-      hll_value obj = hll_sb_pop(vm->stack);
-      hll_gc_push_temp_root(vm->gc, obj);
-
-      hll_value cons = hll_new_cons(vm, obj, hll_nil());
+      // Appended object stays on stack while cons is allocated.
+      hll_value cons = hll_new_cons(vm, hll_sb_last(vm->stack), hll_nil());
+      (void)hll_sb_pop(vm->stack);
+      hll_value *headp = &hll_sb_last(vm->stack) + -1;
+      hll_value *tailp = &hll_sb_last(vm->stack);
       if (hll_is_nil(*headp)) {
         *headp = *tailp = cons;
       } else {
@@ -325,14 +515,14 @@ hll_value hll_interpret_bytecode_internal(hll_vm *vm, hll_value env_,
                             "tail operand of APPEND is not a cons (found %s)",
                             hll_get_value_kind_str(hll_get_value_kind(*tailp)));
         }
+        // Tail is always created by previous APPEND, so it can't be
+        // permanent and write barrier is not needed.
         hll_unwrap_cons(*tailp)->cdr = cons;
         *tailp = cons;
       }
-      hll_gc_pop_temp_root(vm->gc); // obj
     } break;
     case HLL_BC_FIND: {
       hll_value symb = hll_sb_pop(vm->stack);
-      hll_gc_push_temp_root(vm->gc, symb);
       if (HLL_UNLIKELY(hll_get_value_kind(symb) != HLL_VALUE_SYMB)) {
         hll_runtime_error(vm, "operand of FIND is not a symb (found %s)",
                           hll_get_value_kind_str(hll_get_value_kind(symb)));
@@ -343,15 +533,12 @@ hll_value hll_interpret_bytecode_internal(hll_vm *vm, hll_value env_,
       if (HLL_UNLIKELY(!is_found)) {
         hll_runtime_error(vm, "failed to find variable '%s' in current scope",
                           hll_unwrap_zsymb(symb));
-        goto bail;
+        return;
       }
-      hll_gc_pop_temp_root(vm->gc); // symb
       hll_sb_push(vm->stack, found);
     } break;
     case HLL_BC_MAKEFUN: {
-      uint16_t idx =
-          (current_call_frame->ip[0] << 8) | current_call_frame->ip[1];
-      current_call_frame->ip += 2;
+      uint32_t idx = read_const_idx(current_call_frame);
       assert(idx < hll_sb_len(current_call_frame->bytecode->constant_pool));
 
       hll_value value = current_call_frame->bytecode->constant_pool[idx];
@@ -362,50 +549,63 @@ hll_value hll_interpret_bytecode_internal(hll_vm *vm, hll_value env_,
 
       hll_sb_push(vm->stack, value);
     } break;
-    case HLL_BC_MBTRCALL: {
-      hll_value args = hll_sb_pop(vm->stack);
-      hll_gc_push_temp_root(vm->gc, args);
-      hll_value callable = hll_sb_pop(vm->stack);
-      hll_gc_push_temp_root(vm->gc, callable);
-
-      call_func(vm, callable, args, &current_call_frame, true);
-
-      hll_gc_pop_temp_root(vm->gc); // args
-      hll_gc_pop_temp_root(vm->gc); // callable
+    case HLL_BC_MBTRCALL:
+      call_func(vm, &current_call_frame, true);
+      break;
+    case HLL_BC_CALL:
+      call_func(vm, &current_call_frame, false);
+      break;
+    case HLL_BC_CALLNATIVE: {
+      uint32_t idx = read_const_idx(current_call_frame);
+      uint8_t arg_count = *current_call_frame->ip++;
+      assert(idx < hll_sb_len(vm->natives));
+      assert(hll_sb_len(vm->stack) >= arg_count);
+      call_native(vm, &current_call_frame, idx, arg_count);
     } break;
-    case HLL_BC_CALL: {
-      hll_value args = hll_sb_pop(vm->stack);
-      hll_gc_push_temp_root(vm->gc, args);
-      hll_value callable = hll_sb_pop(vm->stack);
-      hll_gc_push_temp_root(vm->gc, callable);
+    case HLL_BC_JN:
+    case HLL_BC_JT: {
+      int32_t offset = read_jump_offset(current_call_frame, is_wide);
 
-      call_func(vm, callable, args, &current_call_frame, false);
-
-      hll_gc_pop_temp_root(vm->gc); // args
-      hll_gc_pop_temp_root(vm->gc); // callable
+      assert(hll_sb_len(vm->stack) != 0);
+      hll_value cond = hll_sb_pop(vm->stack);
+      if (hll_is_nil(cond) == (op == HLL_BC_JN)) {
+        current_call_frame->ip += offset;
+        assert(current_call_frame->ip >= current_call_frame->bytecode->ops &&
+               current_call_frame->ip <=
+                   &hll_sb_last(current_call_frame->bytecode->ops));
+      }
     } break;
-    case HLL_BC_JN: {
-      uint16_t offset =
-          (current_call_frame->ip[0] << 8) | current_call_frame->ip[1];
-      current_call_frame->ip += 2;
+    case HLL_BC_JTK: {
+      int32_t offset = read_jump_offset(current_call_frame, is_wide);
 
       assert(hll_sb_len(vm->stack) != 0);
-      hll_value cond = hll_sb_pop(vm->stack);
-      hll_gc_push_temp_root(vm->gc, cond);
-      if (hll_is_nil(cond)) {
+      if (hll_is_nil(hll_sb_last(vm->stack))) {
+        (void)hll_sb_pop(vm->stack);
+      } else {
         current_call_frame->ip += offset;
-        assert(current_call_frame->ip <=
-               &hll_sb_last(current_call_frame->bytecode->ops));
+        assert(current_call_frame->ip >= current_call_frame->bytecode->ops &&
+               current_call_frame->ip <=
+                   &hll_sb_last(current_call_frame->bytecode->ops));
       }
-      hll_gc_pop_temp_root(vm->gc);
     } break;
-    case HLL_BC_LET: {
+    case HLL_BC_SWITCH: {
+      uint32_t idx = read_const_idx(current_call_frame);
+      assert(idx < hll_sb_len(current_call_frame->bytecode->constant_pool));
+      hll_value table = current_call_frame->bytecode->constant_pool[idx];
       assert(hll_sb_len(vm->stack) != 0);
-      hll_value value = hll_sb_pop(vm->stack);
-      hll_gc_push_temp_root(vm->gc, value);
-      hll_value name = hll_sb_last(vm->stack);
+      hll_value *entry = hll_hash_get(table, hll_sb_pop(vm->stack));
+      size_t entry_idx = entry != NULL ? (size_t)hll_unwrap_int(*entry)
+                                       : hll_unwrap_hash(table)->count;
+      // Each entry is wide JMP: prefix, opcode and 4 byte offset.
+      current_call_frame->ip += entry_idx * 6;
+      assert(*current_call_frame->ip == HLL_BC_WIDE);
+    } break;
+    case HLL_BC_LET: {
+      assert(hll_sb_len(vm->stack) >= 2);
+      hll_value value = hll_sb_last(vm->stack);
+      hll_value name = (&hll_sb_last(vm->stack))[-1];
       hll_add_variable(vm, vm->env, name, value);
-      hll_gc_pop_temp_root(vm->gc); // value
+      (void)hll_sb_pop(vm->stack);
     } break;
     case HLL_BC_PUSHENV:
       vm->env = hll_new_env(vm, vm->env, hll_nil());
@@ -418,41 +618,191 @@ hll_value hll_interpret_bytecode_internal(hll_vm *vm, hll_value env_,
     case HLL_BC_CAR: {
       assert(hll_sb_len(vm->stack) != 0);
       hll_value cons = hll_sb_pop(vm->stack);
-      hll_gc_push_temp_root(vm->gc, cons);
       hll_value car = hll_car(vm, cons);
-      hll_gc_pop_temp_root(vm->gc); // cons
       hll_sb_push(vm->stack, car);
     } break;
     case HLL_BC_CDR: {
       assert(hll_sb_len(vm->stack) != 0);
       hll_value cons = hll_sb_pop(vm->stack);
-      hll_gc_push_temp_root(vm->gc, cons);
       hll_value cdr = hll_cdr(vm, cons);
-      hll_gc_pop_temp_root(vm->gc); // cons
       hll_sb_push(vm->stack, cdr);
     } break;
     case HLL_BC_SETCAR: {
       assert(hll_sb_len(vm->stack) != 0);
       hll_value car = hll_sb_pop(vm->stack);
-      hll_gc_push_temp_root(vm->gc, car);
       hll_value cons = hll_sb_last(vm->stack);
-      hll_gc_pop_temp_root(vm->gc); // car
       hll_unwrap_cons(cons)->car = car;
+      hll_gc_write_barrier(vm->gc, cons);
     } break;
     case HLL_BC_SETCDR: {
       assert(hll_sb_len(vm->stack) != 0);
       hll_value cdr = hll_sb_pop(vm->stack);
-      hll_gc_push_temp_root(vm->gc, cdr);
       hll_value cons = hll_sb_last(vm->stack);
       hll_unwrap_cons(cons)->cdr = cdr;
-      hll_gc_pop_temp_root(vm->gc); // cdr
+      hll_gc_write_barrier(vm->gc, cons);
+    } break;
+    case HLL_BC_VREF: {
+      assert(hll_sb_len(vm->stack) >= 2);
+      hll_value idx = hll_sb_pop(vm->stack);
+      hll_value *top = &hll_sb_last(vm->stack);
+      *top = *get_vec_item(vm, *top, idx);
+    } break;
+    case HLL_BC_VSET: {
+      assert(hll_sb_len(vm->stack) >= 3);
+      hll_value value = hll_sb_pop(vm->stack);
+      hll_value idx = hll_sb_pop(vm->stack);
+      hll_value vec = hll_sb_last(vm->stack);
+      *get_vec_item(vm, vec, idx) = value;
+      hll_gc_write_barrier(vm->gc, vec);
+    } break;
+    case HLL_BC_DOTIMES: {
+      uint32_t offset = read_jump_operand(current_call_frame, is_wide);
+
+      assert(hll_sb_len(vm->stack) >= 2);
+      hll_value *top = &hll_sb_last(vm->stack);
+      hll_value limit = top[-1];
+      hll_obj_cons *var = hll_unwrap_cons(top[0]);
+      bool is_done;
+      // Numbers are not heap objects, so variable can be updated without
+      // write barrier.
+      if (HLL_LIKELY(hll_is_int(var->cdr) && hll_is_int(limit))) {
+        int64_t next = hll_unwrap_int(var->cdr) + 1;
+        var->cdr = hll_int(next);
+        is_done = next >= hll_unwrap_int(limit);
+      } else {
+        if (HLL_UNLIKELY(!hll_is_num(limit))) {
+          hll_runtime_error(vm, "'dotimes' count is not a number (got %s)",
+                            hll_get_value_kind_str(hll_get_value_kind(limit)));
+        }
+        if (HLL_UNLIKELY(!hll_is_num(var->cdr))) {
+          hll_runtime_error(
+              vm, "'dotimes' variable is not a number (got %s)",
+              hll_get_value_kind_str(hll_get_value_kind(var->cdr)));
+        }
+        double next = hll_unwrap_num(var->cdr) + 1;
+        var->cdr = hll_num(next);
+        is_done = next >= hll_unwrap_num(limit);
+      }
+
+      if (is_done) {
+        hll_sb_size(vm->stack) -= 2;
+        current_call_frame->ip += offset;
+        assert(current_call_frame->ip <=
+               &hll_sb_last(current_call_frame->bytecode->ops));
+      }
+    } break;
+    case HLL_BC_DOLIST: {
+      uint32_t offset = read_jump_operand(current_call_frame, is_wide);
+
+      assert(hll_sb_len(vm->stack) >= 3);
+      hll_value *top = &hll_sb_last(vm->stack);
+      hll_value seq = top[-2];
+      hll_value item = hll_nil();
+      bool is_done = false;
+      switch (hll_get_value_kind(seq)) {
+      case HLL_VALUE_NIL:
+        is_done = true;
+        break;
+      case HLL_VALUE_CONS:
+        item = hll_unwrap_car(seq);
+        top[-2] = hll_unwrap_cdr(seq);
+        break;
+      case HLL_VALUE_RANGE: {
+        hll_obj_range *range = hll_unwrap_range(seq);
+        size_t idx = hll_unwrap_int(top[-1]);
+        if (idx == range->length) {
+          is_done = true;
+        } else {
+          item = hll_range_item(range, idx);
+          top[-1] = hll_int(idx + 1);
+        }
+      } break;
+      default:
+        hll_runtime_error(vm, "'dolist' expects list or range (got %s)",
+                          hll_get_value_kind_str(hll_get_value_kind(seq)));
+        break;
+      }
+
+      if (is_done) {
+        hll_sb_size(vm->stack) -= 3;
+        current_call_frame->ip += offset;
+        assert(current_call_frame->ip <=
+               &hll_sb_last(current_call_frame->bytecode->ops));
+      } else {
+        hll_unwrap_cons(top[0])->cdr = item;
+        hll_gc_write_barrier(vm->gc, top[0]);
+      }
+    } break;
+    case HLL_BC_JMP: {
+      int32_t offset = read_jump_offset(current_call_frame, is_wide);
+      current_call_frame->ip += offset;
+      assert(current_call_frame->ip >= current_call_frame->bytecode->ops &&
+             current_call_frame->ip <=
+                 &hll_sb_last(current_call_frame->bytecode->ops));
     } break;
+    case HLL_BC_LOADVAR: {
+      uint32_t idx = read_const_idx(current_call_frame);
+      assert(idx < hll_sb_len(current_call_frame->bytecode->constant_pool));
+      hll_value symb = current_call_frame->bytecode->constant_pool[idx];
+      assert(hll_get_value_kind(symb) == HLL_VALUE_SYMB);
+
+      hll_value found;
+      bool is_found = hll_find_var(vm->env, symb, &found);
+      if (HLL_UNLIKELY(!is_found)) {
+        hll_runtime_error(vm, "failed to find variable '%s' in current scope",
+                          hll_unwrap_zsymb(symb));
+        return;
+      }
+      hll_sb_push(vm->stack, hll_unwrap_cdr(found));
+    } break;
+    case HLL_BC_CONS: {
+      assert(hll_sb_len(vm->stack) >= 2);
+      // Both operands stay on stack while cons is allocated.
+      hll_value *top = &hll_sb_last(vm->stack);
+      hll_value cons = hll_new_cons(vm, top[-1], top[0]);
+      hll_sb_size(vm->stack) -= 2;
+      hll_sb_push(vm->stack, cons);
+    } break;
+    case HLL_BC_WIDE:
+      assert(!is_wide);
+      is_wide = true;
+      continue;
     default:
       HLL_UNREACHABLE;
       break;
     }
+    is_wide = false;
+  }
+}
+
+hll_value hll_interpret_bytecode_internal(hll_vm *vm, hll_value env_,
+                                          hll_value compiled) {
+  // Native code does not close its handle scopes when runtime error is
+  // raised, so temp roots are restored to this scope after bailing.
+  hll_handle_scope initial_scope = hll_gc_open_scope(vm->gc);
+  // Same applies to pins done by native code calling back to interpreter.
+  uint32_t initial_pin = vm->gc->pin;
+  // Setup setjump for error handling
+  if (setjmp(vm->err_jmp) == 1) {
+    goto bail;
   }
 
+  hll_gc_handle(vm->gc, compiled);
+  hll_bytecode *initial_bytecode = hll_unwrap_func(compiled)->bytecode;
+  vm->call_stack = NULL;
+  vm->stack = NULL;
+  vm->env = env_;
+
+  {
+    hll_call_frame original_frame = {0};
+    original_frame.ip = initial_bytecode->ops;
+    original_frame.bytecode = initial_bytecode;
+    original_frame.env = env_;
+    original_frame.func = compiled;
+    hll_sb_push(vm->call_stack, original_frame);
+  }
+  execute(vm, 0);
+
   hll_value result;
   goto success;
 success:
@@ -460,10 +810,13 @@ success:
   goto end;
 bail:
   result = hll_nil();
+  vm->gc->pin = initial_pin;
 end:
   hll_sb_free(vm->stack);
+  vm->stack = NULL;
   hll_sb_free(vm->call_stack);
-  hll_gc_pop_temp_root(vm->gc); // callable
+  vm->call_stack = NULL;
+  hll_gc_close_scope(vm->gc, initial_scope);
 
   return result;
 }
@@ -487,14 +840,18 @@ hll_interpret_result hll_interpret_bytecode(hll_vm *vm, hll_value compiled,
 hll_expand_macro_result hll_expand_macro(hll_vm *vm, hll_value macro,
                                          hll_value args, hll_value *dst) {
   hll_obj_func *func = hll_unwrap_func(macro);
+  hll_handle_scope scope = hll_gc_open_scope(vm->gc);
+  hll_gc_handle(vm->gc, macro);
+  hll_gc_handle(vm->gc, args);
   hll_value new_env = hll_new_env(vm, vm->global_env, hll_nil());
-  hll_gc_push_temp_root(vm->gc, new_env);
+  hll_gc_handle(vm->gc, new_env);
   hll_value param_name = func->param_names;
   hll_value param_value = args;
   if (hll_is_cons(param_name) && hll_is_symb(hll_unwrap_car(param_name))) {
     for (; hll_is_cons(param_name); param_name = hll_unwrap_cdr(param_name),
                                     param_value = hll_unwrap_cdr(param_value)) {
       if (hll_get_value_kind(param_value) != HLL_VALUE_CONS) {
+        hll_gc_close_scope(vm->gc, scope);
         return HLL_EXPAND_MACRO_ERR_ARGS;
       }
       hll_value name = hll_unwrap_car(param_name);
@@ -512,11 +869,35 @@ hll_expand_macro_result hll_expand_macro(hll_vm *vm, hll_value macro,
     hll_add_variable(vm, new_env, param_name, param_value);
   }
 
-  hll_gc_pop_temp_root(vm->gc); // env
+  // Compiler holds references to ast, so it must not be moved.
+  hll_gc_pin(vm->gc);
   *dst = hll_interpret_bytecode_internal(vm, new_env, macro);
+  hll_gc_unpin(vm->gc);
+  hll_gc_close_scope(vm->gc, scope);
   return HLL_EXPAND_MACRO_OK;
 }
 
+hll_value hll_call(hll_vm *vm, hll_value callable, hll_value args) {
+  assert(vm->call_stack != NULL);
+  size_t depth = hll_sb_len(vm->call_stack);
+  // Caller may hold references to conses, so compacting collection has to
+  // wait until callable returns.
+  hll_gc_pin(vm->gc);
+  hll_sb_push(vm->stack, callable);
+  hll_sb_push(vm->stack, args);
+  hll_call_frame *current_call_frame = &hll_sb_last(vm->call_stack);
+  call_func(vm, &current_call_frame, false);
+  // Builtins are completed by call_func, functions get a new frame that is
+  // executed until it returns.
+  if (hll_sb_len(vm->call_stack) > depth) {
+    execute(vm, depth);
+  }
+  hll_value result = hll_sb_pop(vm->stack);
+  hll_gc_unpin(vm->gc);
+
+  return result;
+}
+
 void hll_print(hll_vm *vm, const char *str) {
   if (vm->config.write_fn) {
     vm->config.write_fn(vm, str);
@@ -18,6 +18,21 @@ typedef struct hll_call_frame {
   hll_value func;
 } hll_call_frame;
 
+// Builtin that can be called directly by CALLNATIVE instruction, without
+// looking up its variable.
+typedef struct {
+  // Variable of builtin in global env.
+  hll_value var;
+  hll_value bind;
+  // Set when variable with the same name is defined in global env. Calls then
+  // look up the variable, like other calls do.
+  bool is_shadowed;
+} hll_native;
+
+// Size of table of symbols that have special meaning for compiler. Must be
+// power of two.
+#define HLL_SPECIAL_SYMB_SLOTS 128
+
 typedef struct hll_vm {
   struct hll_config config;
   struct hll_debug_storage *debug;
@@ -30,7 +45,18 @@ typedef struct hll_vm {
   // Global env. It is stored across calls to interpret, allowing defining
   // toplevel functions.
   hll_value global_env;
-  hll_value macro_env;
+  // Hash table of macros by their names.
+  hll_value macros;
+  // Builtins added with hll_add_binding. Dynamic array.
+  hll_native *natives;
+  // Hash table of indices of natives by their names.
+  hll_value native_names;
+  // Builtin that runs fused chains of sequence functions. Compiler loads it as
+  // constant, and it is not bound to any variable, so programs can't rebind it.
+  hll_value fused_bind;
+  // Hash table that classifies special form symbols by their hash, see
+  // hll_init_special_symbs. Slots hold index of symbol plus one.
+  uint8_t special_symbs[HLL_SPECIAL_SYMB_SLOTS];
 
   // Current execution state
   hll_value *stack;
@@ -47,6 +73,8 @@ HLL_PUB hll_interpret_result hll_interpret_bytecode(hll_vm *vm,
                                                     hll_value compiled,
                                                     bool print_result);
 
+// Defines variable in env. Caller must make sure env, name and value are
+// reachable by garbage collector.
 HLL_PUB void hll_add_variable(hll_vm *vm, hll_value env, hll_value name,
                               hll_value value);
 
@@ -68,6 +96,11 @@ HLL_PUB void hll_runtime_error(hll_vm *vm, const char *fmt, ...);
 HLL_PUB hll_value hll_interpret_bytecode_internal(hll_vm *vm, hll_value env_,
                                                   hll_value compiled);
 
+// Calls function or builtin with given arguments and returns its result. Can
+// only be used by builtins. Conses are not moved until call returns, so caller
+// may keep references to them, but it still has to root values it allocates.
+HLL_PUB hll_value hll_call(hll_vm *vm, hll_value callable, hll_value args);
+
 HLL_PUB void hll_print(hll_vm *vm, const char *str);
 
 //
@@ -26,6 +26,7 @@ typedef struct {
   hll_mode mode;
   const char *str;
   bool forbid_colors;
+  bool heap_profile;
 } hll_options;
 
 static char *read_entire_file(const char *filename) {
@@ -75,7 +76,9 @@ static void print_usage(FILE *f) {
              "  -e stat   Execute string 'stat'\n"
              "  -v        Show version information\n"
              "  -h        Show this message\n"
-             "  -m        Do not use colored output\n");
+             "  -m        Do not use colored output\n"
+             "  --heap-profile\n"
+             "            Print live objects by allocation site on exit\n");
 }
 
 static void print_version(void) { printf("hololisp 1.0.0\n"); }
@@ -108,6 +111,8 @@ static bool parse_cli_args(hll_options *opts, uint32_t argc,
       opts->mode = HLL_MODE_DUMP_BYTECODE;
     } else if (strcmp(opt, "-m") == 0) {
       opts->forbid_colors = true;
+    } else if (strcmp(opt, "--heap-profile") == 0) {
+      opts->heap_profile = true;
     } else {
       fprintf(stderr, "Unknown option '%s'\n", opt);
       print_usage(stderr);
@@ -118,9 +123,19 @@ static bool parse_cli_args(hll_options *opts, uint32_t argc,
   return false;
 }
 
+static struct hll_vm *make_vm(hll_options *opts) {
+  hll_config config;
+  hll_initialize_default_config(&config);
+  if (opts->heap_profile) {
+    config.heap_profile_rate = 1;
+  }
+
+  return hll_make_vm(&config);
+}
+
 static bool execute_repl(hll_options *opts, bool tty) {
   bool result = false;
-  struct hll_vm *vm = hll_make_vm(NULL);
+  struct hll_vm *vm = make_vm(opts);
 
   for (;;) {
     if (tty) {
@@ -157,7 +172,7 @@ static bool execute_script(hll_options *opts) {
     return true;
   }
 
-  struct hll_vm *vm = hll_make_vm(NULL);
+  struct hll_vm *vm = make_vm(opts);
   hll_interpret_flags flags = 0;
   if (!opts->forbid_colors) {
     flags |= HLL_INTERPRET_DEBUG_COLORED;
@@ -165,6 +180,9 @@ static bool execute_script(hll_options *opts) {
   hll_interpret_result interpret_result =
       hll_interpret(vm, file_contents, opts->str, flags);
   bool result = interpret_result == HLL_RESULT_ERROR;
+  if (opts->heap_profile) {
+    hll_dump_heap_profile(vm);
+  }
   hll_delete_vm(vm);
   free(file_contents);
 
@@ -172,12 +190,15 @@ static bool execute_script(hll_options *opts) {
 }
 
 static bool execute_string(hll_options *opts) {
-  struct hll_vm *vm = hll_make_vm(NULL);
+  struct hll_vm *vm = make_vm(opts);
   hll_interpret_flags flags = HLL_INTERPRET_PRINT_RESULT;
   if (!opts->forbid_colors) {
     flags |= HLL_INTERPRET_DEBUG_COLORED;
   }
   hll_interpret_result result = hll_interpret(vm, opts->str, "cli", flags);
+  if (opts->heap_profile) {
+    hll_dump_heap_profile(vm);
+  }
   hll_delete_vm(vm);
 
   return result == HLL_RESULT_ERROR;
@@ -1,6 +1,7 @@
 #include "../hololisp/hll_bytecode.h"
 #include "../hololisp/hll_compiler.h"
 #include "../hololisp/hll_debug.h"
+#include "../hololisp/hll_gc.h"
 #include "../hololisp/hll_mem.h"
 #include "../hololisp/hll_value.h"
 #include "../hololisp/hll_vm.h"
@@ -27,7 +28,7 @@ static void test_bytecode_equals(uint8_t *expected, size_t expected_len,
 
 static void test_compiler_compiles_integer(void) {
   const char *source = "1";
-  uint8_t bytecode[] = {HLL_BC_CONST, 0x00, 0x00, HLL_BC_END};
+  uint8_t bytecode[] = {HLL_BC_CONST, 0x00, HLL_BC_END};
   struct hll_vm *vm = hll_make_vm(NULL);
 
   hll_value result;
@@ -40,16 +41,8 @@ static void test_compiler_compiles_integer(void) {
 
 static void test_compiler_compiles_addition(void) {
   const char *source = "(+ 1 2)";
-  uint8_t bytecode[] = {// +
-                        HLL_BC_CONST, 0x00, 0x00, HLL_BC_FIND, HLL_BC_CDR,
-                        // (1 2)
-                        HLL_BC_NIL, HLL_BC_NIL,
-                        // 1
-                        HLL_BC_CONST, 0x00, 0x01, HLL_BC_APPEND,
-                        // 2
-                        HLL_BC_CONST, 0x00, 0x02, HLL_BC_APPEND, HLL_BC_POP,
-                        // (+ 1 2)
-                        HLL_BC_CALL, HLL_BC_END};
+  // Call to pure builtin with constant arguments is evaluated by compiler.
+  uint8_t bytecode[] = {HLL_BC_CONST, 0x00, HLL_BC_END};
   struct hll_vm *vm = hll_make_vm(NULL);
 
   hll_value result;
@@ -58,77 +51,12 @@ static void test_compiler_compiles_addition(void) {
   struct hll_bytecode *compiled = hll_unwrap_func(result)->bytecode;
   TEST_ASSERT(hll_is_nil(compiled->name));
   test_bytecode_equals(bytecode, sizeof(bytecode), compiled);
+  TEST_ASSERT(hll_unwrap_num(compiled->constant_pool[0]) == 3);
 }
 
 static void test_compiler_compiles_complex_arithmetic_operation(void) {
   const char *source = "(+ (* 3 5) 2 (/ 2 1))";
-  uint8_t bytecode[] = {
-      // +
-      HLL_BC_CONST,
-      0x00,
-      0x00,
-      HLL_BC_FIND,
-      HLL_BC_CDR,
-      // ((* 3 5) 2 (/ 2 1))
-      HLL_BC_NIL,
-      HLL_BC_NIL,
-      // *
-      HLL_BC_CONST,
-      0x00,
-      0x01,
-      HLL_BC_FIND,
-      HLL_BC_CDR,
-      // (3 5)
-      HLL_BC_NIL,
-      HLL_BC_NIL,
-      // 3
-      HLL_BC_CONST,
-      0x00,
-      0x02,
-      HLL_BC_APPEND,
-      // 5
-      HLL_BC_CONST,
-      0x00,
-      0x03,
-      HLL_BC_APPEND,
-      HLL_BC_POP,
-      // (* 3 5)
-      HLL_BC_CALL,
-      HLL_BC_APPEND,
-      // 2
-      HLL_BC_CONST,
-      0x00,
-      0x04,
-      HLL_BC_APPEND,
-      // /
-      HLL_BC_CONST,
-      0x00,
-      0x05,
-      HLL_BC_FIND,
-      HLL_BC_CDR,
-      // (2 1)
-      HLL_BC_NIL,
-      HLL_BC_NIL,
-      // 2
-      HLL_BC_CONST,
-      0x00,
-      0x04,
-      HLL_BC_APPEND,
-      // 1
-      HLL_BC_CONST,
-      0x00,
-      0x06,
-      HLL_BC_APPEND,
-      HLL_BC_POP,
-      // (/ 2 1)
-      HLL_BC_CALL,
-      HLL_BC_APPEND,
-      HLL_BC_POP,
-      // (+ (* 3 5) 2 (/ 2 1))
-      HLL_BC_CALL,
-      HLL_BC_END,
-
-  };
+  uint8_t bytecode[] = {HLL_BC_CONST, 0x00, HLL_BC_END};
   struct hll_vm *vm = hll_make_vm(NULL);
 
   hll_value result;
@@ -136,17 +64,103 @@ static void test_compiler_compiles_complex_arithmetic_operation(void) {
   TEST_ASSERT(is_compiled);
   struct hll_bytecode *compiled = hll_unwrap_func(result)->bytecode;
   test_bytecode_equals(bytecode, sizeof(bytecode), compiled);
+  TEST_ASSERT(hll_unwrap_num(compiled->constant_pool[0]) == 19);
 }
 
 static void test_compiler_compiles_if(void) {
   const char *source = "(if t 1 0)";
-  uint8_t bytecode[] = {// t
-                        HLL_BC_TRUE, HLL_BC_JN, 0x00, 0x07,
+  // Only taken arm is compiled.
+  uint8_t bytecode[] = {HLL_BC_CONST, 0x00, HLL_BC_END};
+  struct hll_vm *vm = hll_make_vm(NULL);
+
+  hll_value result;
+  bool is_compiled = hll_compile(vm, source, "", &result);
+  TEST_ASSERT(is_compiled);
+  struct hll_bytecode *compiled = hll_unwrap_func(result)->bytecode;
+  test_bytecode_equals(bytecode, sizeof(bytecode), compiled);
+}
+
+static void test_compiler_compiles_call_with_variable(void) {
+  const char *source = "(+ x 2)";
+  uint8_t bytecode[] = {// x
+                        HLL_BC_LOADVAR, 0x00,
+                        // 2
+                        HLL_BC_CONST, 0x01,
+                        // (+ x 2)
+                        HLL_BC_CALLNATIVE, 0x01, 0x02, HLL_BC_END};
+  struct hll_vm *vm = hll_make_vm(NULL);
+
+  hll_value result;
+  bool is_compiled = hll_compile(vm, source, "", &result);
+  TEST_ASSERT(is_compiled);
+  struct hll_bytecode *compiled = hll_unwrap_func(result)->bytecode;
+  test_bytecode_equals(bytecode, sizeof(bytecode), compiled);
+}
+
+static void test_compiler_compiles_and_in_if(void) {
+  const char *source = "(if (and x y) 1 2)";
+  // Each argument jumps to else arm directly.
+  uint8_t bytecode[] = {// x
+                        HLL_BC_LOADVAR, 0x00, HLL_BC_JN, 0x00, 0x08,
+                        // y
+                        HLL_BC_LOADVAR, 0x01, HLL_BC_JN, 0x00, 0x03,
                         // 1
-                        HLL_BC_CONST, 0x00, 0x00, HLL_BC_NIL, HLL_BC_JN, 0x00,
-                        0x03,
-                        // 0
-                        HLL_BC_CONST, 0x00, 0x01, HLL_BC_END};
+                        HLL_BC_CONST, 0x02, HLL_BC_END,
+                        // 2
+                        HLL_BC_CONST, 0x03, HLL_BC_END};
+  struct hll_vm *vm = hll_make_vm(NULL);
+
+  hll_value result;
+  bool is_compiled = hll_compile(vm, source, "", &result);
+  TEST_ASSERT(is_compiled);
+  struct hll_bytecode *compiled = hll_unwrap_func(result)->bytecode;
+  test_bytecode_equals(bytecode, sizeof(bytecode), compiled);
+}
+
+static void test_compiler_compiles_or(void) {
+  const char *source = "(or x y)";
+  // Value of x is kept as result if it is not nil.
+  uint8_t bytecode[] = {// x
+                        HLL_BC_LOADVAR, 0x00, HLL_BC_JTK, 0x00, 0x02,
+                        // y
+                        HLL_BC_LOADVAR, 0x01, HLL_BC_END};
+  struct hll_vm *vm = hll_make_vm(NULL);
+
+  hll_value result;
+  bool is_compiled = hll_compile(vm, source, "", &result);
+  TEST_ASSERT(is_compiled);
+  struct hll_bytecode *compiled = hll_unwrap_func(result)->bytecode;
+  test_bytecode_equals(bytecode, sizeof(bytecode), compiled);
+}
+
+static void test_compiler_compiles_case(void) {
+  const char *source = "(case x (1 'a) (t 'b))";
+  // Entries of jump table are kept wide.
+  uint8_t bytecode[] = {HLL_BC_LOADVAR, 0x00, HLL_BC_SWITCH, 0x01,
+                        // 1
+                        HLL_BC_WIDE, HLL_BC_JMP, 0x00, 0x00, 0x00, 0x06,
+                        // t
+                        HLL_BC_WIDE, HLL_BC_JMP, 0x00, 0x00, 0x00, 0x03,
+                        // 'a
+                        HLL_BC_CONST, 0x02, HLL_BC_END,
+                        // 'b
+                        HLL_BC_CONST, 0x03, HLL_BC_END, HLL_BC_END};
+  struct hll_vm *vm = hll_make_vm(NULL);
+
+  hll_value result;
+  bool is_compiled = hll_compile(vm, source, "", &result);
+  TEST_ASSERT(is_compiled);
+  struct hll_bytecode *compiled = hll_unwrap_func(result)->bytecode;
+  test_bytecode_equals(bytecode, sizeof(bytecode), compiled);
+}
+
+static void test_compiler_propagates_constant_define(void) {
+  const char *source = "(define w 10) (- w 1)";
+  uint8_t bytecode[] = {// (define w 10)
+                        HLL_BC_CONST, 0x00, HLL_BC_CONST, 0x01,
+                        HLL_BC_LET, HLL_BC_POP,
+                        // (- w 1)
+                        HLL_BC_CONST, 0x02, HLL_BC_END};
   struct hll_vm *vm = hll_make_vm(NULL);
 
   hll_value result;
@@ -154,13 +168,15 @@ static void test_compiler_compiles_if(void) {
   TEST_ASSERT(is_compiled);
   struct hll_bytecode *compiled = hll_unwrap_func(result)->bytecode;
   test_bytecode_equals(bytecode, sizeof(bytecode), compiled);
+  TEST_ASSERT(hll_unwrap_num(compiled->constant_pool[2]) == 9);
 }
 
 static void test_compiler_compiles_quote(void) {
   const char *source = "'(1 2)";
-  uint8_t bytecode[] = {HLL_BC_NIL, HLL_BC_NIL,    HLL_BC_CONST, 0x00,
-                        0x00,       HLL_BC_APPEND, HLL_BC_CONST, 0x00,
-                        0x01,       HLL_BC_APPEND, HLL_BC_POP,   HLL_BC_END};
+  uint8_t bytecode[] = {HLL_BC_NIL,    HLL_BC_NIL,    HLL_BC_CONST,
+                        0x00,          HLL_BC_APPEND, HLL_BC_CONST,
+                        0x01,          HLL_BC_APPEND, HLL_BC_POP,
+                        HLL_BC_END};
   struct hll_vm *vm = hll_make_vm(NULL);
 
   hll_value result;
@@ -172,29 +188,12 @@ static void test_compiler_compiles_quote(void) {
 
 static void test_compiler_compiles_define(void) {
   const char *source = "(define (f x) (* x 2))";
-  uint8_t function_bytecode[] = {HLL_BC_CONST,
-                                 0x00,
-                                 0x00,
-                                 HLL_BC_FIND,
-                                 HLL_BC_CDR,
-                                 HLL_BC_NIL,
-                                 HLL_BC_NIL,
-                                 HLL_BC_CONST,
-                                 0x00,
-                                 0x01,
-                                 HLL_BC_FIND,
-                                 HLL_BC_CDR,
-                                 HLL_BC_APPEND,
-                                 HLL_BC_CONST,
-                                 0x00,
-                                 0x02,
-                                 HLL_BC_APPEND,
-                                 HLL_BC_POP,
-                                 HLL_BC_MBTRCALL,
-                                 HLL_BC_END};
-
-  uint8_t program_bytecode[] = {HLL_BC_CONST, 0x00, 0x00,       HLL_BC_MAKEFUN,
-                                0x00,         0x01, HLL_BC_LET, HLL_BC_END};
+  uint8_t function_bytecode[] = {// (* x 2)
+                                 HLL_BC_LOADVAR, 0x00, HLL_BC_CONST, 0x01,
+                                 HLL_BC_CALLNATIVE, 0x03, 0x02, HLL_BC_END};
+
+  uint8_t program_bytecode[] = {HLL_BC_CONST, 0x00,       HLL_BC_MAKEFUN,
+                                0x01,         HLL_BC_LET, HLL_BC_END};
 
   (void)function_bytecode;
 
@@ -223,40 +222,23 @@ static void test_compiler_compiles_let(void) {
       // c
       HLL_BC_CONST,
       0x00,
-      0x00,
       // 2
       HLL_BC_CONST,
-      0x00,
       0x01,
       // (c 2)
       HLL_BC_LET,
       HLL_BC_POP,
       // a
       HLL_BC_CONST,
-      0x00,
       0x02,
-      // +
-      HLL_BC_CONST,
-      0x00,
-      0x03,
-      HLL_BC_FIND,
-      HLL_BC_CDR,
-      // (c 1)
-      HLL_BC_NIL,
-      HLL_BC_NIL,
-      HLL_BC_CONST,
-      0x00,
+      // (+ c 1)
+      HLL_BC_LOADVAR,
       0x00,
-      HLL_BC_FIND,
-      HLL_BC_CDR,
-      HLL_BC_APPEND,
       HLL_BC_CONST,
-      0x00,
-      0x04,
-      HLL_BC_APPEND,
-      HLL_BC_POP,
-      // (+ c 1)
-      HLL_BC_CALL,
+      0x03,
+      HLL_BC_CALLNATIVE,
+      0x01,
+      0x02,
       HLL_BC_LET,
       HLL_BC_POP,
       HLL_BC_NIL,
@@ -279,71 +261,37 @@ static void test_compiler_compiles_let_with_body(void) {
       // c
       HLL_BC_CONST,
       0x00,
-      0x00,
       // 2
       HLL_BC_CONST,
-      0x00,
       0x01,
       // (c 2)
       HLL_BC_LET,
       HLL_BC_POP,
       // a
       HLL_BC_CONST,
-      0x00,
       0x02,
-      // +
-      HLL_BC_CONST,
-      0x00,
-      0x03,
-      HLL_BC_FIND,
-      HLL_BC_CDR,
-      // (c 1)
-      HLL_BC_NIL,
-      HLL_BC_NIL,
-      HLL_BC_CONST,
-      0x00,
+      // (+ c 1)
+      HLL_BC_LOADVAR,
       0x00,
-      HLL_BC_FIND,
-      HLL_BC_CDR,
-      HLL_BC_APPEND,
       HLL_BC_CONST,
-      0x00,
-      0x04,
-      HLL_BC_APPEND,
-      HLL_BC_POP,
-      // (+ c 1)
-      HLL_BC_CALL,
+      0x03,
+      HLL_BC_CALLNATIVE,
+      0x01,
+      0x02,
       HLL_BC_LET,
       HLL_BC_POP,
       // (* c a)
-      HLL_BC_CONST,
-      0x00,
-      0x05,
-      HLL_BC_FIND,
-      HLL_BC_CDR,
-      HLL_BC_NIL,
-      HLL_BC_NIL,
-      HLL_BC_CONST,
-      0x00,
-      0x00,
-      HLL_BC_FIND,
-      HLL_BC_CDR,
-      HLL_BC_APPEND,
-      HLL_BC_CONST,
+      HLL_BC_LOADVAR,
       0x00,
+      HLL_BC_LOADVAR,
+      0x02,
+      HLL_BC_CALLNATIVE,
+      0x03,
       0x02,
-      HLL_BC_FIND,
-      HLL_BC_CDR,
-      HLL_BC_APPEND,
-      HLL_BC_POP,
-      HLL_BC_CALL,
       HLL_BC_POP,
-      // c
-      HLL_BC_CONST,
-      0x00,
+      // a
+      HLL_BC_LOADVAR,
       0x02,
-      HLL_BC_FIND,
-      HLL_BC_CDR,
       HLL_BC_POPENV,
       HLL_BC_END,
   };
@@ -359,10 +307,10 @@ static void test_compiler_compiles_let_with_body(void) {
 static void test_compiler_compiles_setf_symbol(void) {
   const char *source = "(define x) (set! x t)";
   uint8_t bytecode[] = {// defvar x
-                        HLL_BC_CONST, 0x00, 0x00, HLL_BC_NIL, HLL_BC_LET,
+                        HLL_BC_CONST, 0x00, HLL_BC_NIL, HLL_BC_LET,
                         HLL_BC_POP,
                         // set
-                        HLL_BC_CONST, 0x00, 0x00, HLL_BC_FIND, HLL_BC_TRUE,
+                        HLL_BC_CONST, 0x00, HLL_BC_FIND, HLL_BC_TRUE,
                         HLL_BC_SETCDR, HLL_BC_END};
   struct hll_vm *vm = hll_make_vm(NULL);
 
@@ -377,11 +325,11 @@ static void test_compiler_compiles_setf_cdr(void) {
   const char *source = "(define x '(1)) (set! (cdr x) '(2))";
   uint8_t bytecode[] = {
       // defvar x
-      HLL_BC_CONST, 0x00, 0x00, HLL_BC_NIL, HLL_BC_NIL, HLL_BC_CONST, 0x00,
-      0x01, HLL_BC_APPEND, HLL_BC_POP, HLL_BC_LET, HLL_BC_POP,
+      HLL_BC_CONST, 0x00, HLL_BC_NIL, HLL_BC_NIL, HLL_BC_CONST, 0x01,
+      HLL_BC_APPEND, HLL_BC_POP, HLL_BC_LET, HLL_BC_POP,
       // set
-      HLL_BC_CONST, 0x00, 0x00, HLL_BC_FIND, HLL_BC_CDR, HLL_BC_NIL, HLL_BC_NIL,
-      HLL_BC_CONST, 0x00, 0x02, HLL_BC_APPEND, HLL_BC_POP,
+      HLL_BC_LOADVAR, 0x00, HLL_BC_NIL, HLL_BC_NIL, HLL_BC_CONST, 0x02,
+      HLL_BC_APPEND, HLL_BC_POP,
 
       HLL_BC_SETCDR, HLL_BC_END};
   struct hll_vm *vm = hll_make_vm(NULL);
@@ -393,10 +341,58 @@ static void test_compiler_compiles_setf_cdr(void) {
   test_bytecode_equals(bytecode, sizeof(bytecode), compiled);
 }
 
+static void test_compiler_compiles_cons(void) {
+  const char *source = "(cons 1 2)";
+  uint8_t bytecode[] = {HLL_BC_CONST, 0x00,        HLL_BC_CONST,
+                        0x01,         HLL_BC_CONS, HLL_BC_END};
+  struct hll_vm *vm = hll_make_vm(NULL);
+
+  hll_value result;
+  bool is_compiled = hll_compile(vm, source, "", &result);
+  TEST_ASSERT(is_compiled);
+  struct hll_bytecode *compiled = hll_unwrap_func(result)->bytecode;
+  test_bytecode_equals(bytecode, sizeof(bytecode), compiled);
+}
+
+static void test_compiler_compiles_vector_ref(void) {
+  const char *source = "(vector-ref v 1)";
+  uint8_t bytecode[] = {// v
+                        HLL_BC_LOADVAR, 0x00,
+                        // 1
+                        HLL_BC_CONST, 0x01,
+                        // (vector-ref v 1)
+                        HLL_BC_VREF, HLL_BC_END};
+  struct hll_vm *vm = hll_make_vm(NULL);
+
+  hll_value result;
+  bool is_compiled = hll_compile(vm, source, "", &result);
+  TEST_ASSERT(is_compiled);
+  struct hll_bytecode *compiled = hll_unwrap_func(result)->bytecode;
+  test_bytecode_equals(bytecode, sizeof(bytecode), compiled);
+}
+
+static void test_compiler_compiles_setf_vector_ref(void) {
+  const char *source = "(set! (vector-ref v 1) 2)";
+  uint8_t bytecode[] = {// v
+                        HLL_BC_LOADVAR, 0x00,
+                        // 1
+                        HLL_BC_CONST, 0x01,
+                        // 2
+                        HLL_BC_CONST, 0x02,
+                        // set
+                        HLL_BC_VSET, HLL_BC_END};
+  struct hll_vm *vm = hll_make_vm(NULL);
+
+  hll_value result;
+  bool is_compiled = hll_compile(vm, source, "", &result);
+  TEST_ASSERT(is_compiled);
+  struct hll_bytecode *compiled = hll_unwrap_func(result)->bytecode;
+  test_bytecode_equals(bytecode, sizeof(bytecode), compiled);
+}
+
 static void test_compiler_compiles_macro(void) {
   const char *source = "(defmacro (hello) (+ 1 2 3)) (hello)";
-  uint8_t bytecode[] = {HLL_BC_NIL, HLL_BC_POP, HLL_BC_CONST,
-                        0x00,       0x00,       HLL_BC_END};
+  uint8_t bytecode[] = {HLL_BC_CONST, 0x00, HLL_BC_END};
 
   struct hll_vm *vm = hll_make_vm(NULL);
   hll_value result;
@@ -408,27 +404,19 @@ static void test_compiler_compiles_macro(void) {
 
 static void test_compiler_compiles_lambda(void) {
   const char *source = "((lambda (x) (+ x x x)) 3)";
-  uint8_t function_bytecode[] = {
-      HLL_BC_CONST, 0x00,       0x00,          HLL_BC_FIND,
-      HLL_BC_CDR, // *
-
-      HLL_BC_NIL,   HLL_BC_NIL, HLL_BC_CONST,  0x00,
-      0x01, // x
-      HLL_BC_FIND,  HLL_BC_CDR, HLL_BC_APPEND, HLL_BC_CONST, 0x00,
-      0x01, // x
-      HLL_BC_FIND,  HLL_BC_CDR, HLL_BC_APPEND, HLL_BC_CONST, 0x00,
-      0x01, // x
-      HLL_BC_FIND,  HLL_BC_CDR, HLL_BC_APPEND,
-
-      HLL_BC_POP,
-
-      HLL_BC_CALL,  HLL_BC_END};
-
-  uint8_t program_bytecode[] = {HLL_BC_MAKEFUN, 0x00,
-                                0x00, // function object
-                                HLL_BC_NIL,     HLL_BC_NIL,  HLL_BC_CONST,
-                                0x00,           0x01,        HLL_BC_APPEND,
-                                HLL_BC_POP,     HLL_BC_CALL, HLL_BC_END};
+  uint8_t function_bytecode[] = {// x
+                                 HLL_BC_LOADVAR, 0x00,
+                                 // x
+                                 HLL_BC_LOADVAR, 0x00,
+                                 // x
+                                 HLL_BC_LOADVAR, 0x00,
+                                 // (+ x x x)
+                                 HLL_BC_CALLNATIVE, 0x01, 0x03, HLL_BC_END};
+
+  uint8_t program_bytecode[] = {HLL_BC_MAKEFUN, 0x00, // function object
+                                HLL_BC_NIL,     HLL_BC_NIL,    HLL_BC_CONST,
+                                0x01,           HLL_BC_APPEND, HLL_BC_POP,
+                                HLL_BC_CALL,    HLL_BC_END};
 
   (void)function_bytecode;
 
@@ -450,11 +438,118 @@ static void test_compiler_compiles_lambda(void) {
                        function_bytecode_compiled);
 }
 
+static void test_compiler_compiles_while(void) {
+  const char *source = "(while x (x))";
+  uint8_t bytecode[] = {// jump to condition
+                        HLL_BC_JMP, 0x00, 0x05,
+                        // (x)
+                        HLL_BC_LOADVAR, 0x00, HLL_BC_NIL, HLL_BC_CALL,
+                        HLL_BC_POP,
+                        // x
+                        HLL_BC_LOADVAR, 0x00, HLL_BC_JT, 0xFF, 0xF6,
+                        // result
+                        HLL_BC_NIL, HLL_BC_END};
+  struct hll_vm *vm = hll_make_vm(NULL);
+
+  hll_value result;
+  bool is_compiled = hll_compile(vm, source, "", &result);
+  TEST_ASSERT(is_compiled);
+  struct hll_bytecode *compiled = hll_unwrap_func(result)->bytecode;
+  test_bytecode_equals(bytecode, sizeof(bytecode), compiled);
+}
+
+static void test_compiler_compiles_infinite_while(void) {
+  const char *source = "(while t 1)";
+  // 1 is evaluated only for side effects, so it is removed. Condition is
+  // always true, so loop is a jump to itself.
+  uint8_t bytecode[] = {HLL_BC_JMP, 0xFF, 0xFD, HLL_BC_NIL, HLL_BC_END};
+  struct hll_vm *vm = hll_make_vm(NULL);
+
+  hll_value result;
+  bool is_compiled = hll_compile(vm, source, "", &result);
+  TEST_ASSERT(is_compiled);
+  struct hll_bytecode *compiled = hll_unwrap_func(result)->bytecode;
+  test_bytecode_equals(bytecode, sizeof(bytecode), compiled);
+}
+
+static void test_compiler_compiles_long_jump(void) {
+  // Positive arm does not fit in short jump offset.
+  static char source[65536];
+  strcpy(source, "(if x (progn");
+  for (size_t i = 0; i < 8000; ++i) {
+    strcat(source, " (x)");
+  }
+  strcat(source, ") 1)");
+  struct hll_vm *vm = hll_make_vm(NULL);
+
+  hll_value result;
+  bool is_compiled = hll_compile(vm, source, "", &result);
+  TEST_ASSERT(is_compiled);
+  struct hll_bytecode *compiled = hll_unwrap_func(result)->bytecode;
+  TEST_ASSERT(hll_sb_len(compiled->ops) > 32768);
+  uint8_t prefix[] = {HLL_BC_LOADVAR, 0x00, HLL_BC_WIDE, HLL_BC_JN};
+  TEST_CHECK(memcmp(prefix, compiled->ops, sizeof(prefix)) == 0);
+  // Jump out of positive arm goes to the end, so it is replaced by return.
+  uint8_t suffix[] = {HLL_BC_CALL, HLL_BC_END, HLL_BC_CONST, 0x01,
+                      HLL_BC_END};
+  TEST_CHECK(memcmp(suffix,
+                    compiled->ops + hll_sb_len(compiled->ops) -
+                        sizeof(suffix),
+                    sizeof(suffix)) == 0);
+}
+
+static void test_compiler_compiles_large_constant_pool(void) {
+  // Constant indices of 128 and more take several bytes.
+  static char source[131072];
+  strcpy(source, "(list");
+  for (size_t i = 0; i < 20000; ++i) {
+    sprintf(source + strlen(source), " %zu", i);
+  }
+  strcat(source, ")");
+  struct hll_vm *vm = hll_make_vm(NULL);
+
+  hll_value result;
+  bool is_compiled = hll_compile(vm, source, "", &result);
+  TEST_ASSERT(is_compiled);
+  struct hll_bytecode *compiled = hll_unwrap_func(result)->bytecode;
+  TEST_ASSERT(hll_sb_len(compiled->constant_pool) == 20000);
+  uint8_t suffix[] = {HLL_BC_CONST,  0x81,       0x9C,      0x1F,
+                      HLL_BC_APPEND, HLL_BC_POP, HLL_BC_END};
+  TEST_CHECK(memcmp(suffix,
+                    compiled->ops + hll_sb_len(compiled->ops) -
+                        sizeof(suffix),
+                    sizeof(suffix)) == 0);
+}
+
+static void test_compiler_deduplicates_many_constants(void) {
+  // Constants are looked up in hash table, so repeated ones are found even
+  // when pool is large.
+  static char source[524288];
+  strcpy(source, "(list");
+  for (size_t i = 0; i < 70000; ++i) {
+    sprintf(source + strlen(source), " %zu", i);
+  }
+  strcat(source, " 69999 0)");
+  struct hll_vm *vm = hll_make_vm(NULL);
+
+  hll_value result;
+  bool is_compiled = hll_compile(vm, source, "", &result);
+  TEST_ASSERT(is_compiled);
+  struct hll_bytecode *compiled = hll_unwrap_func(result)->bytecode;
+  TEST_ASSERT(hll_sb_len(compiled->constant_pool) == 70000);
+  uint8_t suffix[] = {HLL_BC_CONST,  0x84,         0xA2, 0x6F,
+                      HLL_BC_APPEND, HLL_BC_CONST, 0x00, HLL_BC_APPEND,
+                      HLL_BC_POP,    HLL_BC_END};
+  TEST_CHECK(memcmp(suffix,
+                    compiled->ops + hll_sb_len(compiled->ops) -
+                        sizeof(suffix),
+                    sizeof(suffix)) == 0);
+}
+
 static void test_compiler_generates_mbtr(void) {
   const char *source = "(define (tr) (tr))";
-  uint8_t bytecode[] = {HLL_BC_CONST,    0x00,       0x00,       HLL_BC_FIND,
-                        HLL_BC_CDR,      HLL_BC_NIL, HLL_BC_NIL, HLL_BC_POP,
-                        HLL_BC_MBTRCALL, HLL_BC_END};
+  uint8_t bytecode[] = {HLL_BC_LOADVAR, 0x00, HLL_BC_NIL, HLL_BC_MBTRCALL,
+                        HLL_BC_END};
 
   struct hll_vm *vm = hll_make_vm(NULL);
   hll_value result;
@@ -474,35 +569,15 @@ static void test_compiler_generates_mbtr(void) {
 
 static void test_compiler_generates_mbtr_in_if(void) {
   const char *source = "(define (tr a) (if a (tr a)))";
-  uint8_t bytecode[] = {HLL_BC_CONST,
-                        0x00,
-                        0x00,
-                        HLL_BC_FIND,
-                        HLL_BC_CDR,
-                        HLL_BC_JN,
-                        0x00,
-                        0x13,
-                        HLL_BC_CONST,
-                        0x00,
-                        0x01,
-                        HLL_BC_FIND,
-                        HLL_BC_CDR,
-                        HLL_BC_NIL,
-                        HLL_BC_NIL,
-                        HLL_BC_CONST,
-                        0x00,
-                        0x00,
-                        HLL_BC_FIND,
-                        HLL_BC_CDR,
-                        HLL_BC_APPEND,
-                        HLL_BC_POP,
-                        HLL_BC_MBTRCALL,
-                        HLL_BC_NIL,
-                        HLL_BC_JN,
-                        0x00,
-                        0x01,
-                        HLL_BC_NIL,
-                        HLL_BC_END};
+  uint8_t bytecode[] = {// a
+                        HLL_BC_LOADVAR, 0x00, HLL_BC_JN, 0x00, 0x0A,
+                        // (tr a)
+                        HLL_BC_LOADVAR, 0x01, HLL_BC_NIL, HLL_BC_NIL,
+                        HLL_BC_LOADVAR, 0x00, HLL_BC_APPEND, HLL_BC_POP,
+                        // Jump over else branch is replaced with return.
+                        HLL_BC_MBTRCALL, HLL_BC_END,
+                        // else
+                        HLL_BC_NIL, HLL_BC_END};
 
   struct hll_vm *vm = hll_make_vm(NULL);
   hll_value result;
@@ -517,21 +592,59 @@ static void test_compiler_generates_mbtr_in_if(void) {
   test_bytecode_equals(bytecode, sizeof(bytecode), function_bytecode_compiled);
 }
 
+// Counts permanent vectors of given length.
+static size_t count_perm_vecs(struct hll_vm *vm, size_t length) {
+  size_t count = 0;
+  for (hll_obj *obj = vm->gc->perm_objs; obj != NULL; obj = obj->next_gc) {
+    if (obj->kind == HLL_VALUE_VEC &&
+        ((hll_obj_vec *)obj->as)->length == length) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+static void test_freeze_heap_skips_unreachable_objects(void) {
+  const char *source = "(define kept (make-vector 3)) (make-vector 5) ()";
+
+  struct hll_vm *vm = hll_make_vm(NULL);
+  TEST_ASSERT(hll_interpret(vm, source, "", 0) == HLL_RESULT_OK);
+  hll_freeze_heap(vm);
+  TEST_CHECK(count_perm_vecs(vm, 3) == 1);
+  TEST_CHECK(count_perm_vecs(vm, 5) == 0);
+  TEST_CHECK(vm->gc->all_objs == NULL);
+  hll_delete_vm(vm);
+}
+
 #define TCASE(_name)                                                           \
   { #_name, _name }
 
 TEST_LIST = {TCASE(test_compiler_compiles_integer),
              TCASE(test_compiler_compiles_addition),
              TCASE(test_compiler_compiles_complex_arithmetic_operation),
+             TCASE(test_compiler_compiles_call_with_variable),
              TCASE(test_compiler_compiles_if),
+             TCASE(test_compiler_compiles_and_in_if),
+             TCASE(test_compiler_compiles_or),
+             TCASE(test_compiler_compiles_case),
+             TCASE(test_compiler_propagates_constant_define),
              TCASE(test_compiler_compiles_quote),
              TCASE(test_compiler_compiles_define),
              TCASE(test_compiler_compiles_let),
              TCASE(test_compiler_compiles_let_with_body),
              TCASE(test_compiler_compiles_setf_symbol),
              TCASE(test_compiler_compiles_setf_cdr),
+             TCASE(test_compiler_compiles_cons),
+             TCASE(test_compiler_compiles_vector_ref),
+             TCASE(test_compiler_compiles_setf_vector_ref),
              TCASE(test_compiler_compiles_macro),
              TCASE(test_compiler_compiles_lambda),
+             TCASE(test_compiler_compiles_while),
+             TCASE(test_compiler_compiles_infinite_while),
+             TCASE(test_compiler_compiles_long_jump),
+             TCASE(test_compiler_compiles_large_constant_pool),
+             TCASE(test_compiler_deduplicates_many_constants),
              TCASE(test_compiler_generates_mbtr),
              TCASE(test_compiler_generates_mbtr_in_if),
+             TCASE(test_freeze_heap_skips_unreachable_objects),
              {NULL, NULL}};
@@ -329,6 +329,41 @@ static void test_lexer_reports_too_big_integer(void) {
   TEST_ASSERT(lexer.next.kind == HLL_TOK_EOF);
 }
 
+static void test_lexer_parses_string(void) {
+  struct hll_vm *vm = hll_make_vm(NULL);
+  hll_translation_unit tu = hll_make_tu(vm, NULL, NULL, 0);
+  hll_lexer lexer;
+  hll_lexer_init(&lexer, "\"a\\\"b\"c", &tu);
+
+  hll_lexer_next(&lexer);
+  TEST_ASSERT(lexer.error_count == 0);
+  TEST_ASSERT(lexer.next.kind == HLL_TOK_STRING);
+  TEST_ASSERT(lexer.next.offset == 0);
+  TEST_ASSERT(lexer.next.length == 6);
+
+  hll_lexer_next(&lexer);
+  TEST_ASSERT(lexer.error_count == 0);
+  TEST_ASSERT(lexer.next.kind == HLL_TOK_SYMB);
+
+  hll_lexer_next(&lexer);
+  TEST_ASSERT(lexer.error_count == 0);
+  TEST_ASSERT(lexer.next.kind == HLL_TOK_EOF);
+}
+
+static void test_lexer_reports_unterminated_string(void) {
+  struct hll_vm *vm = hll_make_vm(NULL);
+  hll_translation_unit tu = hll_make_tu(vm, NULL, NULL, 0);
+  hll_lexer lexer;
+  hll_lexer_init(&lexer, "\"abc", &tu);
+
+  hll_lexer_next(&lexer);
+  TEST_ASSERT(lexer.error_count);
+  TEST_ASSERT(lexer.next.kind == HLL_TOK_STRING);
+
+  hll_lexer_next(&lexer);
+  TEST_ASSERT(lexer.next.kind == HLL_TOK_EOF);
+}
+
 #define TCASE(_name)                                                           \
   { #_name, _name }
 
@@ -344,5 +379,7 @@ TEST_LIST = {TCASE(test_lexer_parses_simple_symbol),
              TCASE(test_lexer_reports_symbol_consisting_of_only_dots),
              TCASE(test_lexer_parses_quote),
              TCASE(test_lexer_reports_too_big_integer),
+             TCASE(test_lexer_parses_string),
+             TCASE(test_lexer_reports_unterminated_string),
 
              {NULL, NULL}};
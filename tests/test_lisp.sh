@@ -46,6 +46,20 @@ neg_test () {
   echo "ok"
 }
 
+# Runs each line of input as separate translation unit.
+repl_test () {
+  echo -n "Testing $1 ... "
+
+  result=$(echo "$3" | $EXECUTABLE 2> /dev/null | tail -1)
+  if [ "$result" != "$2" ]; then
+    echo FAILED
+    panic "'$2' expected, but got '$result' $1"
+    return
+  fi
+
+  echo "ok"
+}
+
 pos_test comment 5 "
     ; 2
     5 ; 3"
@@ -136,6 +150,17 @@ pos_test "cons" "((a b) . a)" "(cons '(a b) 'a)"
 pos_test "list" "(1)" "(list 1)"
 pos_test "list" "()" "(list)"
 pos_test "list" "(1 2 3 4)" "(list (+ 0 1) (* 2 1) (/ 9 3) (- 0 -4))"
+pos_test "integer product exact" "281474976710655" "(* 16777215 16777217)"
+pos_test "integer promoted to double" "281474976710656" "(+ 281474976710655 1)"
+pos_test "negative integer promoted" "-281474976710657" "(- -281474976710656 1)"
+pos_test "non-integral division" "0.1" "(/ 1 10)"
+pos_test "integral division" "3" "(/ 9 3)"
+pos_test "mixed arithmetic" "1.5" "(+ 1 (/ 1 2))"
+pos_test "double back to integer" "2" "(* (/ 1 2) 4)"
+pos_test "rem negative" "-1" "(rem -7 3)"
+pos_test "range negative" "(-2 -1 0)" "(range -2 1)"
+pos_test "integral double as hash key" "a" "(define h (make-hash)) (hash-set! h 2 'a) (hash-ref h (/ 4 2))"
+neg_test "non-integral vector index" "(vector-ref (vector 1 2) (/ 1 2))"
 
 neg_test "setcar! args" "(setcar!)"
 neg_test "setcar! args" "(setcar! '(1))"
@@ -280,15 +305,58 @@ pos_test "when true" "t" "(when t t)"
 pos_test "when false" "()" "(when () t)"
 pos_test "unless true" "()" "(unless t t)"
 pos_test "unless false" "t" "(unless () t)"
+pos_test "when body" "3" "(when t 1 2 3)"
+pos_test "when empty body" "()" "(when t)"
+pos_test "unless body" "3" "(define x 0) (unless () (set! x 2) (+ x 1))"
+pos_test "when and cond" "1" "(when (and t (not ())) 1)"
+neg_test "when args" "(when)"
+neg_test "unless args" "(unless)"
 
 pos_test "or true" "1" "(or () () 1)"
 pos_test "or false" "()" "(or () () ())"
 pos_test "and true" "3" "(and 1 2 3)"
 pos_test "and false" "()" "(and () () ())"
+pos_test "or empty" "()" "(or)"
+pos_test "and empty" "t" "(and)"
+pos_test "or value" "2" "(define x 2) (or () x 3)"
+pos_test "and value" "(1 2)" "(define x (list 1 2)) (and t x)"
+pos_test "or short circuit" "(1 0)" "(define x 0) (list (or 1 (set! x 1)) x)"
+pos_test "and short circuit" "0" "(define x 0) (and () (set! x 1)) x"
+pos_test "or in if" "(1 2)" "(define (f x y) (if (or x y) 1 2)) (list (f () t) (f () ()))"
+pos_test "and in if" "(1 2)" "(define (f x y) (if (and x y) 1 2)) (list (f t t) (f t ()))"
+pos_test "nested and or" "(t () t ())" "(define (f x y z) (if (or (and x y) (not z)) t ())) (list (f t t t) (f t () t) (f () () ()) (f () t t))"
+pos_test "and or in while" "5" "(define i 0) (while (and (< i 10) (not (= i 5))) (set! i (+ i 1))) i"
+pos_test "and tail call" "t" "(define (f n) (and (< -1 n) (or (= n 0) (f (- n 1))))) (f 100000)"
+pos_test "or tail call" "t" "(define (f n) (or (= n 0) (f (- n 1)))) (f 100000)"
+pos_test "and or constant" "(3 () 1 t)" "(list (and 1 2 3) (and 1 () x) (or () 1 x) (not (not 2)))"
 
 pos_test "not true" "()" "(not t)"
 pos_test "not nil" "t" "(not ())"
 pos_test "not eval" "()" "(not (+ 1 2))"
+neg_test "not args" "(not 1 2)"
+
+pos_test "cond" "2" "(define x 5) (cond ((< x 3) 1) ((< x 10) 2) (t 3))"
+pos_test "cond default" "3" "(define x 50) (cond ((< x 3) 1) ((< x 10) 2) (t 3))"
+pos_test "cond no match" "()" "(define x 50) (cond ((< x 3) 1) ((< x 10) 2))"
+pos_test "cond empty" "()" "(cond)"
+pos_test "cond test value" "(1 2)" "(define x (list 1 2)) (cond ((car ()) 1) (x))"
+pos_test "cond body" "3" "(define x 0) (cond (t (set! x 2) (+ x 1)))"
+pos_test "cond short circuit" "0" "(define x 0) (cond (t x) ((set! x 1) 2))"
+pos_test "cond and" "2" "(define x 5) (cond ((and (< 0 x) (< x 3)) 1) ((and (< 3 x) (< x 6)) 2))"
+neg_test "cond clause" "(cond 1)"
+pos_test "case number" "b" "(case (+ 1 1) (1 'a) (2 'b) (3 'c))"
+pos_test "case symbol" "2" "(define (f op) (case op (add 1) (sub 2) (t 3))) (f 'sub)"
+pos_test "case key list" "(1 1 2 3)" "(define (f x) (case x ((a b) 1) ((c 4) 2) (t 3))) (list (f 'a) (f 'b) (f 4) (f 'd))"
+pos_test "case default" "3" "(case 'x (a 1) (t 2 3))"
+pos_test "case no match" "()" "(case 'x (a 1) (b 2))"
+pos_test "case first key wins" "1" "(case 1 (1 1) ((2 1) 2))"
+pos_test "case non key value" "d" "(case (list 1) (1 'a) (t 'd))"
+pos_test "case empty body" "()" "(case 1 (1))"
+pos_test "case dispatch loop" "(3 1 1)" "(define (run ops acc) (if ops (run (cdr ops) (case (car ops) (inc (+ acc 1)) (dec (- acc 1)) (dbl (* acc 2)) (t acc))) acc)) (list (run '(inc dbl inc) 0) (run '(inc nop) 0) (run '(inc inc dec dbl dec) 0))"
+pos_test "case tail call" "done" "(define (f n) (case n (0 'done) (t (f (- n 1))))) (f 100000)"
+neg_test "case args" "(case)"
+neg_test "case key" "(case 1 (\"a\" 1))"
+neg_test "case clause" "(case 1 2)"
 
 pos_test "set!" "321" "(define x 123)
 (set! x 321)
@@ -326,6 +394,100 @@ pos_test "nth first" "0" "(nth 0 '(0 1 2 3))"
 pos_test "nth second" "1" "(nth 1 '(0 1 2 3))"
 pos_test "nth more than length" "()" "(nth 100 '(0 1 2 3))"
 
+pos_test "vector" "#(1 2 3)" "(vector 1 2 3)"
+pos_test "vector empty" "#()" "(vector)"
+pos_test "make-vector" "#(() ())" "(make-vector 2)"
+pos_test "make-vector fill" "#(0 0 0)" "(make-vector 3 0)"
+neg_test "make-vector args" "(make-vector)"
+neg_test "make-vector negative" "(make-vector -1)"
+pos_test "vector-length" "3" "(vector-length (vector 1 2 3))"
+neg_test "vector-length non-vector" "(vector-length '(1 2 3))"
+pos_test "vector?" "t" "(vector? (vector))"
+pos_test "vector? list" "()" "(vector? '(1))"
+pos_test "vector-ref" "2" "(vector-ref (vector 1 2 3) 1)"
+neg_test "vector-ref args" "(vector-ref (vector 1 2 3))"
+neg_test "vector-ref out of bounds" "(vector-ref (vector 1 2 3) 3)"
+neg_test "vector-ref negative" "(vector-ref (vector 1 2 3) -1)"
+neg_test "vector-ref non-vector" "(vector-ref '(1 2 3) 0)"
+pos_test "vector-set!" "#(1 0 3)" "(vector-set! (vector 1 2 3) 1 0)"
+neg_test "vector-set! out of bounds" "(vector-set! (vector 1 2 3) 3 0)"
+pos_test "set! vector-ref" "#(1 2 0)" "(define v (vector 1 2 3)) (set! (vector-ref v 2) 0) v"
+pos_test "list->vector" "#(1 2 3)" "(list->vector '(1 2 3))"
+pos_test "vector->list" "(1 2 3)" "(vector->list (vector 1 2 3))"
+pos_test "vector of lists" "#((1 2) (3))" "(define v (make-vector 2)) (vector-set! v 0 (list 1 2)) (vector-set! v 1 (list 3)) (length (range 100)) v"
+pos_test "f64array" "#f64(1 2 3)" "(f64array 1 2 3)"
+neg_test "f64array non-number" "(f64array 1 'a)"
+pos_test "make-f64array" "#f64(0 0)" "(make-f64array 2)"
+pos_test "make-f64array fill" "#f64(3 3 3)" "(make-f64array 3 3)"
+pos_test "f64array-length" "3" "(f64array-length (f64array 1 2 3))"
+pos_test "f64array?" "t" "(f64array? (f64array))"
+pos_test "f64array? vector" "()" "(f64array? (vector))"
+pos_test "f64array-ref" "2" "(f64array-ref (f64array 1 2 3) 1)"
+neg_test "f64array-ref out of bounds" "(f64array-ref (f64array 1 2 3) 3)"
+pos_test "f64array-set!" "#f64(1 0 3)" "(f64array-set! (f64array 1 2 3) 1 0)"
+pos_test "list->f64array" "#f64(1 2 3)" "(list->f64array '(1 2 3))"
+pos_test "f64array->list" "(1 2 3)" "(f64array->list (f64array 1 2 3))"
+pos_test "f64+" "#f64(5 7 9 11 13)" "(f64+ (f64array 1 2 3 4 5) (f64array 4 5 6 7 8))"
+pos_test "f64-" "#f64(-3 -3 -3)" "(f64- (f64array 1 2 3) (f64array 4 5 6))"
+pos_test "f64*" "#f64(4 10 18)" "(f64* (f64array 1 2 3) (f64array 4 5 6))"
+neg_test "f64+ length mismatch" "(f64+ (f64array 1 2) (f64array 1))"
+neg_test "f64+ non-array" "(f64+ (f64array 1) (vector 1))"
+pos_test "f64-scale" "#f64(2 4 6 8 10)" "(f64-scale (f64array 1 2 3 4 5) 2)"
+pos_test "f64-fma" "#f64(7 11 15)" "(f64-fma (f64array 1 2 3) (f64array 4 4 4) (f64array 3 3 3))"
+pos_test "f64<" "#f64(1 0 0 0 1)" "(f64< (f64array 1 5 2 4 0) (make-f64array 5 2))"
+pos_test "f64<=" "#f64(1 0 1 0 1)" "(f64<= (f64array 1 5 2 4 0) (make-f64array 5 2))"
+pos_test "f64>" "#f64(0 1 0 1 0)" "(f64> (f64array 1 5 2 4 0) (make-f64array 5 2))"
+pos_test "f64>=" "#f64(0 1 1 1 0)" "(f64>= (f64array 1 5 2 4 0) (make-f64array 5 2))"
+pos_test "f64=" "#f64(0 0 1 0 0)" "(f64= (f64array 1 5 2 4 0) (make-f64array 5 2))"
+pos_test "f64-sum" "2002" "(f64-sum (make-f64array 1001 2))"
+pos_test "f64-sum empty" "0" "(f64-sum (f64array))"
+pos_test "f64-sum mask" "2" "(f64-sum (f64< (f64array 1 5 2 4 0) (make-f64array 5 2)))"
+pos_test "f64-min" "-1" "(f64-min (f64array 5 3 9 -1 4 7 2 11 0))"
+pos_test "f64-max" "11" "(f64-max (f64array 5 3 9 -1 4 7 2 11 0))"
+neg_test "f64-min empty" "(f64-min (f64array))"
+pos_test "f64-dot" "54" "(f64-dot (make-f64array 9 2) (make-f64array 9 3))"
+pos_test "f64array survives gc" "4950" "(define a (list->f64array (range 100))) (length (range 1000)) (f64-sum a)"
+pos_test "make-hash" "#hash()" "(make-hash)"
+neg_test "make-hash args" "(make-hash 1)"
+pos_test "hash?" "t" "(hash? (make-hash))"
+pos_test "hash? list" "()" "(hash? '(1))"
+pos_test "hash-set!" "1" "(hash-set! (make-hash) 'a 1)"
+pos_test "hash-ref symbol" "1" "(define h (make-hash)) (hash-set! h 'a 1) (hash-set! h 'b 2) (hash-ref h 'a)"
+pos_test "hash-ref number" "b" "(define h (make-hash)) (hash-set! h 2 'b) (hash-ref h (+ 1 1))"
+pos_test "hash-ref missing" "()" "(hash-ref (make-hash) 'a)"
+pos_test "hash-ref default" "5" "(hash-ref (make-hash) 'a 5)"
+neg_test "hash-ref non-hash" "(hash-ref '((a . 1)) 'a)"
+pos_test "hash-set! replaces" "#hash((x . 2))" "(define h (make-hash)) (hash-set! h 'x 1) (hash-set! h 'x 2) h"
+pos_test "hash-remove!" "(t () 0)" "(define h (make-hash)) (hash-set! h 1 2) (list (hash-remove! h 1) (hash-remove! h 1) (hash-count h))"
+pos_test "hash-count" "(500 5929)" "(define h (make-hash)) (define (fill n) (when (< 0 n) (hash-set! h n (* n n)) (fill (- n 1)))) (fill 500) (list (hash-count h) (hash-ref h 77))"
+pos_test "hash reinsert after remove" "(100 50)" "(define h (make-hash)) (define (fill n) (when (< 0 n) (hash-set! h n n) (hash-remove! h n) (hash-set! h n n) (fill (- n 1)))) (fill 100) (list (hash-count h) (hash-ref h 50))"
+pos_test "hash-keys" "(a)" "(define h (make-hash)) (hash-set! h 'a 1) (hash-keys h)"
+pos_test "hash-values" "(1)" "(define h (make-hash)) (hash-set! h 'a 1) (hash-values h)"
+pos_test "hash->alist" "((a . 1))" "(define h (make-hash)) (hash-set! h 'a 1) (hash->alist h)"
+pos_test "hash cons keys survive gc" "ok" "(define h (make-hash)) (define ks (range 300)) (define (fill l) (when l (hash-set! h l (car l)) (fill (cdr l)))) (fill ks) (length (range 3000)) (define (chk l) (if l (if (= (hash-ref h l) (car l)) (chk (cdr l)) 'bad) 'ok)) (chk ks)"
+
+pos_test "string literal" "hello" '"hello"'
+pos_test "string escapes" 'a"b\c' '"a\"b\\c"'
+pos_test "string?" "(t ())" '(list (string? "") (string? (quote a)))'
+pos_test "string-length" "6" '(string-length "héllo")'
+pos_test "substring" "world" '(substring "hello world" 6)'
+pos_test "substring range" "ell" '(substring "hello" 1 4)'
+pos_test "substring of view" "l" '(substring (substring "hello" 1 4) 1 2)'
+pos_test "substring keeps parent alive" "bc" '(define s (substring (string-append "ab" "cd") 1 3)) (length (range 3000)) s'
+pos_test "string-append" "abcd" '(string-append "a" (substring "xbcx" 1 3) "d")'
+pos_test "string=?" "(t ())" '(list (string=? "ab" (substring "xab" 1)) (string=? "ab" "abc"))'
+pos_test "symbol->string" "foo" "(symbol->string 'foo)"
+pos_test "string->symbol" "(1 ())" "(define h (make-hash)) (hash-set! h 'bar 1) (list (hash-ref h (string->symbol \"bar\")) (hash-ref h \"bar\"))"
+pos_test "number->string" "(-12 1.5)" '(list (number->string -12) (number->string (/ 3 2)))'
+pos_test "string->number" "(2.25 ())" '(list (string->number "2.25") (string->number "2x"))'
+pos_test "string->number exponent" "(-150 ())" '(list (string->number "-1.5e2") (string->number "e5"))'
+pos_test "string->number special forms" "(() () () () ())" '(list (string->number "nan") (string->number "-nan(0x4000000001234)") (string->number "nan(0x6000000000007)") (string->number "inf") (string->number "0x10"))'
+neg_test "string->number nan payload" '(+ 1 (string->number "nan(0x6000000000007)"))'
+pos_test "nan is number" "t" '(define i (string->number "1e999")) (number? (- i i))'
+pos_test "string builder" "x=42;y" "(define b (make-string-builder)) (string-builder-append! b \"x=\") (string-builder-append! b 42) (string-builder-append! b \";\") (string-builder-append! b 'y) (string-builder->string b)"
+pos_test "string builder grows" "1000" "(define b (make-string-builder)) (define (fill n) (when (< 0 n) (string-builder-append! b \"x\") (fill (- n 1)))) (fill 1000) (string-length (string-builder->string b))"
+pos_test "string hash keys" "1" '(define h (make-hash)) (hash-set! h "k" 1) (hash-ref h (substring "xk" 1))'
+
 neg_test "set! args" "(set! 1)"
 neg_test "set! bogus" "(set! 1 2)"
 pos_test "set! nth" "(1 2 4)" "(define a '(1 2 3)) (set! (nth 2 a) 4) a"
@@ -339,6 +501,9 @@ pos_test "macro" "42" "(defmacro (if-zero x then) (list 'if (list '= x 0) then))
   (if-zero 0 42)"
 neg_test "defmacro args" "(defmacro)"
 neg_test "defmacro args" "(defmacro (1) ())"
+neg_test "defmacro redefined" "(defmacro (m) 1) (defmacro (m) 2)"
+many_macros=$(seq 100 | sed 's/.*/(defmacro (m&) &)/')
+pos_test "many macros" "(1 50 100)" "$many_macros (list (m1) (m50) (m100))"
 
 pos_test "restargs" "(3 5 7)" "(define (f x . y) (cons x y)) (f 3 5 7)"
 pos_test "restargs" "(3)" "(define (f x . y) (cons x y)) (f 3)"
@@ -353,18 +518,167 @@ pos_test "random high low" "t" "(define (test) (let ((x (random 1024 2048))) (an
 
 pos_test "scopes" "10" "(define (f) y) (define y 10) (f)"
 neg_test "scopes" "(define (f x) (g)) (define (g) x) (f 10)"
+neg_test "heap-profile disabled" "(heap-profile)"
 pos_test "closure scopes" "10" "(define (f) (define fn (lambda () x)) (define x 10) fn) ((f))"
 
 pos_test "heads" "(1 3 5 7)" "(heads '((1) (3 2 4) (5 5 5) (7 1 2 34)))"
 
 pos_test "map" "(2 4 6 8)" "(map (lambda (it) (* 2 it)) (list 1 2 3 4))"
 pos_test "amap" "(2 4 6 8)" "(amap (* 2 it) (list 1 2 3 4))"
+pos_test "map builtin" "(2 1)" "(map length '((1 a) (2)))"
+pos_test "map nested" "((1 2) (2 4))" "(map (lambda (x) (map (lambda (y) (* x y)) (list 1 2))) (list 1 2))"
+pos_test "map long list" "5000" "(length (map (lambda (x) (+ x 1)) (range 5000)))"
+pos_test "map survives gc" "(0 1 4 9)" "(define l (map (lambda (x) (length (range 100)) (* x x)) (range 200))) (list (nth 0 l) (nth 1 l) (nth 2 l) (nth 3 l))"
+neg_test "map error in callback" "(map (lambda (x) (car x)) (list 1 2))"
+neg_test "map improper list" "(map length 5)"
+pos_test "filter" "(1 3 5 7 9)" "(filter odd? (range 10))"
+pos_test "afilter" "(3 4)" "(afilter (> it 2) (list 1 2 3 4))"
+pos_test "mapcat" "(1 1 2 2 3 3)" "(mapcat (lambda (x) (list x x)) (list 1 2 3))"
+pos_test "mapcat nil results" "(2 2)" "(mapcat (lambda (x) (when (even? x) (list x x))) (list 1 2 3))"
+pos_test "any" "30" "(any (lambda (x) (when (> x 2) (* x 10))) (list 1 2 3 4))"
+pos_test "any none" "()" "(any odd? (list 2 4))"
+pos_test "all" "(t () t)" "(list (all odd? (list 1 3)) (all odd? (list 1 2)) (all odd? ()))"
+pos_test "count" "5" "(count odd? (range 11))"
+pos_test "acount" "2" "(acount (> it 2) (list 1 2 3 4))"
+pos_test "repeat" "(a a a)" "(repeat 3 'a)"
+
+pos_test "sort" "(1 1 2 3 4 5)" "(sort (list 5 3 1 4 1 2))"
+pos_test "sort >" "(5 4 3 2 1)" "(sort (list 3 5 1 4 2) >)"
+pos_test "sort empty" "(() ())" "(list (sort ()) (sort () >))"
+pos_test "sort comparator is stable" "((0 . b) (0 . d) (1 . a) (1 . c))" "(sort (list '(1 . a) '(0 . b) '(1 . c) '(0 . d)) (lambda (a b) (< (car a) (car b))))"
+pos_test "sort key is stable" "((0 . b) (0 . d) (1 . a) (1 . c))" "(sort (list '(1 . a) '(0 . b) '(1 . c) '(0 . d)) < (lambda (x) (car x)))"
+pos_test "sort sorted input" "(0 1 2 3 4 5 6 7 8 9)" "(sort (range 10))"
+pos_test "sort long list" "(0 1 2 1999)" "(define l (sort (map (lambda (x) (rem (* x 7919) 2000)) (range 2000)))) (list (nth 0 l) (nth 1 l) (nth 2 l) (nth 1999 l))"
+pos_test "sort comparator survives gc" "(1 2 3 4 5)" "(sort (list 5 3 1 4 2) (lambda (a b) (length (range 300)) (< a b)))"
+pos_test "sort vector" "#(1 2 3)" "(sort (vector 3 1 2))"
+pos_test "sort vector in place" "#(3 2 1)" "(define v (vector 1 3 2)) (sort v >) v"
+pos_test "sort vector key" "#(1 2 3 4 5)" "(sort (vector 3 1 2 5 4) > (lambda (x) (- x)))"
+neg_test "sort non-numbers with <" "(sort (list 1 'a))"
+neg_test "sort atom" "(sort 5)"
 
 pos_test "reduce sum" "17" "(reduce (lambda (a b) (+ a b)) (list 1 3 5 6 2))"
 pos_test "reduce max" "6" "(reduce (lambda (a b) (if (> a b) a b)) (list 1 3 5 6 2))"
+pos_test "reduce is right fold" "9" "(reduce - (list 10 4 3))"
+pos_test "reduce single" "(1 ())" "(list (reduce + (list 1)) (reduce + ()))"
+pos_test "reduce long list" "12497500" "(reduce + (range 5000))"
 
 pos_test "range" "(0 1 2 3 4)" "(range 5)"
 pos_test "range" "(5 6 7 8 9)" "(range 5 10)"
+pos_test "range large" "2000" "(length (range 2000))"
+pos_test "shared tail" "(0 5 3)" "(define a (list 1 2 3)) (define b (cons 0 (cdr a))) (length (range 100)) (set! (car (cdr a)) 5) b"
+
+pos_test "while" "5" "(define i 0) (while (< i 5) (set! i (+ i 1))) i"
+pos_test "while returns nil" "()" "(define i 0) (while (< i 3) (set! i (+ i 1)))"
+pos_test "while false" "0" "(define i 0) (while () (set! i 1)) i"
+pos_test "dotimes" "45" "(define s 0) (dotimes (i 10) (set! s (+ s i))) s"
+pos_test "dotimes result" "3" "(dotimes (i 3 i))"
+pos_test "dotimes zero" "()" "(dotimes (i 0) (print i))"
+pos_test "dotimes nested" "(12 30)" "(define n 0) (define s 0)
+(dotimes (i 3) (dotimes (j 4) (set! n (+ n 1)) (set! s (+ s i j)))) (list n s)"
+pos_test "dotimes scope" "(0 (0 1 2))" "(define i 0) (define r ())
+(dotimes (i 3) (set! r (append r (list i)))) (list i r)"
+pos_test "dotimes closure" "(3 3 3)" "(define fs ())
+(dotimes (i 3) (set! fs (cons (lambda () i) fs))) (map (lambda (f) (f)) fs)"
+pos_test "dotimes long" "12497500" "(define s 0) (dotimes (i 5000 s) (set! s (+ s i)))"
+pos_test "dolist" "(3 2 1)" "(define r ()) (dolist (x (list 1 2 3) r) (set! r (cons x r)))"
+pos_test "dolist empty" "1" "(dolist (x () 1) (print x))"
+pos_test "dolist tail call in result" "0" "(define (f l n) (dolist (x l n) (set! n (+ n x)))) (f (list 1 2 3) -6)"
+
+# Bodies that don't fit in short jump offsets.
+long_body=$(printf ' (set! s (+ s 1))%.0s' $(seq 4000))
+pos_test "while long body" "8000" "(define i 0) (define s 0) (while (< i 2) (set! i (+ i 1))$long_body) s"
+pos_test "dotimes long body" "12000" "(define s 0) (dotimes (i 3 s)$long_body)"
+pos_test "if long arm" "4001" "(define s 1) (if s (progn$long_body s) 0)"
+pos_test "if long arm skipped" "0" "(define s ()) (if s (progn$long_body s) 0)"
+pos_test "case long clause" "(4001 0)" "(define s 1) (define (f x) (case x (a$long_body s) (t 0))) (list (f 'a) (f 'b))"
+
+many_constants=$(seq -s ' ' 0 16999)
+pos_test "many constants" "(17000 16999)" "(define l (list $many_constants)) (list (length l) (nth 16999 l))"
+
+neg_test "dotimes not number" "(dotimes (i 'a))"
+neg_test "dotimes variable changed" "(dotimes (i 3) (set! i 'a))"
+neg_test "dotimes bad spec" "(dotimes i)"
+neg_test "dolist not list" "(dolist (x 1))"
+neg_test "dolist improper list" "(dolist (x (cons 1 2)))"
+neg_test "while no condition" "(while)"
+
+pos_test "irange" "#range(0 5 1)" "(irange 5)"
+pos_test "irange length" "(5 3 0 4)" "(list (length (irange 5)) (length (irange 2 10 3)) (length (irange 5 2)) (length (irange 10 -2 -3)))"
+pos_test "map irange" "(0 1 4 9 16)" "(map (lambda (x) (* x x)) (irange 5))"
+pos_test "filter irange" "(5 7 9)" "(filter (lambda (x) (> x 4)) (irange 1 10 2))"
+pos_test "reduce irange" "2" "(reduce - (irange 1 4))"
+pos_test "reduce irange long" "12497500" "(reduce + (irange 5000))"
+pos_test "reduce empty irange" "()" "(reduce + (irange 0))"
+pos_test "count irange" "3" "(count (lambda (x) (> x 6)) (irange 10))"
+pos_test "mapcat irange" "(0 0 1 1 2 2)" "(mapcat (lambda (x) (list x x)) (irange 3))"
+pos_test "dolist irange" "(-9 -6 -3 0)" "(define r ()) (dolist (x (irange 0 -10 -3) r) (set! r (cons x r)))"
+pos_test "irange reused" "(6 6)" "(define r (irange 4)) (list (reduce + r) (reduce + r))"
+
+neg_test "irange zero step" "(irange 1 2 0)"
+neg_test "irange not number" "(irange 'a)"
+neg_test "map not sequence" "(map (lambda (x) x) 1)"
+
+pos_test "fused reduce map filter" "25" "(reduce + (map (lambda (x) (* x x)) (filter (lambda (x) (> x 2)) (list 1 2 3 4))))"
+pos_test "fused map map" "(1 3 5 7 9)" "(map (lambda (x) (+ x 1)) (map (lambda (x) (* x 2)) (irange 5)))"
+pos_test "fused filter map" "(6 8)" "(filter (lambda (x) (> x 4)) (map (lambda (x) (* x 2)) (irange 5)))"
+pos_test "fused count" "2" "(count (lambda (x) (> x 5)) (map (lambda (x) (* x 2)) (irange 5)))"
+pos_test "fused any" "(t 3)" "(define n 0) (list (any (lambda (x) (> x 2)) (map (lambda (x) (set! n (+ n 1)) (* x 2)) (irange 5))) n)"
+pos_test "fused all" "(() t)" "(list (all (lambda (x) (< x 4)) (map (lambda (x) (* x 2)) (irange 5))) (all (lambda (x) t) (filter (lambda (x) ()) (irange 5))))"
+pos_test "fused reduce is right fold" "9" "(reduce - (map (lambda (x) x) (list 10 4 3)))"
+pos_test "fused reduce empty" "()" "(reduce + (filter (lambda (x) ()) (list 1 2)))"
+pos_test "fused long" "12497500" "(reduce + (map (lambda (x) x) (filter (lambda (x) t) (irange 5000))))"
+pos_test "fused rebound global" "15" "(define (map f l) (list 7 8)) (reduce + (map 1 2))"
+pos_test "fused rebound local" "3" "(let ((filter (lambda (p l) (list 1 2)))) (reduce + (filter 1 2)))"
+pos_test "fused with macro" "(2 4)" "(defmacro (filter p l) l) (map (lambda (x) (* x 2)) (filter 1 (list 1 2)))"
+neg_test "fused not sequence" "(reduce + (map (lambda (x) x) 5))"
+pos_test "fused helper name defined" "3" "(define __fused 1) (reduce + (map (lambda (x) x) (list 1 2)))"
+pos_test "fused helper name bound" "3" "(let ((__fused 1)) (reduce + (map (lambda (x) x) (list 1 2))))"
+neg_test "fused helper not visible" "__fused"
+
+pos_test "fold arithmetic" "3600000" "(* 60 60 1000)"
+pos_test "fold nested" "(a 3 t)" "(list (if (< 1 2) 'a 'b) (max 1 (abs -3) (rem 7 4)) (/= 1 2))"
+pos_test "fold if nil" "()" "(if (> 1 2) 1)"
+pos_test "fold define" "(9 10)" "(define w 10) (define (f) (- w 1)) (list (f) w)"
+pos_test "fold define assigned" "3" "(define w 10) (define (f) w) (set! w 3) (f)"
+pos_test "fold define macro assigned" "11" "(define w 10) (define (f) w) (inc! w) (f)"
+pos_test "fold define twice" "7" "(define w 10) (define w 7) w"
+pos_test "fold define shadowed" "(1 10)" "(define w 10) (define (f w) w) (list (f 1) w)"
+pos_test "fold rebound builtin" "(2 15)" "(define (g) (+ 1 2)) (define (+ a b) (* a b)) (list (g) (let ((- *)) (- 5 3)))"
+neg_test "fold zero division" "(/ 1 0)"
+neg_test "fold use before define" "(print w) (define w 1)"
+repl_test "fold define redefined" "19" "(define w 10) (define (f) (- w 1))
+(define w 20)
+(f)"
+repl_test "fold builtin redefined" "99" "(define (f) (* 2 3))
+(define (* a b) 99)
+(f)"
+repl_test "fold define assigned by call" "10" "(define (bump) (set! x 10))
+(define x 5) (bump) x"
+repl_test "fold builtin assigned by call" "2" "(define (rebind) (set! + -))
+(rebind) (+ 5 3)"
+repl_test "fold define assigned in loop" "(5 10 10)" "(define (bump) (set! x 10))
+(define x 5) (define l ()) (dotimes (i 3) (set! l (cons x l)) (bump)) (reverse! l)"
+# Expression that does not fold at the bottom is compiled in linear time.
+deep_sum="$(printf '(+ 1 %.0s' $(seq 4000))s$(printf ')%.0s' $(seq 4000))"
+pos_test "fold deep expression" "4002" "(define s 1) (set! s 2) $deep_sum"
+
+pos_test "native call" "(3 (3 2 1) 5)" "(define (f x) (list (length x) (reverse! x) (abs -5))) (f (list 1 2 3))"
+pos_test "native call order" "(1 2)" "(define s ()) (+ (progn (set! s (cons 2 s)) 1) (progn (set! s (cons 1 s)) 2)) s"
+pos_test "native call param" "7" "(define (f length) (length 1)) (f (lambda (x) 7))"
+pos_test "native call let" "6" "(let ((abs (lambda (x) (* x 2)))) (abs 3))"
+pos_test "native call many args" "45150" "(+ $(seq 300 | tr '\n' ' '))"
+neg_test "native call error" "(define (f) (abs 'a)) (f)"
+repl_test "native redefined" "(6 5)" "(define (f x) (length x))
+(define length reverse!)
+(f (list 5 6))"
+repl_test "native assigned" "7" "(define (f x) (length x))
+(set! length (lambda (x) 7))
+(f (list 5 6))"
+repl_test "native restored" "2" "(define (f x) (length x))
+(define saved length)
+(set! length reverse!)
+(set! length saved)
+(f (list 5 6))"
 
 pos_test "restargs macro" "1" "(defmacro (&& expr . rest)
   (if rest